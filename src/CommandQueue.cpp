@@ -0,0 +1,88 @@
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include "CommandQueue.h"
+#include <windows.h>
+
+////////////////////////////////////////////////////////////
+CommandQueue::CommandQueue(int capacity)
+: mSlots(NULL)
+, mMask(capacity - 1)
+, mPush(0)
+, mPop(0)
+{
+	mSlots = new Slot[capacity];
+	for (int i = 0; i < capacity; i++)
+		mSlots[i].sequence = i;
+}
+
+////////////////////////////////////////////////////////////
+CommandQueue::~CommandQueue()
+{
+	delete[] mSlots;
+}
+
+////////////////////////////////////////////////////////////
+bool CommandQueue::Push(const WebCommand& command)
+{
+	long position = mPush;
+	Slot* slot = NULL;
+
+	for (;;)
+	{
+		slot = &mSlots[position & mMask];
+		long difference = slot->sequence - position;
+
+		if (difference == 0)
+		{
+			//The slot is free, claim the position unless another thread got there first.
+			long previous = InterlockedCompareExchange(&mPush, position + 1, position);
+			if (previous == position)
+				break;
+			position = previous;
+		}
+		else if (difference < 0)
+		{
+			//The slot still holds a command from one lap ago, so the queue is full.
+			return false;
+		}
+		else
+		{
+			//Another thread has filled this position already.
+			position = mPush;
+		}
+	}
+
+	slot->command = command;
+
+	//Publish the command.  The exchange is a full barrier, so the command is written before the sequence.
+	InterlockedExchange(&slot->sequence, position + 1);
+	return true;
+}
+
+////////////////////////////////////////////////////////////
+int CommandQueue::PopBatch(std::vector<WebCommand>& out, int max)
+{
+	int count = 0;
+
+	while (count < max)
+	{
+		Slot* slot = &mSlots[mPop & mMask];
+		if (slot->sequence != mPop + 1)
+			break;
+
+		//Keep the sequence read before the command.
+		MemoryBarrier();
+
+		out.push_back(slot->command);
+
+		//Let go of references held by the command before the slot can be reused.
+		slot->command = WebCommand();
+
+		InterlockedExchange(&slot->sequence, mPop + mMask + 1);
+		mPop++;
+		count++;
+	}
+
+	return count;
+}
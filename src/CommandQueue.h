@@ -0,0 +1,243 @@
+#pragma once
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include <include/cef_browser.h>
+#include <include/cef_scheme.h>
+#include <vector>
+
+////////////////////////////////////////////////////////////
+// Pre-processor Definitions
+////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////
+// Number of commands which can wait for the cef thread at
+// once.  Must be a power of two.
+//
+////////////////////////////////////////////////////////////
+#ifndef WEB_COMMAND_QUEUE_SIZE
+#define WEB_COMMAND_QUEUE_SIZE 1024
+#endif
+
+class WebInterface;
+
+////////////////////////////////////////////////////////////
+/// \brief Something for the cef thread to do, see WebSystem::PostCommand().
+///
+/// Only the fields used by the type of command are set.
+///
+////////////////////////////////////////////////////////////
+struct WebCommand
+{
+public:
+	enum Type
+	{
+		////////////////////////////////////////////////////////////
+		/// Registers factory for the scheme text on the domain target.
+		///
+		////////////////////////////////////////////////////////////
+		COMMAND_REGISTER_SCHEME,
+
+		////////////////////////////////////////////////////////////
+		/// Creates the browser of pWeb.
+		///
+		////////////////////////////////////////////////////////////
+		COMMAND_CREATE_BROWSER,
+
+		////////////////////////////////////////////////////////////
+		/// Sends focus, true to give pWeb focus.
+		///
+		////////////////////////////////////////////////////////////
+		COMMAND_FOCUS,
+
+		////////////////////////////////////////////////////////////
+		/// Moves the mouse to mouse, then presses or releases button (flag set for
+		/// release) clicks times.
+		///
+		////////////////////////////////////////////////////////////
+		COMMAND_MOUSE_CLICK,
+
+		////////////////////////////////////////////////////////////
+		/// Moves the mouse to mouse.  flag is set if the mouse left the view.
+		///
+		////////////////////////////////////////////////////////////
+		COMMAND_MOUSE_MOVE,
+
+		////////////////////////////////////////////////////////////
+		/// Scrolls by deltaX and deltaY with the mouse at mouse.
+		///
+		////////////////////////////////////////////////////////////
+		COMMAND_MOUSE_WHEEL,
+
+		////////////////////////////////////////////////////////////
+		/// Sends key.
+		///
+		////////////////////////////////////////////////////////////
+		COMMAND_KEY,
+
+		////////////////////////////////////////////////////////////
+		/// Runs the javascript text in frame, or the main frame if frame is NULL,
+		/// numbering lines from line.
+		///
+		////////////////////////////////////////////////////////////
+		COMMAND_EXECUTE_JS,
+
+		////////////////////////////////////////////////////////////
+		/// Tells the browser of pWeb its view has been resized.
+		///
+		////////////////////////////////////////////////////////////
+		COMMAND_RESIZE,
+
+		////////////////////////////////////////////////////////////
+		/// Asks the browser of pWeb to repaint rect.
+		///
+		////////////////////////////////////////////////////////////
+		COMMAND_INVALIDATE,
+
+		////////////////////////////////////////////////////////////
+		/// Tells the browser of pWeb it has been hidden, or shown if flag is false.
+		///
+		////////////////////////////////////////////////////////////
+		COMMAND_SET_HIDDEN,
+
+		////////////////////////////////////////////////////////////
+		/// Closes the browser of pWeb, or gives it back to the browser pool.  flag is set
+		/// to force the close.
+		///
+		////////////////////////////////////////////////////////////
+		COMMAND_CLOSE,
+
+		////////////////////////////////////////////////////////////
+		/// Creates or closes spare browsers until the browser pool is the size asked for.
+		///
+		////////////////////////////////////////////////////////////
+		COMMAND_FILL_POOL,
+
+		////////////////////////////////////////////////////////////
+		/// Sends the input queued up by pWeb since the last flush.
+		///
+		////////////////////////////////////////////////////////////
+		COMMAND_FLUSH_INPUT,
+
+		////////////////////////////////////////////////////////////
+		/// Sends the javascript bindings pWeb is waiting to add to its browser.
+		///
+		////////////////////////////////////////////////////////////
+		COMMAND_ADD_BINDINGS
+	};
+
+	WebCommand(Type commandType = COMMAND_FOCUS)
+		: type(commandType)
+		, pWeb(NULL)
+		, flag(false)
+		, button(MBT_LEFT)
+		, clicks(1)
+		, deltaX(0)
+		, deltaY(0)
+		, line(0)
+	{}
+
+	Type type;
+
+	////////////////////////////////////////////////////////////
+	/// \brief WebInterface the command is for.  Referenced while the command waits.
+	///
+	////////////////////////////////////////////////////////////
+	WebInterface* pWeb;
+
+	bool flag;
+	CefMouseEvent mouse;
+	CefBrowserHost::MouseButtonType button;
+	int clicks;
+	int deltaX;
+	int deltaY;
+	CefKeyEvent key;
+	CefRect rect;
+	CefString text;
+	CefString target;
+	CefRefPtr<CefFrame> frame;
+	int line;
+	CefRefPtr<CefSchemeHandlerFactory> factory;
+};
+
+////////////////////////////////////////////////////////////
+/// \brief Bounded queue of WebCommands, pushed from any number of threads and popped from one.
+///
+/// Lock free.  Each slot carries a sequence number saying whether it is free or filled, so
+/// pushers only contend with each other on claiming a position, which is a single
+/// InterlockedCompareExchange, and never on the popping thread.
+///
+/// The slots are allocated up front and reused, so once every slot has been used the queue
+/// itself no longer allocates.
+///
+////////////////////////////////////////////////////////////
+class CommandQueue
+{
+public:
+	////////////////////////////////////////////////////////////
+	/// \param capacity		Number of slots.  Must be a power of two.
+	///
+	////////////////////////////////////////////////////////////
+	CommandQueue(int capacity = WEB_COMMAND_QUEUE_SIZE);
+	~CommandQueue();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Adds a command to the back of the queue.  Can be called from any thread.
+	///
+	/// \param command	The command, copied into the queue.
+	///
+	/// \return False if the queue is full.
+	///
+	////////////////////////////////////////////////////////////
+	bool Push(const WebCommand& command);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Takes every queued command, up to a limit, in the order they were pushed.
+	///
+	/// Only ever call from one thread.  The commands are appended to out, which is best
+	/// reused between calls so it keeps its capacity.
+	///
+	/// \param out		Receives the commands.
+	/// \param max		Most commands to take.
+	///
+	/// \return Number of commands taken.
+	///
+	////////////////////////////////////////////////////////////
+	int PopBatch(std::vector<WebCommand>& out, int max);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the number of slots.
+	///
+	////////////////////////////////////////////////////////////
+	int GetCapacity() const { return mMask + 1; }
+
+private:
+	////////////////////////////////////////////////////////////
+	/// \brief A command and whether it may be written or read.
+	///
+	/// The sequence equals the position it is next written at while free, and that position
+	/// plus one once the command is in.
+	///
+	////////////////////////////////////////////////////////////
+	struct Slot
+	{
+	public:
+		volatile long sequence;
+		WebCommand command;
+	};
+
+	Slot* mSlots;
+	long mMask;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Next position to push at, claimed by pushers.
+	///
+	////////////////////////////////////////////////////////////
+	volatile long mPush;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Next position to pop from.  Only used by the popping thread.
+	///
+	////////////////////////////////////////////////////////////
+	long mPop;
+};
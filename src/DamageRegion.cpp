@@ -0,0 +1,211 @@
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include "DamageRegion.h"
+
+////////////////////////////////////////////////////////////
+DamageRegion::DamageRegion()
+: mWidth(0)
+, mHeight(0)
+, mArea(0)
+, mPromotion(DAMAGE_REGION_PROMOTION)
+, mFull(false)
+{
+
+}
+
+////////////////////////////////////////////////////////////
+void DamageRegion::SetViewSize(int width, int height)
+{
+	if (width == mWidth && height == mHeight)
+		return;
+
+	mWidth = width;
+	mHeight = height;
+	Clear();
+}
+
+////////////////////////////////////////////////////////////
+void DamageRegion::SetPromotionThreshold(float fraction)
+{
+	mPromotion = fraction < 0.0f ? 0.0f : fraction > 1.0f ? 1.0f : fraction;
+}
+
+////////////////////////////////////////////////////////////
+void DamageRegion::Add(const CefRect& rect)
+{
+	if (mFull)
+		return;
+
+	CefRect r = Intersect(rect, CefRect(0, 0, mWidth, mHeight));
+	if (r.IsEmpty())
+		return;
+
+	//Keep absorbing rects into r until nothing else wants to merge with it.
+	bool merged = true;
+	while (merged)
+	{
+		merged = false;
+
+		for (unsigned int i = 0; i < mRects.size();)
+		{
+			const CefRect& other = mRects[i];
+
+			//Already damaged.  Anything absorbed so far was inside r, so it is inside other too.
+			if (Contains(other, r))
+				return;
+
+			if (Contains(r, other) || ShouldMerge(r, other))
+			{
+				r = Union(r, other);
+				mArea -= other.width * other.height;
+				mRects[i] = mRects.back();
+				mRects.pop_back();
+				merged = true;
+			}
+			else
+			{
+				i++;
+			}
+		}
+	}
+
+	mRects.push_back(r);
+	mArea += r.width * r.height;
+
+	if (mRects.size() > DAMAGE_REGION_MAX_RECTS ||
+		(float)mArea >= mPromotion * (float)mWidth * (float)mHeight)
+	{
+		AddAll();
+	}
+}
+
+////////////////////////////////////////////////////////////
+void DamageRegion::Add(const CefRenderHandler::RectList& rects)
+{
+	CefRenderHandler::RectList::const_iterator i = rects.begin();
+	for (; i != rects.end() && !mFull; ++i)
+		Add(*i);
+}
+
+////////////////////////////////////////////////////////////
+void DamageRegion::AddAll()
+{
+	mRects.clear();
+
+	if (mWidth > 0 && mHeight > 0)
+	{
+		mRects.push_back(CefRect(0, 0, mWidth, mHeight));
+		mArea = mWidth * mHeight;
+		mFull = true;
+	}
+}
+
+////////////////////////////////////////////////////////////
+void DamageRegion::Clear()
+{
+	mRects.clear();
+	mArea = 0;
+	mFull = false;
+}
+
+////////////////////////////////////////////////////////////
+CefRect DamageRegion::GetBounds() const
+{
+	if (mRects.empty())
+		return CefRect();
+
+	CefRect bounds = mRects[0];
+	for (unsigned int i = 1; i < mRects.size(); i++)
+		bounds = Union(bounds, mRects[i]);
+
+	return bounds;
+}
+
+////////////////////////////////////////////////////////////
+bool DamageRegion::Contains(const CefRect& outer, const CefRect& inner)
+{
+	return inner.x >= outer.x && inner.y >= outer.y &&
+		inner.x + inner.width <= outer.x + outer.width &&
+		inner.y + inner.height <= outer.y + outer.height;
+}
+
+////////////////////////////////////////////////////////////
+CefRect DamageRegion::Intersect(const CefRect& a, const CefRect& b)
+{
+	int left = a.x > b.x ? a.x : b.x;
+	int top = a.y > b.y ? a.y : b.y;
+	int right = a.x + a.width < b.x + b.width ? a.x + a.width : b.x + b.width;
+	int bottom = a.y + a.height < b.y + b.height ? a.y + a.height : b.y + b.height;
+
+	if (right <= left || bottom <= top)
+		return CefRect();
+
+	return CefRect(left, top, right - left, bottom - top);
+}
+
+////////////////////////////////////////////////////////////
+CefRect DamageRegion::Union(const CefRect& a, const CefRect& b)
+{
+	int left = a.x < b.x ? a.x : b.x;
+	int top = a.y < b.y ? a.y : b.y;
+	int right = a.x + a.width > b.x + b.width ? a.x + a.width : b.x + b.width;
+	int bottom = a.y + a.height > b.y + b.height ? a.y + a.height : b.y + b.height;
+
+	return CefRect(left, top, right - left, bottom - top);
+}
+
+////////////////////////////////////////////////////////////
+void DamageRegion::SplitToGrid(const CefRect& rect, int cellSize, std::vector<CefRect>& pieces)
+{
+	if (rect.IsEmpty())
+		return;
+
+	if (cellSize <= 0)
+	{
+		pieces.push_back(rect);
+		return;
+	}
+
+	int right = rect.x + rect.width;
+	int bottom = rect.y + rect.height;
+	for (int y = rect.y; y < bottom;)
+	{
+		//Each row of pieces ends at the next cell edge or the bottom of the rect.
+		int rowEnd = (y / cellSize + 1) * cellSize;
+		if (rowEnd > bottom)
+			rowEnd = bottom;
+
+		for (int x = rect.x; x < right;)
+		{
+			int columnEnd = (x / cellSize + 1) * cellSize;
+			if (columnEnd > right)
+				columnEnd = right;
+
+			pieces.push_back(CefRect(x, y, columnEnd - x, rowEnd - y));
+			x = columnEnd;
+		}
+
+		y = rowEnd;
+	}
+}
+
+////////////////////////////////////////////////////////////
+bool DamageRegion::ShouldMerge(const CefRect& a, const CefRect& b)
+{
+	//Overlapping rects always merge, otherwise the overlap would be uploaded twice.
+	if (!Intersect(a, b).IsEmpty())
+		return true;
+
+	//Rects which do not at least touch are left alone.
+	if (a.x > b.x + b.width || b.x > a.x + a.width ||
+		a.y > b.y + b.height || b.y > a.y + a.height)
+		return false;
+
+	//Touching rects merge if their bounding box is mostly made of the two of them.
+	CefRect bounds = Union(a, b);
+	int used = a.width * a.height + b.width * b.height;
+	int total = bounds.width * bounds.height;
+
+	return total - used <= total / 4;
+}
@@ -0,0 +1,193 @@
+#pragma once
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include <include/cef_render_handler.h>
+#include <vector>
+
+////////////////////////////////////////////////////////////
+// Pre-processor Definitions
+////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////
+// Past this many separate rects a DamageRegion gives up and
+// damages the whole view.
+//
+////////////////////////////////////////////////////////////
+#ifndef DAMAGE_REGION_MAX_RECTS
+#define DAMAGE_REGION_MAX_RECTS 16
+#endif
+
+////////////////////////////////////////////////////////////
+// Default fraction of the view which must be damaged before
+// a DamageRegion promotes itself to the whole view.
+//
+////////////////////////////////////////////////////////////
+#ifndef DAMAGE_REGION_PROMOTION
+#define DAMAGE_REGION_PROMOTION 0.5f
+#endif
+
+////////////////////////////////////////////////////////////
+/// \brief Accumulates the damaged parts of a view as a small set of disjoint rects.
+///
+/// Overlapping rects are merged, as are touching rects whose bounding box wastes little space.
+/// A rect which covers earlier ones replaces them.  Once the damaged area reaches a set fraction
+/// of the view, or too many separate rects pile up, the region becomes the whole view.
+///
+/// Because the rects never overlap, uploading them never sends the same pixel twice.
+///
+////////////////////////////////////////////////////////////
+class DamageRegion
+{
+public:
+	DamageRegion();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Sets the size of the view, which all added rects are clipped to.
+	///
+	/// Clears the region if the size changes.
+	///
+	/// \param width	Width of the view.
+	/// \param height	Height of the view.
+	///
+	////////////////////////////////////////////////////////////
+	void SetViewSize(int width, int height);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Sets the fraction of the view at which the region becomes the whole view.
+	///
+	/// \param fraction		Between 0 and 1.  0 always damages the whole view, 1 only does when it is all damaged.
+	///
+	////////////////////////////////////////////////////////////
+	void SetPromotionThreshold(float fraction);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the fraction of the view at which the region becomes the whole view.
+	///
+	////////////////////////////////////////////////////////////
+	float GetPromotionThreshold() const { return mPromotion; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Adds a damaged rect to the region.
+	///
+	/// \param rect		Damaged rect in view coordinates.
+	///
+	////////////////////////////////////////////////////////////
+	void Add(const CefRect& rect);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Adds every rect of a list to the region.
+	///
+	/// \param rects	Damaged rects in view coordinates.
+	///
+	////////////////////////////////////////////////////////////
+	void Add(const CefRenderHandler::RectList& rects);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Damages the whole view.
+	///
+	////////////////////////////////////////////////////////////
+	void AddAll();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Empties the region.
+	///
+	////////////////////////////////////////////////////////////
+	void Clear();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the disjoint rects making up the region.
+	///
+	////////////////////////////////////////////////////////////
+	const std::vector<CefRect>& GetRects() const { return mRects; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the smallest rect containing the whole region.
+	///
+	////////////////////////////////////////////////////////////
+	CefRect GetBounds() const;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the number of damaged pixels.
+	///
+	////////////////////////////////////////////////////////////
+	int GetArea() const { return mArea; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns true if nothing is damaged.
+	///
+	////////////////////////////////////////////////////////////
+	bool IsEmpty() const { return mRects.empty(); }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns true if the whole view is damaged.
+	///
+	////////////////////////////////////////////////////////////
+	bool IsFull() const { return mFull; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Checks whether outer completely covers inner.
+	///
+	////////////////////////////////////////////////////////////
+	static bool Contains(const CefRect& outer, const CefRect& inner);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the overlap of two rects, which is empty if they do not overlap.
+	///
+	////////////////////////////////////////////////////////////
+	static CefRect Intersect(const CefRect& a, const CefRect& b);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the bounding box of two rects.
+	///
+	////////////////////////////////////////////////////////////
+	static CefRect Union(const CefRect& a, const CefRect& b);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Cuts a rect along a grid of square cells, so that no piece crosses a cell edge.
+	///
+	/// \param rect		Rect to cut.
+	/// \param cellSize	Width and height of a cell.  0 or less leaves the rect whole.
+	/// \param pieces	Receives the pieces, appended in rows from the top left.
+	///
+	////////////////////////////////////////////////////////////
+	static void SplitToGrid(const CefRect& rect, int cellSize, std::vector<CefRect>& pieces);
+
+private:
+	////////////////////////////////////////////////////////////
+	/// \brief Decides whether two rects should become their bounding box.
+	///
+	////////////////////////////////////////////////////////////
+	static bool ShouldMerge(const CefRect& a, const CefRect& b);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Disjoint damaged rects.
+	///
+	////////////////////////////////////////////////////////////
+	std::vector<CefRect> mRects;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Size of the view.
+	///
+	////////////////////////////////////////////////////////////
+	int mWidth;
+	int mHeight;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Sum of the areas of mRects.
+	///
+	////////////////////////////////////////////////////////////
+	int mArea;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Fraction of the view at which the region becomes the whole view.
+	///
+	////////////////////////////////////////////////////////////
+	float mPromotion;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Whether the region is the whole view.
+	///
+	////////////////////////////////////////////////////////////
+	bool mFull;
+};
@@ -0,0 +1,102 @@
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include "FrameHandoff.h"
+#include <windows.h>
+
+////////////////////////////////////////////////////////////
+FrameHandoff::FrameHandoff()
+: mBack(0)
+, mReady(1)
+, mFront(2)
+, mWidth(0)
+, mHeight(0)
+, mTileSize(0)
+{
+	for (int i = 0; i < 3; i++)
+		mFrames[i].pixels = NULL;
+}
+
+////////////////////////////////////////////////////////////
+FrameHandoff::~FrameHandoff()
+{
+	Reset(0, 0);
+}
+
+////////////////////////////////////////////////////////////
+void FrameHandoff::Reset(int width, int height)
+{
+	for (int i = 0; i < 3; i++)
+	{
+		if (width != mWidth || height != mHeight)
+		{
+			delete[] mFrames[i].pixels;
+			mFrames[i].pixels = NULL;
+
+			if (width > 0 && height > 0)
+				mFrames[i].pixels = new sf::Uint8[width * height * 4];
+		}
+
+		mFrames[i].rects.clear();
+		mFrames[i].offsets.clear();
+	}
+
+	mWidth = width;
+	mHeight = height;
+	mBack = 0;
+	mReady = 1;
+	mFront = 2;
+	mPending.SetViewSize(width, height);
+	mPending.Clear();
+}
+
+////////////////////////////////////////////////////////////
+FrameHandoff::Frame* FrameHandoff::BeginFrame(const CefRenderHandler::RectList& dirtyRects)
+{
+	if (!mFrames[mBack].pixels)
+		return NULL;
+
+	//If the last frame we published has been picked up, its regions are already on the texture.
+	//Otherwise the reader will skip it, so its regions have to go out again with this frame.
+	if (!(mReady & FRESH))
+		mPending.Clear();
+
+	mPending.Add(dirtyRects);
+
+	//The rects of a DamageRegion never overlap, so their pixels always fit in one view.
+	//Cutting them along the tile grid keeps it that way.
+	Frame& frame = mFrames[mBack];
+	frame.rects.clear();
+	const std::vector<CefRect>& pending = mPending.GetRects();
+	for (unsigned int r = 0; r < pending.size(); r++)
+		DamageRegion::SplitToGrid(pending[r], mTileSize, frame.rects);
+	frame.offsets.resize(frame.rects.size());
+
+	size_t offset = 0;
+	for (unsigned int r = 0; r < frame.rects.size(); r++)
+	{
+		frame.offsets[r] = offset;
+		offset += frame.rects[r].width * frame.rects[r].height * 4;
+	}
+
+	return &frame;
+}
+
+////////////////////////////////////////////////////////////
+void FrameHandoff::EndFrame()
+{
+	long previous = InterlockedExchange(&mReady, mBack | FRESH);
+	mBack = previous & ~FRESH;
+}
+
+////////////////////////////////////////////////////////////
+const FrameHandoff::Frame* FrameHandoff::AcquireFrame()
+{
+	if (!(mReady & FRESH))
+		return NULL;
+
+	long previous = InterlockedExchange(&mReady, mFront);
+	mFront = previous & ~FRESH;
+
+	return &mFrames[mFront];
+}
@@ -0,0 +1,178 @@
+#pragma once
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include <include/cef_render_handler.h>
+#include <SFML\Config.hpp>
+#include "DamageRegion.h"
+#include <vector>
+
+////////////////////////////////////////////////////////////
+/// \brief Triple buffer used to pass painted frames from the cef thread to the draw thread.
+///
+/// The cef thread writes the changed regions of a frame into the back frame and publishes it.
+/// The draw thread picks up the most recently published frame and uploads its regions.
+/// Neither side ever waits on the other; frames are swapped with a single interlocked exchange.
+///
+/// Regions published while the draw thread was not looking are carried forward into the next
+/// frame, so skipping frames never loses damage.  They are accumulated in a DamageRegion, so
+/// a region painted many times before the draw thread looks is still only uploaded once.
+/// Each frame only stores the pixels of its regions, packed one after the other.
+///
+/// Reset() is not thread safe and must only be called while neither side is using the frames.
+///
+////////////////////////////////////////////////////////////
+class FrameHandoff
+{
+public:
+	////////////////////////////////////////////////////////////
+	/// \brief A set of changed regions and their pixels.
+	///
+	////////////////////////////////////////////////////////////
+	struct Frame
+	{
+	public:
+		////////////////////////////////////////////////////////////
+		/// \brief Regions of the view which changed.
+		///
+		////////////////////////////////////////////////////////////
+		std::vector<CefRect> rects;
+
+		////////////////////////////////////////////////////////////
+		/// \brief Offset into pixels at which the tightly packed data of each rect starts.
+		///
+		////////////////////////////////////////////////////////////
+		std::vector<size_t> offsets;
+
+		////////////////////////////////////////////////////////////
+		/// \brief Storage for the pixels of all rects, big enough for one full view.
+		///
+		////////////////////////////////////////////////////////////
+		sf::Uint8* pixels;
+	};
+
+	FrameHandoff();
+	~FrameHandoff();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Discards all frames and resizes them for a view of the given size.
+	///
+	/// A size of 0x0 frees the frames entirely.
+	///
+	/// \param width	Width of the view.
+	/// \param height	Height of the view.
+	///
+	////////////////////////////////////////////////////////////
+	void Reset(int width, int height);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Writer side.  Prepares the back frame for the given dirty rects.
+	///
+	/// The rects of the returned frame are the dirty rects plus any regions the draw thread
+	/// has not picked up yet.  The caller fills in their pixels and then calls EndFrame().
+	///
+	/// \param dirtyRects	Rects which changed in this paint.
+	///
+	/// \return The back frame, or NULL if Reset() has not been given a size.
+	///
+	////////////////////////////////////////////////////////////
+	Frame* BeginFrame(const CefRenderHandler::RectList& dirtyRects);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Writer side.  Publishes the frame returned by BeginFrame().
+	///
+	////////////////////////////////////////////////////////////
+	void EndFrame();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Reader side.  Takes the most recently published frame.
+	///
+	/// The frame stays valid until the next call to AcquireFrame().
+	///
+	/// \return The new frame, or NULL if nothing was published since the last call.
+	///
+	////////////////////////////////////////////////////////////
+	const Frame* AcquireFrame();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Sets the fraction of the view at which a frame uploads the whole view.
+	///
+	/// Writer side, must not be called while a frame is being written.
+	///
+	/// \param fraction	See DamageRegion::SetPromotionThreshold().
+	///
+	////////////////////////////////////////////////////////////
+	void SetPromotionThreshold(float fraction) { mPending.SetPromotionThreshold(fraction); }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Cuts the rects of every frame along a grid, so each one lands on a single tile.
+	///
+	/// Writer side, must not be called while a frame is being written.
+	///
+	/// \param tileSize	Width and height of a tile, or 0 to leave rects whole.
+	///
+	////////////////////////////////////////////////////////////
+	void SetTileSize(int tileSize) { mTileSize = tileSize; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the width the frames were sized for.
+	///
+	////////////////////////////////////////////////////////////
+	int GetWidth() const { return mWidth; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the height the frames were sized for.
+	///
+	////////////////////////////////////////////////////////////
+	int GetHeight() const { return mHeight; }
+
+private:
+	////////////////////////////////////////////////////////////
+	/// \brief Set in mReady when the frame it names has not been picked up yet.
+	///
+	////////////////////////////////////////////////////////////
+	static const long FRESH = 4;
+
+	////////////////////////////////////////////////////////////
+	/// \brief The three frames.
+	///
+	////////////////////////////////////////////////////////////
+	Frame mFrames[3];
+
+	////////////////////////////////////////////////////////////
+	/// \brief Frame owned by the writer.
+	///
+	////////////////////////////////////////////////////////////
+	long mBack;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Frame shared between both sides, or'd with FRESH when newly published.
+	///
+	////////////////////////////////////////////////////////////
+	volatile long mReady;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Frame owned by the reader.
+	///
+	////////////////////////////////////////////////////////////
+	long mFront;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Regions published since the reader last picked up a frame.  Writer only.
+	///
+	////////////////////////////////////////////////////////////
+	DamageRegion mPending;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Size of the view the frames were sized for.
+	///
+	////////////////////////////////////////////////////////////
+	int mWidth;
+	int mHeight;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Size of the grid frame rects are cut along, or 0.
+	///
+	////////////////////////////////////////////////////////////
+	int mTileSize;
+};
@@ -0,0 +1,461 @@
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include "InputRouter.h"
+#include <algorithm>
+#include <cmath>
+
+////////////////////////////////////////////////////////////
+struct InputRouter::TopmostFirst
+{
+public:
+	const std::vector<Placement>* pPlacements;
+
+	bool operator()(unsigned int a, unsigned int b) const
+	{
+		const Placement& pa = (*pPlacements)[a];
+		const Placement& pb = (*pPlacements)[b];
+		if (pa.z != pb.z)
+			return pa.z > pb.z;
+		return pa.order > pb.order;
+	}
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+//Input Router Methods
+//--------------------------------------------------------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////
+InputRouter::InputRouter()
+: mNextOrder(0)
+, mDirty(false)
+, mButtonsHeld(0)
+, mClickTime(0.25f)
+, mLastClickButton(sf::Mouse::Left)
+, mClickCount(1)
+{
+
+}
+
+////////////////////////////////////////////////////////////
+void InputRouter::Place(CefRefPtr<WebInterface> pWeb, const sf::Transform& transform, int z)
+{
+	Placement* pPlacement = Find(pWeb);
+	if (!pPlacement)
+	{
+		Placement placement;
+		placement.pWeb = pWeb;
+		placement.order = mNextOrder++;
+		mPlacements.push_back(placement);
+		pPlacement = &mPlacements.back();
+	}
+
+	pPlacement->inverse = transform.getInverse();
+	pPlacement->bounds = transform.transformRect(sf::FloatRect(0.0f, 0.0f, (float)pWeb->GetWidth(), (float)pWeb->GetHeight()));
+	pPlacement->z = z;
+	mDirty = true;
+}
+
+////////////////////////////////////////////////////////////
+void InputRouter::Remove(CefRefPtr<WebInterface> pWeb)
+{
+	for (unsigned int i = 0; i < mPlacements.size(); i++)
+	{
+		if (mPlacements[i].pWeb == pWeb)
+		{
+			mPlacements.erase(mPlacements.begin() + i);
+			mDirty = true;
+			break;
+		}
+	}
+
+	if (mpHover == pWeb)
+		mpHover = NULL;
+	if (mpCapture == pWeb)
+		mpCapture = NULL;
+	if (mpFocus == pWeb)
+		mpFocus = NULL;
+}
+
+////////////////////////////////////////////////////////////
+void InputRouter::Clear()
+{
+	mPlacements.clear();
+	mCells.clear();
+	mDirty = false;
+
+	mpHover = NULL;
+	mpCapture = NULL;
+	mpFocus = NULL;
+}
+
+////////////////////////////////////////////////////////////
+bool InputRouter::ProcessEvent(const sf::Event& event)
+{
+	//Modifiers sent along with the event should be those of the event.
+	WebSystem::ProcessEvent(event);
+
+	sf::Vector2f local;
+
+	switch (event.type)
+	{
+	case sf::Event::MouseMoved:
+		{
+			WebInterface* pWeb = MoveMouse((float)event.mouseMove.x, (float)event.mouseMove.y, local);
+			if (!pWeb)
+				return false;
+
+			pWeb->SendMouseMoveEvent((int)local.x, (int)local.y, false);
+			return true;
+		}
+	case sf::Event::MouseButtonPressed:
+		{
+			if (mClickClock.getElapsedTime().asSeconds() < mClickTime && event.mouseButton.button == mLastClickButton)
+				mClickCount++;
+			else
+				mClickCount = 1;
+			mLastClickButton = event.mouseButton.button;
+			mClickClock.restart();
+
+			WebInterface* pWeb = MoveMouse((float)event.mouseButton.x, (float)event.mouseButton.y, local);
+
+			//The first button down takes the mouse until every button is up again.
+			if (mButtonsHeld++ == 0)
+				mpCapture = pWeb;
+
+			//Clicking outside every WebInterface takes focus away from them all.
+			SetFocus(pWeb);
+
+			if (!pWeb)
+				return false;
+
+			pWeb->SendMouseClickEvent((int)local.x, (int)local.y, event.mouseButton.button, false, mClickCount);
+			return true;
+		}
+	case sf::Event::MouseButtonReleased:
+		{
+			WebInterface* pWeb = MoveMouse((float)event.mouseButton.x, (float)event.mouseButton.y, local);
+
+			if (mButtonsHeld > 0 && --mButtonsHeld == 0)
+				mpCapture = NULL;
+
+			if (!pWeb)
+				return false;
+
+			pWeb->SendMouseClickEvent((int)local.x, (int)local.y, event.mouseButton.button, true, mClickCount);
+			return true;
+		}
+	case sf::Event::MouseWheelMoved:
+		{
+			WebInterface* pWeb = MoveMouse((float)event.mouseWheel.x, (float)event.mouseWheel.y, local);
+			if (!pWeb)
+				return false;
+
+			pWeb->SendMouseWheelEvent((int)local.x, (int)local.y, 0, event.mouseWheel.delta * 30);
+			return true;
+		}
+	case sf::Event::MouseLeft:
+		{
+			if (mpHover && !mpCapture)
+			{
+				mpHover->SendMouseMoveEvent((int)mHoverPoint.x, (int)mHoverPoint.y, true);
+				mpHover = NULL;
+			}
+			return false;
+		}
+	case sf::Event::LostFocus:
+		{
+			//Releases happening elsewhere are never seen, so nothing can be assumed held.
+			mButtonsHeld = 0;
+			mpCapture = NULL;
+
+			if (mpHover)
+			{
+				mpHover->SendMouseMoveEvent((int)mHoverPoint.x, (int)mHoverPoint.y, true);
+				mpHover = NULL;
+			}
+			return false;
+		}
+	case sf::Event::KeyPressed:
+	case sf::Event::KeyReleased:
+		{
+			WPARAM key = GetVirtualKey(event.key.code);
+			if (!mpFocus || key == VK_NONAME)
+				return false;
+
+			mpFocus->SendKeyEvent(key, event.type == sf::Event::KeyReleased, event.key.control);
+			return true;
+		}
+	case sf::Event::TextEntered:
+		{
+			if (!mpFocus)
+				return false;
+
+			mpFocus->SendKeyEvent((char)event.text.unicode);
+			return true;
+		}
+	default:
+		return false;
+	}
+}
+
+////////////////////////////////////////////////////////////
+WebInterface* InputRouter::HitTest(float x, float y, sf::Vector2f& local)
+{
+	Rebuild();
+
+	int column = (int)floor(x / INPUT_ROUTER_CELL_SIZE);
+	int row = (int)floor(y / INPUT_ROUTER_CELL_SIZE);
+
+	std::map<std::pair<int, int>, std::vector<unsigned int> >::iterator cell = mCells.find(std::make_pair(column, row));
+	if (cell == mCells.end())
+		return NULL;
+
+	const std::vector<unsigned int>& indices = cell->second;
+	for (unsigned int i = 0; i < indices.size(); i++)
+	{
+		Placement& placement = mPlacements[indices[i]];
+		if (!placement.bounds.contains(x, y))
+			continue;
+
+		//The bounds of a rotated placement are bigger than the placement itself.
+		sf::Vector2f point = placement.inverse.transformPoint(x, y);
+		if (point.x < 0.0f || point.y < 0.0f || point.x >= placement.pWeb->GetWidth() || point.y >= placement.pWeb->GetHeight())
+			continue;
+
+		if (IsClear(placement.pWeb, (int)point.x, (int)point.y))
+			continue;
+
+		local = point;
+		return placement.pWeb;
+	}
+
+	return NULL;
+}
+
+////////////////////////////////////////////////////////////
+void InputRouter::SetFocus(WebInterface* pWeb)
+{
+	if (mpFocus.get() == pWeb)
+		return;
+
+	if (mpFocus)
+		mpFocus->SendFocusEvent(false);
+
+	mpFocus = pWeb;
+
+	if (mpFocus)
+		mpFocus->SendFocusEvent(true);
+}
+
+////////////////////////////////////////////////////////////
+WPARAM InputRouter::GetVirtualKey(sf::Keyboard::Key key)
+{
+	switch (key)
+	{
+	case sf::Keyboard::LControl:		return VK_CONTROL;
+	case sf::Keyboard::RControl:		return VK_CONTROL;
+	case sf::Keyboard::LSystem:		return VK_LWIN;
+	case sf::Keyboard::RSystem:		return VK_RWIN;
+	case sf::Keyboard::Menu:		return VK_APPS;
+	case sf::Keyboard::SemiColon:		return VK_OEM_1;
+	case sf::Keyboard::Slash:		return VK_OEM_2;
+	case sf::Keyboard::Equal:		return 	VK_OEM_PLUS;
+	case sf::Keyboard::Dash:		return 	VK_OEM_MINUS;
+	case sf::Keyboard::LBracket:		return 	VK_OEM_4;
+	case sf::Keyboard::RBracket:		return 	VK_OEM_6;
+	case sf::Keyboard::Comma:		return 	VK_OEM_COMMA;
+	case sf::Keyboard::Period:		return 	VK_OEM_PERIOD;
+	case sf::Keyboard::Quote:		return 	VK_OEM_7;
+	case sf::Keyboard::BackSlash:		return 	VK_OEM_5;
+	case sf::Keyboard::Tilde:		return 	VK_OEM_3;
+	case sf::Keyboard::Escape:		return 	VK_ESCAPE;
+	case sf::Keyboard::Space:		return 	VK_SPACE;
+	case sf::Keyboard::Return:		return 	VK_RETURN;
+	case sf::Keyboard::BackSpace:       return 	VK_BACK;
+	case sf::Keyboard::Tab:       return 	VK_TAB;
+	case sf::Keyboard::PageUp:		return 	VK_PRIOR;
+	case sf::Keyboard::PageDown:       return 	VK_NEXT;
+	case sf::Keyboard::End:       return 	VK_END;
+	case sf::Keyboard::Home:       return 	VK_HOME;
+	case sf::Keyboard::Insert:		return 	VK_INSERT;
+	case sf::Keyboard::Delete:		return 	VK_DELETE;
+	case sf::Keyboard::Add:       return 	VK_ADD;
+	case sf::Keyboard::Subtract:		return 	VK_SUBTRACT;
+	case sf::Keyboard::Multiply:		return 	VK_MULTIPLY;
+	case sf::Keyboard::Divide:		return 	VK_DIVIDE;
+	case sf::Keyboard::Pause:		return 	VK_PAUSE;
+	case sf::Keyboard::F1:       return 	VK_F1;
+	case sf::Keyboard::F2:       return 	VK_F2;
+	case sf::Keyboard::F3:       return 	VK_F3;
+	case sf::Keyboard::F4:       return 	VK_F4;
+	case sf::Keyboard::F5:       return 	VK_F5;
+	case sf::Keyboard::F6:       return 	VK_F6;
+	case sf::Keyboard::F7:       return 	VK_F7;
+	case sf::Keyboard::F8:       return 	VK_F8;
+	case sf::Keyboard::F9:       return 	VK_F9;
+	case sf::Keyboard::F10:       return 	VK_F10;
+	case sf::Keyboard::F11:       return 	VK_F11;
+	case sf::Keyboard::F12:       return 	VK_F12;
+	case sf::Keyboard::F13:       return 	VK_F13;
+	case sf::Keyboard::F14:       return 	VK_F14;
+	case sf::Keyboard::F15:       return 	VK_F15;
+	case sf::Keyboard::Left:       return 	VK_LEFT;
+	case sf::Keyboard::Right:		return 	VK_RIGHT;
+	case sf::Keyboard::Up:       return 	VK_UP;
+	case sf::Keyboard::Down:       return 	VK_DOWN;
+	case sf::Keyboard::Numpad0:		return 	VK_NUMPAD0;
+	case sf::Keyboard::Numpad1:		return 	VK_NUMPAD1;
+	case sf::Keyboard::Numpad2:		return 	VK_NUMPAD2;
+	case sf::Keyboard::Numpad3:		return 	VK_NUMPAD3;
+	case sf::Keyboard::Numpad4:		return 	VK_NUMPAD4;
+	case sf::Keyboard::Numpad5:		return 	VK_NUMPAD5;
+	case sf::Keyboard::Numpad6:		return 	VK_NUMPAD6;
+	case sf::Keyboard::Numpad7:		return 	VK_NUMPAD7;
+	case sf::Keyboard::Numpad8:		return 	VK_NUMPAD8;
+	case sf::Keyboard::Numpad9:		return 	VK_NUMPAD9;
+	case sf::Keyboard::A:						return	'A';
+	case sf::Keyboard::B:						return	'B';
+	case sf::Keyboard::C:						return	'C';
+	case sf::Keyboard::D:						return	'D';
+	case sf::Keyboard::E:						return	'E';
+	case sf::Keyboard::F:						return	'F';
+	case sf::Keyboard::G:						return	'G';
+	case sf::Keyboard::H:						return	'H';
+	case sf::Keyboard::I:						return	'I';
+	case sf::Keyboard::J:						return	'J';
+	case sf::Keyboard::K:						return	'K';
+	case sf::Keyboard::L:						return	'L';
+	case sf::Keyboard::M:						return	'M';
+	case sf::Keyboard::N:						return	'N';
+	case sf::Keyboard::O:						return	'O';
+	case sf::Keyboard::P:						return	'P';
+	case sf::Keyboard::Q:						return	'Q';
+	case sf::Keyboard::R:						return	'R';
+	case sf::Keyboard::S:						return	'S';
+	case sf::Keyboard::T:						return	'T';
+	case sf::Keyboard::U:						return	'U';
+	case sf::Keyboard::V:						return	'V';
+	case sf::Keyboard::W:						return	'W';
+	case sf::Keyboard::X:						return	'X';
+	case sf::Keyboard::Y:						return	'Y';
+	case sf::Keyboard::Z:						return	'Z';
+	case sf::Keyboard::Num0:					return	'0';
+	case sf::Keyboard::Num1:					return	'1';
+	case sf::Keyboard::Num2:					return	'2';
+	case sf::Keyboard::Num3:					return	'3';
+	case sf::Keyboard::Num4:					return	'4';
+	case sf::Keyboard::Num5:					return	'5';
+	case sf::Keyboard::Num6:					return	'6';
+	case sf::Keyboard::Num7:					return	'7';
+	case sf::Keyboard::Num8:					return	'8';
+	case sf::Keyboard::Num9:					return	'9';
+	default:									break;
+	}
+
+	return VK_NONAME;
+}
+
+////////////////////////////////////////////////////////////
+void InputRouter::Rebuild()
+{
+	if (!mDirty)
+		return;
+	mDirty = false;
+
+	//Keep the vectors of cells which stay in use, so moving placements around does not reallocate them.
+	std::map<std::pair<int, int>, std::vector<unsigned int> >::iterator cell;
+	for (cell = mCells.begin(); cell != mCells.end(); cell++)
+		cell->second.clear();
+
+	for (unsigned int i = 0; i < mPlacements.size(); i++)
+	{
+		const sf::FloatRect& bounds = mPlacements[i].bounds;
+		int left = (int)floor(bounds.left / INPUT_ROUTER_CELL_SIZE);
+		int top = (int)floor(bounds.top / INPUT_ROUTER_CELL_SIZE);
+		int right = (int)floor((bounds.left + bounds.width) / INPUT_ROUTER_CELL_SIZE);
+		int bottom = (int)floor((bounds.top + bounds.height) / INPUT_ROUTER_CELL_SIZE);
+
+		for (int row = top; row <= bottom; row++)
+		{
+			for (int column = left; column <= right; column++)
+				mCells[std::make_pair(column, row)].push_back(i);
+		}
+	}
+
+	TopmostFirst order;
+	order.pPlacements = &mPlacements;
+
+	for (cell = mCells.begin(); cell != mCells.end();)
+	{
+		if (cell->second.empty())
+		{
+			mCells.erase(cell++);
+			continue;
+		}
+
+		std::sort(cell->second.begin(), cell->second.end(), order);
+		++cell;
+	}
+}
+
+////////////////////////////////////////////////////////////
+InputRouter::Placement* InputRouter::Find(WebInterface* pWeb)
+{
+	for (unsigned int i = 0; i < mPlacements.size(); i++)
+	{
+		if (mPlacements[i].pWeb.get() == pWeb)
+			return &mPlacements[i];
+	}
+
+	return NULL;
+}
+
+////////////////////////////////////////////////////////////
+bool InputRouter::IsClear(WebInterface* pWeb, int x, int y)
+{
+	//Only the frame shadow can be read back, without it the whole view counts.
+	if (!pWeb->IsTransparent() || !pWeb->HasFrameShadow())
+		return false;
+
+	bool clear = false;
+
+	WebInterface::PixelSpan frame = pWeb->LockFrame();
+	if (frame.pixels && x < frame.width && y < frame.height)
+	{
+		//Alpha is the last byte of a pixel in both BGRA and RGBA.
+		clear = frame.pixels[y * frame.pitch + x * BYTES_PER_PIXEL + 3] == 0;
+	}
+	pWeb->UnlockFrame();
+
+	return clear;
+}
+
+////////////////////////////////////////////////////////////
+WebInterface* InputRouter::MoveMouse(float x, float y, sf::Vector2f& local)
+{
+	//A held button keeps sending the mouse to where it was pressed, even outside of it.
+	if (mpCapture)
+	{
+		Placement* pPlacement = Find(mpCapture);
+		if (pPlacement)
+		{
+			local = pPlacement->inverse.transformPoint(x, y);
+			mHoverPoint = local;
+			return mpCapture;
+		}
+	}
+
+	WebInterface* pWeb = HitTest(x, y, local);
+
+	if (mpHover.get() != pWeb)
+	{
+		if (mpHover)
+			mpHover->SendMouseMoveEvent((int)mHoverPoint.x, (int)mHoverPoint.y, true);
+		mpHover = pWeb;
+	}
+
+	if (pWeb)
+		mHoverPoint = local;
+	return pWeb;
+}
@@ -0,0 +1,206 @@
+#pragma once
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include <SFML\Graphics.hpp>
+#include <map>
+#include <vector>
+#include "WebSystem.h"
+
+////////////////////////////////////////////////////////////
+// Pre-processor Definitions
+////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////
+// Size in pixels of the cells an InputRouter sorts
+// placements into.
+//
+////////////////////////////////////////////////////////////
+#ifndef INPUT_ROUTER_CELL_SIZE
+#define INPUT_ROUTER_CELL_SIZE 256
+#endif
+
+////////////////////////////////////////////////////////////
+/// \brief Sends window events to the WebInterface under the mouse, or the one with focus.
+///
+/// The router knows where each WebInterface is drawn, and in which order.  Mouse events go
+/// to the topmost WebInterface under the mouse only, and key events to the one clicked
+/// last.  Focus events are sent only when focus moves from one WebInterface to another.
+///
+/// Placements are sorted into a grid of cells by their bounds, so finding what is under the
+/// mouse only tests the few placements overlapping one cell.  Transparent WebInterfaces with
+/// a frame shadow let clicks through where they are fully transparent.
+///
+/// While a mouse button is held, the mouse belongs to the WebInterface it was pressed on,
+/// so drags keep going when the mouse leaves it.
+///
+/// Use from the thread which handles the window's events.
+///
+////////////////////////////////////////////////////////////
+class InputRouter
+{
+public:
+	InputRouter();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Sets where a WebInterface is drawn.  Call again whenever it moves or is resized.
+	///
+	/// \param pWeb			The WebInterface.
+	/// \param transform	Placement of the WebInterface, e.g. an sf::Sprite's getTransform().
+	/// \param z			Order of the WebInterface, higher is on top.  Equal orders go by
+	///						which was placed first, later on top.
+	///
+	////////////////////////////////////////////////////////////
+	void Place(CefRefPtr<WebInterface> pWeb, const sf::Transform& transform, int z = 0);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Stops sending events to a WebInterface.
+	///
+	////////////////////////////////////////////////////////////
+	void Remove(CefRefPtr<WebInterface> pWeb);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Removes every WebInterface.
+	///
+	////////////////////////////////////////////////////////////
+	void Clear();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Sends a window event on to the WebInterface it is meant for.
+	///
+	/// Losing focus lets go of the mouse, as the button releases happen elsewhere.
+	///
+	/// \param event	The event, with coordinates in the space placements are given in.
+	///
+	/// \return True if a WebInterface was sent the event.
+	///
+	////////////////////////////////////////////////////////////
+	bool ProcessEvent(const sf::Event& event);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Finds the topmost WebInterface at a point.
+	///
+	/// \param x		Horizontal position.
+	/// \param y		Vertical position.
+	/// \param local	Receives the point in the coordinates of the WebInterface.
+	///
+	/// \return The WebInterface, or NULL if there is none.
+	///
+	////////////////////////////////////////////////////////////
+	WebInterface* HitTest(float x, float y, sf::Vector2f& local);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the WebInterface key events are sent to, or NULL.
+	///
+	////////////////////////////////////////////////////////////
+	WebInterface* GetFocus() { return mpFocus.get(); }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Gives focus to a WebInterface, or takes it away from all of them.
+	///
+	/// \param pWeb		The WebInterface, or NULL.
+	///
+	////////////////////////////////////////////////////////////
+	void SetFocus(WebInterface* pWeb);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Converts an sfml key which is not a character into the windows key code cef takes.
+	///
+	/// \return The key code, VK_NONAME if there is none.
+	///
+	////////////////////////////////////////////////////////////
+	static WPARAM GetVirtualKey(sf::Keyboard::Key key);
+
+private:
+	////////////////////////////////////////////////////////////
+	/// \brief Where a WebInterface is drawn.
+	///
+	////////////////////////////////////////////////////////////
+	struct Placement
+	{
+	public:
+		CefRefPtr<WebInterface> pWeb;
+		sf::Transform inverse;
+		sf::FloatRect bounds;
+		int z;
+
+		////////////////////////////////////////////////////////////
+		/// \brief Order the placement was first made in, breaking ties between equal z.
+		///
+		////////////////////////////////////////////////////////////
+		unsigned int order;
+	};
+
+	////////////////////////////////////////////////////////////
+	/// \brief Orders placement indices topmost first.
+	///
+	////////////////////////////////////////////////////////////
+	struct TopmostFirst;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Sorts the placements into mCells again, if they changed.
+	///
+	////////////////////////////////////////////////////////////
+	void Rebuild();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the placement of a WebInterface, or NULL.
+	///
+	////////////////////////////////////////////////////////////
+	Placement* Find(WebInterface* pWeb);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns whether a WebInterface is fully transparent at a point of its view.
+	///
+	////////////////////////////////////////////////////////////
+	static bool IsClear(WebInterface* pWeb, int x, int y);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Moves the mouse to the WebInterface at a point, telling the last one it left.
+	///
+	/// \return The WebInterface the mouse is over, which has the mouse captured while a button
+	/// is held.
+	///
+	////////////////////////////////////////////////////////////
+	WebInterface* MoveMouse(float x, float y, sf::Vector2f& local);
+
+	std::vector<Placement> mPlacements;
+	unsigned int mNextOrder;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Indices of the placements overlapping each cell, topmost first.
+	///
+	////////////////////////////////////////////////////////////
+	std::map<std::pair<int, int>, std::vector<unsigned int> > mCells;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Whether mCells is out of date.
+	///
+	////////////////////////////////////////////////////////////
+	bool mDirty;
+
+	////////////////////////////////////////////////////////////
+	/// \brief WebInterface under the mouse, and where on it the mouse was last.
+	///
+	////////////////////////////////////////////////////////////
+	CefRefPtr<WebInterface> mpHover;
+	sf::Vector2f mHoverPoint;
+
+	////////////////////////////////////////////////////////////
+	/// \brief WebInterface a held button was pressed on, which gets the mouse until release.
+	///
+	////////////////////////////////////////////////////////////
+	CefRefPtr<WebInterface> mpCapture;
+	int mButtonsHeld;
+
+	CefRefPtr<WebInterface> mpFocus;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Tracks rapid clicks, for double and triple clicks.
+	///
+	////////////////////////////////////////////////////////////
+	sf::Clock mClickClock;
+	float mClickTime;
+	sf::Mouse::Button mLastClickButton;
+	int mClickCount;
+};
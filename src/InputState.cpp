@@ -0,0 +1,100 @@
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include "InputState.h"
+#include <windows.h>
+
+//--------------------------------------------------------------------------------------------------------------------------
+//Input State Methods
+//--------------------------------------------------------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////
+InputState::InputState()
+: mModifiers(0)
+, mTracking(false)
+{
+
+}
+
+////////////////////////////////////////////////////////////
+void InputState::ProcessEvent(const sf::Event& event)
+{
+	switch (event.type)
+	{
+	case sf::Event::KeyPressed:
+	case sf::Event::KeyReleased:
+		//Key events carry the modifiers as they were for that key.
+		SetFlags(EVENTFLAG_CONTROL_DOWN, event.key.control);
+		SetFlags(EVENTFLAG_SHIFT_DOWN, event.key.shift);
+		SetFlags(EVENTFLAG_ALT_DOWN, event.key.alt);
+		UpdateLocks();
+		break;
+	case sf::Event::MouseButtonPressed:
+	case sf::Event::MouseButtonReleased:
+		{
+			int flag = event.mouseButton.button == sf::Mouse::Left ? EVENTFLAG_LEFT_MOUSE_BUTTON :
+				event.mouseButton.button == sf::Mouse::Right ? EVENTFLAG_RIGHT_MOUSE_BUTTON :
+				event.mouseButton.button == sf::Mouse::Middle ? EVENTFLAG_MIDDLE_MOUSE_BUTTON : 0;
+			SetFlags(flag, event.type == sf::Event::MouseButtonPressed);
+		}
+		break;
+	case sf::Event::LostFocus:
+		//Releases happening elsewhere are never seen, so nothing can be assumed held.
+		SetFlags(~0, false);
+		break;
+	case sf::Event::GainedFocus:
+		//Keys may have been pressed elsewhere and still be held, so ask once.
+		InterlockedExchange(&mModifiers, Poll());
+		break;
+	default:
+		return;
+	}
+
+	mTracking = true;
+}
+
+////////////////////////////////////////////////////////////
+int InputState::Poll()
+{
+	int mod = 0;
+	if (sf::Keyboard::isKeyPressed(sf::Keyboard::LControl) ||
+		sf::Keyboard::isKeyPressed(sf::Keyboard::RControl))
+		mod |= EVENTFLAG_CONTROL_DOWN;
+	if (sf::Keyboard::isKeyPressed(sf::Keyboard::LShift) ||
+		sf::Keyboard::isKeyPressed(sf::Keyboard::RShift))
+		mod |= EVENTFLAG_SHIFT_DOWN;
+	if (sf::Keyboard::isKeyPressed(sf::Keyboard::LAlt) ||
+		sf::Keyboard::isKeyPressed(sf::Keyboard::RAlt))
+		mod |= EVENTFLAG_ALT_DOWN;
+	if (sf::Mouse::isButtonPressed(sf::Mouse::Left))
+		mod |= EVENTFLAG_LEFT_MOUSE_BUTTON;
+	if (sf::Mouse::isButtonPressed(sf::Mouse::Middle))
+		mod |= EVENTFLAG_MIDDLE_MOUSE_BUTTON;
+	if (sf::Mouse::isButtonPressed(sf::Mouse::Right))
+		mod |= EVENTFLAG_RIGHT_MOUSE_BUTTON;
+
+	// Low bit set from GetKeyState indicates "toggled".
+	if (::GetKeyState(VK_NUMLOCK) & 1)
+		mod |= EVENTFLAG_NUM_LOCK_ON;
+	if (::GetKeyState(VK_CAPITAL) & 1)
+		mod |= EVENTFLAG_CAPS_LOCK_ON;
+
+	return mod;
+}
+
+////////////////////////////////////////////////////////////
+void InputState::SetFlags(int flags, bool set)
+{
+	long modifiers = mModifiers;
+	modifiers = set ? modifiers | flags : modifiers & ~flags;
+
+	//Only one thread writes, the exchange just publishes to the readers.
+	InterlockedExchange(&mModifiers, modifiers);
+}
+
+////////////////////////////////////////////////////////////
+void InputState::UpdateLocks()
+{
+	SetFlags(EVENTFLAG_NUM_LOCK_ON, (::GetKeyState(VK_NUMLOCK) & 1) != 0);
+	SetFlags(EVENTFLAG_CAPS_LOCK_ON, (::GetKeyState(VK_CAPITAL) & 1) != 0);
+}
@@ -0,0 +1,78 @@
+#pragma once
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include <include/internal/cef_types.h>
+#include <SFML\Window.hpp>
+
+////////////////////////////////////////////////////////////
+/// \brief Keeps the modifier keys, mouse buttons and lock keys as cef event flags, from window events.
+///
+/// Reading the flags is a single load, instead of asking the os about each key and button.
+/// Because they follow the events, the flags sent with an event are those of that event,
+/// not of whatever happens to be held by the time it is handled.
+///
+/// Caps and num lock are read from GetKeyState() on key events and when the window gains
+/// focus, which gives their state as of the message being handled.
+///
+/// Until the first event comes in nothing is known, so GetModifiers() asks the os as before.
+///
+////////////////////////////////////////////////////////////
+class InputState
+{
+public:
+	InputState();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Updates the flags from a window event.  Call for every event, from one thread.
+	///
+	////////////////////////////////////////////////////////////
+	void ProcessEvent(const sf::Event& event);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the cef event flags of the mouse buttons, modifier keys and lock keys.
+	///
+	/// Can be called from any thread.
+	///
+	////////////////////////////////////////////////////////////
+	int GetModifiers() const { return mTracking ? (int)mModifiers : Poll(); }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns whether events have been seen, so the flags come from them.
+	///
+	////////////////////////////////////////////////////////////
+	bool IsTracking() const { return mTracking; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Event flags of the mouse buttons.
+	///
+	////////////////////////////////////////////////////////////
+	static const int MOUSE_BUTTON_FLAGS = EVENTFLAG_LEFT_MOUSE_BUTTON | EVENTFLAG_MIDDLE_MOUSE_BUTTON | EVENTFLAG_RIGHT_MOUSE_BUTTON;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Asks the os for every flag.
+	///
+	////////////////////////////////////////////////////////////
+	static int Poll();
+
+private:
+	////////////////////////////////////////////////////////////
+	/// \brief Sets or clears flags.
+	///
+	////////////////////////////////////////////////////////////
+	void SetFlags(int flags, bool set);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Reads caps and num lock into the flags.
+	///
+	////////////////////////////////////////////////////////////
+	void UpdateLocks();
+
+	////////////////////////////////////////////////////////////
+	/// \brief The flags, written only by the thread calling ProcessEvent().
+	///
+	////////////////////////////////////////////////////////////
+	volatile long mModifiers;
+
+	volatile bool mTracking;
+};
@@ -0,0 +1,289 @@
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include "InterfaceRegistry.h"
+#include <windows.h>
+
+////////////////////////////////////////////////////////////
+// Static variables
+////////////////////////////////////////////////////////////
+
+//Readers are counted by the epoch they entered in.  Retire() moves to the next epoch and
+//waits for the count of the last one to drain, while new readers count towards the next.
+static volatile long sReaders[2] = { 0, 0 };
+static volatile long sEpoch = 0;
+
+//How deep the calling thread is in ReadScopes, and the epoch its outermost scope counts towards.
+static __declspec(thread) int tDepth = 0;
+static __declspec(thread) long tEpoch = 0;
+
+//--------------------------------------------------------------------------------------------------------------------------
+//Read Scope Methods
+//--------------------------------------------------------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////
+InterfaceRegistry::ReadScope::ReadScope()
+{
+	if (tDepth++ > 0)
+		return;
+
+	for (;;)
+	{
+		long epoch = sEpoch;
+		InterlockedIncrement(&sReaders[epoch & 1]);
+
+		//If a Retire() moved on meanwhile it may not wait for us, so count towards the new epoch.
+		if (sEpoch == epoch)
+		{
+			tEpoch = epoch;
+			return;
+		}
+
+		InterlockedDecrement(&sReaders[epoch & 1]);
+	}
+}
+
+////////////////////////////////////////////////////////////
+InterfaceRegistry::ReadScope::~ReadScope()
+{
+	if (--tDepth > 0)
+		return;
+
+	InterlockedDecrement(&sReaders[tEpoch & 1]);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+//Iterator Methods
+//--------------------------------------------------------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////
+InterfaceRegistry::Iterator::Iterator(const InterfaceRegistry& registry)
+: mpTable(NULL)
+, mSlot(0)
+{
+	//Taken inside the scope, so the table lives as long as the iterator.
+	mpTable = registry.mpTable;
+}
+
+////////////////////////////////////////////////////////////
+WebInterface* InterfaceRegistry::Iterator::Next()
+{
+	const Table* pTable = (const Table*)mpTable;
+
+	while (mSlot <= pTable->mask)
+	{
+		WebInterface* pWeb = pTable->slots[mSlot++].pWeb;
+		if (pWeb)
+			return pWeb;
+	}
+
+	return NULL;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+//Interface Registry Methods
+//--------------------------------------------------------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////
+InterfaceRegistry::InterfaceRegistry()
+: mpTable(NULL)
+, mUsed(0)
+, mLive(0)
+{
+	mpTable = CreateTable(INTERFACE_REGISTRY_SIZE);
+}
+
+////////////////////////////////////////////////////////////
+InterfaceRegistry::~InterfaceRegistry()
+{
+	mRetired.push_back((Table*)mpTable);
+	for (unsigned int i = 0; i < mRetired.size(); i++)
+	{
+		delete[] mRetired[i]->slots;
+		delete mRetired[i];
+	}
+}
+
+////////////////////////////////////////////////////////////
+void InterfaceRegistry::Add(int id, WebInterface* pWeb)
+{
+	sf::Lock lock(mWriteMutex);
+
+	Reclaim();
+
+	//Keep at least half the slots empty, so probes stay short.
+	if ((mUsed + 1) * 2 > mpTable->mask + 1)
+		Rebuild();
+
+	Table* pTable = mpTable;
+	for (long i = Hash(id, pTable->mask);; i = (i + 1) & pTable->mask)
+	{
+		Slot& slot = pTable->slots[i];
+		if (slot.id != 0)
+			continue;
+
+		//The WebInterface goes in before the id, so a reader finding the id finds it too.
+		slot.pWeb = pWeb;
+		InterlockedExchange(&slot.id, id);
+		break;
+	}
+
+	mUsed++;
+	mLive++;
+}
+
+////////////////////////////////////////////////////////////
+void InterfaceRegistry::Remove(int id)
+{
+	sf::Lock lock(mWriteMutex);
+
+	Table* pTable = mpTable;
+	for (long i = Hash(id, pTable->mask), n = 0; n <= pTable->mask; i = (i + 1) & pTable->mask, n++)
+	{
+		Slot& slot = pTable->slots[i];
+		if (slot.id == 0)
+			break;
+
+		if (slot.id == id && slot.pWeb)
+		{
+			InterlockedExchangePointer((void* volatile*)&slot.pWeb, NULL);
+			InterlockedExchange(&slot.id, SLOT_REMOVED);
+			mLive--;
+			break;
+		}
+	}
+
+	Reclaim();
+}
+
+////////////////////////////////////////////////////////////
+void InterfaceRegistry::Retire(WebInterface* pWeb)
+{
+	sf::Lock retireLock(mRetireMutex);
+
+	{
+		sf::Lock lock(mWriteMutex);
+
+		//The browser may already be gone, so look for the WebInterface itself.  This is rare
+		//enough for a walk over the table to be fine.
+		Table* pTable = mpTable;
+		for (long i = 0; i <= pTable->mask; i++)
+		{
+			Slot& slot = pTable->slots[i];
+			if (slot.pWeb == pWeb)
+			{
+				InterlockedExchangePointer((void* volatile*)&slot.pWeb, NULL);
+				InterlockedExchange(&slot.id, SLOT_REMOVED);
+				mLive--;
+			}
+		}
+	}
+
+	//Readers entering from now on can not find it.  Wait out those which entered before.
+	long epoch = sEpoch;
+	InterlockedExchange(&sEpoch, epoch + 1);
+
+	//A reader on this thread would never finish while we wait.
+	long self = (tDepth > 0 && tEpoch == epoch) ? 1 : 0;
+	while (sReaders[epoch & 1] > self)
+		Sleep(0);
+
+	sf::Lock lock(mWriteMutex);
+	Reclaim();
+}
+
+////////////////////////////////////////////////////////////
+WebInterface* InterfaceRegistry::Find(int id) const
+{
+	const Table* pTable = mpTable;
+	for (long i = Hash(id, pTable->mask), n = 0; n <= pTable->mask; i = (i + 1) & pTable->mask, n++)
+	{
+		const Slot& slot = pTable->slots[i];
+		long slotId = slot.id;
+
+		if (slotId == id)
+		{
+			//NULL once removed.  A removed id is added again in a later slot, so keep looking.
+			WebInterface* pWeb = slot.pWeb;
+			if (pWeb)
+				return pWeb;
+		}
+		else if (slotId == 0)
+			break;
+	}
+
+	return NULL;
+}
+
+////////////////////////////////////////////////////////////
+long InterfaceRegistry::Hash(int id, long mask)
+{
+	//Browser ids count up from 1, spread them over the table.
+	return (long)(((unsigned long)id * 2654435761u) & (unsigned long)mask);
+}
+
+////////////////////////////////////////////////////////////
+InterfaceRegistry::Table* InterfaceRegistry::CreateTable(long capacity)
+{
+	Table* pTable = new Table();
+	pTable->slots = new Slot[capacity];
+	pTable->mask = capacity - 1;
+
+	for (long i = 0; i < capacity; i++)
+	{
+		pTable->slots[i].id = 0;
+		pTable->slots[i].pWeb = NULL;
+	}
+
+	return pTable;
+}
+
+////////////////////////////////////////////////////////////
+void InterfaceRegistry::Rebuild()
+{
+	Table* pOld = mpTable;
+
+	//Double while more than a quarter of the slots would be in use, otherwise just drop the markers.
+	long capacity = pOld->mask + 1;
+	while ((mLive + 1) * 4 > capacity)
+		capacity *= 2;
+
+	Table* pTable = CreateTable(capacity);
+	for (long i = 0; i <= pOld->mask; i++)
+	{
+		const Slot& old = pOld->slots[i];
+		if (!old.pWeb)
+			continue;
+
+		long j = Hash(old.id, pTable->mask);
+		while (pTable->slots[j].id != 0)
+			j = (j + 1) & pTable->mask;
+
+		pTable->slots[j].id = old.id;
+		pTable->slots[j].pWeb = old.pWeb;
+	}
+
+	//The exchange is a full barrier, so the table is filled in before readers can see it.
+	InterlockedExchangePointer((void* volatile*)&mpTable, pTable);
+	mRetired.push_back(pOld);
+	mUsed = mLive;
+}
+
+////////////////////////////////////////////////////////////
+void InterfaceRegistry::Reclaim()
+{
+	if (mRetired.empty())
+		return;
+
+	//Readers only pick up a table after entering, and the old ones were replaced before now.
+	//If no one is inside a scope at this point, no one can still have them.
+	if (sReaders[0] != 0 || sReaders[1] != 0)
+		return;
+
+	for (unsigned int i = 0; i < mRetired.size(); i++)
+	{
+		delete[] mRetired[i]->slots;
+		delete mRetired[i];
+	}
+	mRetired.clear();
+}
@@ -0,0 +1,205 @@
+#pragma once
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include <SFML\System.hpp>
+#include <vector>
+
+////////////////////////////////////////////////////////////
+// Pre-processor Definitions
+////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////
+// Number of slots an InterfaceRegistry starts with.  Must be
+// a power of two.  It grows as needed.
+//
+////////////////////////////////////////////////////////////
+#ifndef INTERFACE_REGISTRY_SIZE
+#define INTERFACE_REGISTRY_SIZE 64
+#endif
+
+class WebInterface;
+
+////////////////////////////////////////////////////////////
+/// \brief Finds WebInterfaces by the ID of their cef browser, from any thread, without locking.
+///
+/// The WebInterfaces are kept in an open addressed table.  Adding only ever fills empty
+/// slots, and removing leaves a marker behind, so a slot never changes from one browser to
+/// another.  Once too few empty slots are left the table is rebuilt without the markers,
+/// into a new table, which makes a new generation.  A reader which found a browser's slot
+/// therefore always reads that browser's WebInterface, or NULL once it is removed.
+///
+/// Readers only look things up inside a ReadScope, which costs one atomic increment and
+/// decrement.  Retire() takes a WebInterface out and then waits for every ReadScope which
+/// may have seen it to end, so a WebInterface is never destroyed while a reader uses it.
+/// Old generations are freed once no reader is left.
+///
+/// Add() and Remove() are only called on the cef thread.  Retire() can be called on any
+/// thread.  There should be one registry for the whole program, as ReadScope is shared.
+///
+////////////////////////////////////////////////////////////
+class InterfaceRegistry
+{
+public:
+	////////////////////////////////////////////////////////////
+	/// \brief Marks the calling thread as reading for as long as it exists.
+	///
+	/// Scopes can be nested.  Do not wait on a thread which may destroy a WebInterface
+	/// while inside one, as that thread waits for the scope to end.
+	///
+	////////////////////////////////////////////////////////////
+	class ReadScope
+	{
+	public:
+		ReadScope();
+		~ReadScope();
+	};
+
+	////////////////////////////////////////////////////////////
+	/// \brief Walks every WebInterface in the registry, inside a ReadScope of its own.
+	///
+	////////////////////////////////////////////////////////////
+	class Iterator
+	{
+	public:
+		Iterator(const InterfaceRegistry& registry);
+
+		////////////////////////////////////////////////////////////
+		/// \brief Returns the next WebInterface, or NULL once there are no more.
+		///
+		/// As with Find(), only reference it with WebInterface::TryAddRef().
+		///
+		////////////////////////////////////////////////////////////
+		WebInterface* Next();
+
+	private:
+		ReadScope mScope;
+		const void* mpTable;
+		long mSlot;
+	};
+
+	InterfaceRegistry();
+	~InterfaceRegistry();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Adds the WebInterface of a browser.  Only call on the cef thread.
+	///
+	/// \param id		ID of the browser, greater than 0.
+	/// \param pWeb		The WebInterface.
+	///
+	////////////////////////////////////////////////////////////
+	void Add(int id, WebInterface* pWeb);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Removes the WebInterface of a browser, if there is one.  Only call on the cef thread.
+	///
+	/// Readers may still be using the WebInterface afterwards.
+	///
+	////////////////////////////////////////////////////////////
+	void Remove(int id);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Removes a WebInterface about to be destroyed, and waits until no reader can be using it.
+	///
+	/// Can be called from any thread, including from inside a ReadScope, though not from
+	/// inside one on two threads at once.
+	///
+	////////////////////////////////////////////////////////////
+	void Retire(WebInterface* pWeb);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Finds the WebInterface of a browser.  Only call inside a ReadScope.
+	///
+	/// \param id	ID of the browser.
+	///
+	/// \return The WebInterface, valid until the ReadScope ends, or NULL.  Its last reference may
+	///			already be gone, so only reference it with WebInterface::TryAddRef().
+	///
+	////////////////////////////////////////////////////////////
+	WebInterface* Find(int id) const;
+
+private:
+	////////////////////////////////////////////////////////////
+	/// \brief One entry of a table.
+	///
+	/// The id is 0 while the slot is empty, and SLOT_REMOVED once its browser is removed.
+	///
+	////////////////////////////////////////////////////////////
+	struct Slot
+	{
+	public:
+		volatile long id;
+		WebInterface* volatile pWeb;
+	};
+
+	////////////////////////////////////////////////////////////
+	/// \brief One generation of slots.
+	///
+	////////////////////////////////////////////////////////////
+	struct Table
+	{
+	public:
+		Slot* slots;
+		long mask;
+	};
+
+	static const long SLOT_REMOVED = -1;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the slot an id starts probing from.
+	///
+	////////////////////////////////////////////////////////////
+	static long Hash(int id, long mask);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Creates an empty table.
+	///
+	////////////////////////////////////////////////////////////
+	static Table* CreateTable(long capacity);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Moves every WebInterface into a new table with room for more, and publishes it.
+	///
+	////////////////////////////////////////////////////////////
+	void Rebuild();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Frees old generations if no reader is left which could be using them.
+	///
+	////////////////////////////////////////////////////////////
+	void Reclaim();
+
+	////////////////////////////////////////////////////////////
+	/// \brief The current generation, read by readers.
+	///
+	////////////////////////////////////////////////////////////
+	Table* volatile mpTable;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Generations replaced by Rebuild(), freed by Reclaim().
+	///
+	////////////////////////////////////////////////////////////
+	std::vector<Table*> mRetired;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Slots in mpTable which are not empty, and of those the ones holding a WebInterface.
+	///
+	////////////////////////////////////////////////////////////
+	long mUsed;
+	long mLive;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Guards the writers against each other.  Readers never take it.
+	///
+	////////////////////////////////////////////////////////////
+	sf::Mutex mWriteMutex;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Keeps Retire() to one thread at a time, as each waits for the epoch it ended.
+	///
+	/// Held while waiting for readers, unlike mWriteMutex, so Add() and Remove() never wait
+	/// for readers.
+	///
+	////////////////////////////////////////////////////////////
+	sf::Mutex mRetireMutex;
+};
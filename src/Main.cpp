@@ -7,119 +7,14 @@
 
 #include "WebSystem.h"
 #include "CustomScheme.h"
-
-// This annoyingly long function converts sf::Keyboard::Keys that are
-//  not characters into WPARAM key codes, which are what CEF takes. 
-// As far as I am aware there is no workaround to make this shorter.
-WPARAM sfkeyToWparam(sf::Keyboard::Key key)
-{
-	switch (key)
-	{
-	case sf::Keyboard::LControl:		return VK_CONTROL;
-	case sf::Keyboard::RControl:		return VK_CONTROL;
-	case sf::Keyboard::LSystem:		return VK_LWIN;
-	case sf::Keyboard::RSystem:		return VK_RWIN;
-	case sf::Keyboard::Menu:		return VK_APPS;
-	case sf::Keyboard::SemiColon:		return VK_OEM_1;
-	case sf::Keyboard::Slash:		return VK_OEM_2;
-	case sf::Keyboard::Equal:		return 	VK_OEM_PLUS;
-	case sf::Keyboard::Dash:		return 	VK_OEM_MINUS;
-	case sf::Keyboard::LBracket:		return 	VK_OEM_4;
-	case sf::Keyboard::RBracket:		return 	VK_OEM_6;
-	case sf::Keyboard::Comma:		return 	VK_OEM_COMMA;
-	case sf::Keyboard::Period:		return 	VK_OEM_PERIOD;
-	case sf::Keyboard::Quote:		return 	VK_OEM_7;
-	case sf::Keyboard::BackSlash:		return 	VK_OEM_5;
-	case sf::Keyboard::Tilde:		return 	VK_OEM_3;
-	case sf::Keyboard::Escape:		return 	VK_ESCAPE;
-	case sf::Keyboard::Space:		return 	VK_SPACE;
-	case sf::Keyboard::Return:		return 	VK_RETURN;
-	case sf::Keyboard::BackSpace:       return 	VK_BACK;
-	case sf::Keyboard::Tab:       return 	VK_TAB;
-	case sf::Keyboard::PageUp:		return 	VK_PRIOR;
-	case sf::Keyboard::PageDown:       return 	VK_NEXT;
-	case sf::Keyboard::End:       return 	VK_END;
-	case sf::Keyboard::Home:       return 	VK_HOME;
-	case sf::Keyboard::Insert:		return 	VK_INSERT;
-	case sf::Keyboard::Delete:		return 	VK_DELETE;
-	case sf::Keyboard::Add:       return 	VK_ADD;
-	case sf::Keyboard::Subtract:		return 	VK_SUBTRACT;
-	case sf::Keyboard::Multiply:		return 	VK_MULTIPLY;
-	case sf::Keyboard::Divide:		return 	VK_DIVIDE;
-	case sf::Keyboard::Pause:		return 	VK_PAUSE;
-	case sf::Keyboard::F1:       return 	VK_F1;
-	case sf::Keyboard::F2:       return 	VK_F2;
-	case sf::Keyboard::F3:       return 	VK_F3;
-	case sf::Keyboard::F4:       return 	VK_F4;
-	case sf::Keyboard::F5:       return 	VK_F5;
-	case sf::Keyboard::F6:       return 	VK_F6;
-	case sf::Keyboard::F7:       return 	VK_F7;
-	case sf::Keyboard::F8:       return 	VK_F8;
-	case sf::Keyboard::F9:       return 	VK_F9;
-	case sf::Keyboard::F10:       return 	VK_F10;
-	case sf::Keyboard::F11:       return 	VK_F11;
-	case sf::Keyboard::F12:       return 	VK_F12;
-	case sf::Keyboard::F13:       return 	VK_F13;
-	case sf::Keyboard::F14:       return 	VK_F14;
-	case sf::Keyboard::F15:       return 	VK_F15;
-	case sf::Keyboard::Left:       return 	VK_LEFT;
-	case sf::Keyboard::Right:		return 	VK_RIGHT;
-	case sf::Keyboard::Up:       return 	VK_UP;
-	case sf::Keyboard::Down:       return 	VK_DOWN;
-	case sf::Keyboard::Numpad0:		return 	VK_NUMPAD0;
-	case sf::Keyboard::Numpad1:		return 	VK_NUMPAD1;
-	case sf::Keyboard::Numpad2:		return 	VK_NUMPAD2;
-	case sf::Keyboard::Numpad3:		return 	VK_NUMPAD3;
-	case sf::Keyboard::Numpad4:		return 	VK_NUMPAD4;
-	case sf::Keyboard::Numpad5:		return 	VK_NUMPAD5;
-	case sf::Keyboard::Numpad6:		return 	VK_NUMPAD6;
-	case sf::Keyboard::Numpad7:		return 	VK_NUMPAD7;
-	case sf::Keyboard::Numpad8:		return 	VK_NUMPAD8;
-	case sf::Keyboard::Numpad9:		return 	VK_NUMPAD9;
-	case sf::Keyboard::A:						return	'A';
-	case sf::Keyboard::B:						return	'B';
-	case sf::Keyboard::C:						return	'C';
-	case sf::Keyboard::D:						return	'D';
-	case sf::Keyboard::E:						return	'E';
-	case sf::Keyboard::F:						return	'F';
-	case sf::Keyboard::G:						return	'G';
-	case sf::Keyboard::H:						return	'H';
-	case sf::Keyboard::I:						return	'I';
-	case sf::Keyboard::J:						return	'J';
-	case sf::Keyboard::K:						return	'K';
-	case sf::Keyboard::L:						return	'L';
-	case sf::Keyboard::M:						return	'M';
-	case sf::Keyboard::N:						return	'N';
-	case sf::Keyboard::O:						return	'O';
-	case sf::Keyboard::P:						return	'P';
-	case sf::Keyboard::Q:						return	'Q';
-	case sf::Keyboard::R:						return	'R';
-	case sf::Keyboard::S:						return	'S';
-	case sf::Keyboard::T:						return	'T';
-	case sf::Keyboard::U:						return	'U';
-	case sf::Keyboard::V:						return	'V';
-	case sf::Keyboard::W:						return	'W';
-	case sf::Keyboard::X:						return	'X';
-	case sf::Keyboard::Y:						return	'Y';
-	case sf::Keyboard::Z:						return	'Z';
-	case sf::Keyboard::Num0:					return	'0';
-	case sf::Keyboard::Num1:					return	'1';
-	case sf::Keyboard::Num2:					return	'2';
-	case sf::Keyboard::Num3:					return	'3';
-	case sf::Keyboard::Num4:					return	'4';
-	case sf::Keyboard::Num5:					return	'5';
-	case sf::Keyboard::Num6:					return	'6';
-	case sf::Keyboard::Num7:					return	'7';
-	case sf::Keyboard::Num8:					return	'8';
-	case sf::Keyboard::Num9:					return	'9';
-	}
-
-	return VK_NONAME;
-}
+#include "PixelConverter.h"
+#include "PaintReplay.h"
+#include "InputRouter.h"
+#include "SelfTests.h"
 
 //These two functions are for checking command line arguments.
-//They aren't even used here, but are included next to the 
-//entry point out of habit.
+//They are included next to the entry point out of habit, and
+//are used to pick which benchmarks to run.
 bool getCmd(char** begin, char** end, const std::string & option)
 {
 	char** itr = std::find(begin, end, option);
@@ -154,6 +49,17 @@ bool jsCallback(
 	return true;
 }
 
+// Called on the cef thread as each interface created by CreateWebInterfaces() gets its browser.
+// Bindings added before the browser exists wait for it, so they could also be added right after creation.
+void onInterfaceCreated(
+	CefRefPtr<WebInterface> pWeb
+	)
+{
+	//Add the binding for "testCallback" to our web interface.  
+	//Specifies jsCallback as the function to be called for the binding.  
+	pWeb->AddJSBinding("testCallback", &jsCallback);
+}
+
 int main(int argc, char* argv[])
 {
 	//This will force WebSystem to run in cef single process mode.  
@@ -172,6 +78,110 @@ int main(int argc, char* argv[])
 		return exit_code;
 	}
 
+	//Benchmarks run instead of the example and do not need a window.
+	if (getCmd(argv, argv + argc, "-bench_pixels"))
+	{
+		PixelConverter::Benchmark();
+		return EXIT_SUCCESS;
+	}
+
+	if (getCmd(argv, argv + argc, "-bench_snapshot"))
+	{
+		PixelConverter::BenchmarkDownscale(1920, 1080, 256);
+		return EXIT_SUCCESS;
+	}
+
+	if (getCmd(argv, argv + argc, "-bench_bindings"))
+	{
+		WebSystem::BenchmarkBindings();
+		return EXIT_SUCCESS;
+	}
+
+	//Self tests, which exit with EXIT_FAILURE if they find a problem.
+	if (getCmd(argv, argv + argc, "-test_arena"))
+		return SelfTests::TestStagingArena() ? EXIT_SUCCESS : EXIT_FAILURE;
+	if (getCmd(argv, argv + argc, "-test_handoff"))
+		return SelfTests::TestFrameHandoff() ? EXIT_SUCCESS : EXIT_FAILURE;
+	if (getCmd(argv, argv + argc, "-test_damage"))
+		return SelfTests::TestDamageRegion() ? EXIT_SUCCESS : EXIT_FAILURE;
+	if (getCmd(argv, argv + argc, "-test_commands"))
+		return SelfTests::TestCommandQueue() ? EXIT_SUCCESS : EXIT_FAILURE;
+	if (getCmd(argv, argv + argc, "-test_registry"))
+		return SelfTests::TestInterfaceRegistry() ? EXIT_SUCCESS : EXIT_FAILURE;
+
+	//Checks that mouse input queued by a WebInterface gets to its page.
+	if (getCmd(argv, argv + argc, "-test_input"))
+	{
+		WebSystem::StartWeb();
+		bool reached = WebSystem::TestInput();
+		WebSystem::EndWeb();
+		WebSystem::WaitForWebEnd();
+		return reached ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	//Renders a page without a window or OpenGL, and saves what it looks like after a few seconds.
+	if (getCmd(argv, argv + argc, "-headless"))
+	{
+		WebSystem::StartWeb();
+
+		CefRefPtr<WebInterface> pWeb = WebSystem::CreateWebInterfaceHeadless(1280, 720, "http://www.google.com", false);
+		sf::sleep(sf::seconds(5.0f));
+
+		WebInterface::PixelSpan frame = pWeb->LockFrame();
+		sf::Image img;
+		if (frame.pixels)
+			img.create(frame.width, frame.height, frame.pixels);
+		printf("Headless frame %u, %dx%d.\n", frame.sequence, frame.width, frame.height);
+		pWeb->UnlockFrame();
+
+		if (frame.pixels)
+			img.saveToFile("headless.png");
+
+		pWeb->Close();
+		pWeb = NULL;
+
+		WebSystem::EndWeb();
+		WebSystem::WaitForWebEnd();
+		return EXIT_SUCCESS;
+	}
+
+	//Feeds recorded or generated paints through a WebInterface with no browser, and prints how fast they went.
+	//-replay takes a file written with -record, or "synthetic".
+	char* replayPath = getCmdOption(argv, argv + argc, "-replay");
+	if (replayPath)
+	{
+		bool headless = getCmd(argv, argv + argc, "-replay_headless");
+
+		//Uploading needs an OpenGL context on this thread, but no window.
+		sf::Context* context = NULL;
+		if (!headless)
+			context = new sf::Context();
+
+		PaintReplay replay;
+		replay.SetRealTime(getCmd(argv, argv + argc, "-replay_realtime"));
+		if (std::string(replayPath) == "synthetic")
+			replay.UseSynthetic(1280, 720, 600);
+		else if (!replay.OpenRecording(replayPath))
+		{
+			printf("Could not open %s.\n", replayPath);
+			delete context;
+			return EXIT_FAILURE;
+		}
+
+		CefRefPtr<WebInterface> pWeb = new WebInterface(1280, 720, "", false, NULL, headless);
+		if (getCmd(argv, argv + argc, "-replay_handoff"))
+			pWeb->SetUpdateMode(WebInterface::UPDATE_HANDOFF);
+
+		PaintReplay::Stats stats;
+		if (!replay.Run(pWeb, stats))
+			printf("Replay stopped early.\n");
+		PaintReplay::PrintStats(stats);
+
+		pWeb = NULL;
+		delete context;
+		return EXIT_SUCCESS;
+	}
+
 	//Make the window to render things in.
 	sf::RenderWindow window;
 	window.create(sf::VideoMode(1280, 720), "test_base", sf::Style::Close);
@@ -180,6 +190,7 @@ int main(int argc, char* argv[])
 	//WebInterfaces are used to interact with the web system.  
 	std::vector<CefRefPtr<WebInterface>> webInterfaces;
 	std::vector<sf::Sprite> sprites;
+	AtlasBatch atlasBatch;
 
 	//This starts the thread that runs CEF.
 	//Said thread is a part of the WebSystem and not CEF's own multi threading.  
@@ -196,34 +207,76 @@ int main(int argc, char* argv[])
 
 	int cols = 1;
 	int rows = 1;
+
+	//Keep a few browsers ready, so panels opened later come up without waiting for cef.
+	if (getCmd(argv, argv + argc, "-pool"))
+	{
+		WebSystem::SetBrowserPool(4, WebInterfaceSpec(
+			(int)(window.getSize().x / (float)cols)
+			, (int)(window.getSize().y / (float)rows)
+			, "about:blank"
+			, true
+			, window.getSystemHandle()));
+	}
+
+	//Ask for every interface at once.  Their browsers come up side by side while the window
+	//keeps drawing, rather than one after another before the first frame.
+	//Parameters are (width, height, staring URL, transparent background, window)
+	std::vector<WebInterfaceSpec> specs;
 	for (int i = 0; i < cols * rows; i++)
 	{
-		int currCol, currRow;
-		currCol = i % cols;
-		currRow = (int)floor((double)i / cols);
-		CefRefPtr<WebInterface> pWeb;
-		//Create our web interface and retrieve a pointer to it.  
-		//Parameters are (width, height, staring URL, transparent background)
-		pWeb = WebSystem::CreateWebInterfaceSync(
+		specs.push_back(WebInterfaceSpec(
 			(int)(window.getSize().x / (float)cols)
 			, (int)(window.getSize().y / (float)rows)
 			//,"local://../res/index.htm"
 			//,"http://www.randomwebsite.com/cgi-bin/random.pl"
 			, "http://www.google.com"
 			, true
-			, window.getSystemHandle());
+			, window.getSystemHandle()));
+	}
+	WebSystem::CreateWebInterfaces(specs, webInterfaces, &onInterfaceCreated);
+
+	for (int i = 0; i < cols * rows; i++)
+	{
+		int currCol, currRow;
+		currCol = i % cols;
+		currRow = (int)floor((double)i / cols);
+		CefRefPtr<WebInterface> pWeb = webInterfaces[i];
+
+		//Have the draw thread upload each changed region once, instead of uploading on both threads.
+		pWeb->SetUpdateMode(WebInterface::UPDATE_HANDOFF);
+
+		//Stream those uploads through pixel buffers where the driver allows it.
+		pWeb->SetUploadBackend(TextureUploader::BACKEND_PBO);
 
-		//Add the binding for "testCallback" to our web interface.  
-		//Specifies jsCallback as the function to be called for the binding.  
-		pWeb->AddJSBinding("testCallback", &jsCallback);
+		//Upload cef's BGRA pixels as they are, so painting only copies them.
+		pWeb->SetPixelFormat(TextureUploader::FORMAT_BGRA);
 
-		webInterfaces.push_back(pWeb);
+		//Stop painting the interface whenever it is not drawn.
+		pWeb->SetAutoVisibility(true);
+
+		//Small grid cells share atlas pages, so they can all be drawn in one batch.
+		//A single view covering the window is cut into tiles instead, so small dirty rects only touch small textures.
+		if (cols * rows > 1)
+			pWeb->SetAtlased(true);
+		else
+			pWeb->SetTileSize(256);
+
+		//Record the paints of the first interface, for playing back later.
+		char* recordPath = getCmdOption(argv, argv + argc, "-record");
+		if (recordPath && i == 0)
+			pWeb->StartRecording(recordPath);
 
 		//Set up the sprite which will be drawing our web texture.  
 		sf::Sprite sprite;
 		//printf("Setting sprite texture.\n");
 		//Get the texture from pWeb to draw in texture.  This only need be done once.  
-		sprite.setTexture(*pWeb->GetTexture());
+		//Tiled interfaces have no single texture, the sprite then only places them.
+		if (pWeb->GetTexture())
+		{
+			sprite.setTexture(*pWeb->GetTexture());
+			sprite.setTextureRect(pWeb->GetTextureRect());
+		}
 		//sprite.setOrigin(sprite.getTexture()->getSize().x / 2.0f, sprite.getTexture()->getSize().y / 2.0f);
 		float x, y;
 		x = ((float)currCol / cols) * window.getSize().x;
@@ -233,12 +286,17 @@ int main(int argc, char* argv[])
 		sprites.push_back(sprite);
 	}
 
-	//These variables are used to track rapid mouse clicks.
-	//This is so that we can properly send double/triple clicks to WebSystem.
-	sf::Clock clickClock; clickClock.restart();
-	float clickTime = 0.25f;
-	sf::Mouse::Button lastClickType = sf::Mouse::Left;
-	int clickCount = 1;
+	//Load a second page behind the first, for F1 to swap in without a blank frame.
+	CefRefPtr<WebInterface> pPrerender;
+	char* prerenderUrl = getCmdOption(argv, argv + argc, "-prerender");
+	if (prerenderUrl && webInterfaces.size())
+		pPrerender = WebSystem::Prerender(webInterfaces[0], prerenderUrl);
+
+	//The router sends each event to the one interface it is meant for.
+	//Later interfaces are drawn on top, so they are placed on top.
+	InputRouter router;
+	for (unsigned int i = 0; i < webInterfaces.size(); i++)
+		router.Place(webInterfaces[i], sprites[i].getTransform(), i);
 
 	//This is acutally the exact example loop from SFML's tutorials.  
     // run the program as long as the window is open
@@ -252,143 +310,66 @@ int main(int argc, char* argv[])
 			if (event.type == sf::Event::Closed)
 				window.close();
 
-			//if (!webInterfaces.size()) continue;
-			if (event.type == sf::Event::MouseButtonPressed)
+			if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F1 && pPrerender && webInterfaces.size())
 			{
-
-				if (clickClock.getElapsedTime().asSeconds() < clickTime && event.mouseButton.button == lastClickType)
-					clickCount++;
-				else
-					clickCount = 1;
-
-				lastClickType = event.mouseButton.button;
-
-				for (unsigned int i = 0; i < webInterfaces.size(); i++)
+				//The prerendered interface brings its own texture, which already holds the page.
+				CefRefPtr<WebInterface> pOld = webInterfaces[0];
+				if (WebSystem::SwapIn(webInterfaces[0], pPrerender))
 				{
-					if (webInterfaces.size())
-						webInterfaces[i]->SendFocusEvent(true);
-					//Send the mouse down events.  
-					//These two lines transform the global mouse position into coordinates of the sprite
-					// which the web is being drawn to.  
-					sf::Vector2f point = (sf::Vector2f)sf::Mouse::getPosition(window);
-					point = sprites[i].getInverseTransform().transformPoint(point);
-					//printf("Point: (%d, %d)\n", (int)point.x, (int)point.y);
-					//CefBrowserHost::MouseButtonType type = event.mouseButton.button == sf::Mouse::Left ? MBT_LEFT : MBT_RIGHT;
-
-					webInterfaces[i]->SendMouseClickEvent((int)point.x, (int)point.y, event.mouseButton.button, false, clickCount);
-
-					clickClock.restart();
+					pPrerender = NULL;
+					router.Remove(pOld);
+					router.Place(webInterfaces[0], sprites[0].getTransform(), 0);
+					if (webInterfaces[0]->GetTexture())
+					{
+						sprites[0].setTexture(*webInterfaces[0]->GetTexture());
+						sprites[0].setTextureRect(webInterfaces[0]->GetTextureRect());
+					}
 				}
+				else
+					printf("Prerendered page is still loading.\n");
 			}
-			if (event.type == sf::Event::MouseButtonReleased)
+
+			if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Escape && webInterfaces.size())
 			{
+				//webInterfaces.front()->GetBrowser()->GetHost()->ParentWindowWillClose();
+				//webInterfaces.front()->GetBrowser()->GetHost()->CloseBrowser(true);
+				//webInterfaces.front()->Release();
+
 				for (unsigned int i = 0; i < webInterfaces.size(); i++)
 				{
-					if (webInterfaces.size())
-						webInterfaces[i]->SendFocusEvent(true);
-					//Send the mouse release events.
-					sf::Vector2f point = (sf::Vector2f)sf::Mouse::getPosition(window);
-					point = sprites[i].getInverseTransform().transformPoint(point);
-					CefBrowserHost::MouseButtonType type = event.mouseButton.button == sf::Mouse::Left ? MBT_LEFT : MBT_RIGHT;
-					webInterfaces[i]->SendMouseClickEvent((int)point.x, (int)point.y, event.mouseButton.button, true, clickCount);
+					webInterfaces[i]->Close();
+					webInterfaces[i] = NULL;
 				}
+				webInterfaces.clear();
+				sprites.clear();
+				router.Clear();
 			}
-			for (unsigned int i = 0; i < webInterfaces.size(); i++)
-			{
-				if (webInterfaces.size())
-					webInterfaces[i]->SendFocusEvent(true);
-				if (event.type == sf::Event::MouseMoved)
-				{
-					//Send events for when the mouse moves.  
-					sf::Vector2f point = (sf::Vector2f)sf::Mouse::getPosition(window);
-					point = sprites[i].getInverseTransform().transformPoint(point);
-					webInterfaces[i]->SendMouseMoveEvent((int)point.x, (int)point.y, false);
-				}
-				if (event.type == sf::Event::MouseWheelMoved)
-				{
-					//Send events for the mousewheel.  
-					//CURRENTLY BROKEN AND DOES NOTHING
-					//printf("Mousewheel: %d\n", event.mouseWheel.delta);
-					sf::Vector2f point = (sf::Vector2f)sf::Mouse::getPosition(window);
-					point = sprites[i].getInverseTransform().transformPoint(point);
-					webInterfaces[i]->SendMouseWheelEvent((int)point.x, (int)point.y, 0, event.mouseWheel.delta * 30);
-				}
-				if (event.type == sf::Event::KeyPressed)
-				{
-					if (event.key.code == sf::Keyboard::Escape)
-					{
-						if (webInterfaces.size())
-						{
-							//webInterfaces.front()->GetBrowser()->GetHost()->ParentWindowWillClose();
-							//webInterfaces.front()->GetBrowser()->GetHost()->CloseBrowser(true);
-							//webInterfaces.front()->Release();
-
-							for (unsigned int i = 0; i < webInterfaces.size(); i++)
-							{
-								webInterfaces[i]->Close();
-								webInterfaces[i] = NULL;
-							}
-							webInterfaces.clear();
-							sprites.clear();
-						}
-					}
-					//if (!webInterfaces.size()) continue;
-					//if (event.key.code == sf::Keyboard::A)
-					//{
-					//	webInterfaces.front()->ExecuteJS("document.getElementById(\"input_textbox\").value = \"c++_put_this_here\";\n");
-					//}
-					////These are just for the rotation to demonstrate the web being drawn to a sprite.  
-					//if (event.key.code == sf::Keyboard::Q)
-					//{
-					//	sprites.front().rotate(1.0f);
-					//}
-					//if (event.key.code == sf::Keyboard::E)
-					//{
-					//	sprites.front().rotate(-1.0f);
-					//}
-					//if (event.key.code == sf::Keyboard::S)
-					//{
-					//	if (!webInterfaces.size()) continue;
-					//	webInterfaces.front()->SetSize(640, 360);
-					//	sprites.front().setTexture(*webInterfaces.front()->GetTexture(), true);
-					//	sprites.front().setOrigin(sprites.front().getTexture()->getSize().x / 2.0f, sprites.front().getTexture()->getSize().y / 2.0f);
-					//	sprites.front().setPosition(640, 360);
-					//}
-
-					if (!webInterfaces.size())continue;
-
-					//Make sure we give focus to the browser since we are about to send it input.  
-					//Since focus is never taken away in this example, this only actually needs to be done once.  
-					//webInterfaces[i]->SendFocusEvent(true);
-
-					//Set up and pass the key down to the web interface, which then passes to CEF.
-					WPARAM key = sfkeyToWparam(event.key.code);
-
-					if (key != VK_NONAME)
-					{
-						webInterfaces[i]->SendKeyEvent(key, false, event.key.control);
-					}
-				}
-				if (event.type == sf::Event::KeyReleased)
-				{
-					//Same as passing the key down, but for the key up.  
-					WPARAM key = sfkeyToWparam(event.key.code);
-
-					if (key != VK_NONAME)
-					{
-						webInterfaces[i]->SendKeyEvent(key, true, event.key.control);
-					}
-				}
-				if (event.type == sf::Event::TextEntered)
-				{
-					//This passes the key events for keys which have a character value.  
-					//webInterfaces[i]->SendFocusEvent(true);
-
-					WPARAM key = (WPARAM)(char)event.text.unicode;
 
-					webInterfaces[i]->SendKeyEvent((char)event.text.unicode);
-				}
-			}
+			//if (!webInterfaces.size()) continue;
+			//if (event.key.code == sf::Keyboard::A)
+			//{
+			//	webInterfaces.front()->ExecuteJS("document.getElementById(\"input_textbox\").value = \"c++_put_this_here\";\n");
+			//}
+			////These are just for the rotation to demonstrate the web being drawn to a sprite.  
+			//if (event.key.code == sf::Keyboard::Q)
+			//{
+			//	sprites.front().rotate(1.0f);
+			//}
+			//if (event.key.code == sf::Keyboard::E)
+			//{
+			//	sprites.front().rotate(-1.0f);
+			//}
+			//if (event.key.code == sf::Keyboard::S)
+			//{
+			//	if (!webInterfaces.size()) continue;
+			//	webInterfaces.front()->SetSize(640, 360);
+			//	sprites.front().setTexture(*webInterfaces.front()->GetTexture(), true);
+			//	sprites.front().setOrigin(sprites.front().getTexture()->getSize().x / 2.0f, sprites.front().getTexture()->getSize().y / 2.0f);
+			//	sprites.front().setPosition(640, 360);
+			//}
+
+			//Mouse events go to the topmost interface under the mouse, key events to the one clicked last.
+			router.ProcessEvent(event);
 
 			if (!webInterfaces.size())
 			{
@@ -412,6 +393,8 @@ int main(int argc, char* argv[])
 						sprite.setTexture(*webInterfaces.back()->GetTexture());
 						//sprite.setOrigin(sprite.getTexture()->getSize().x / 2.0f, sprite.getTexture()->getSize().y / 2.0f);
 						sprites.push_back(sprite);
+
+						router.Place(webInterfaces.back(), sprite.getTransform());
 					}
 				}
 			}
@@ -423,12 +406,33 @@ int main(int argc, char* argv[])
 		window.clear();
 
 		//draw stuff
+		//Transparent pages come out of cef premultiplied, their render states composite them correctly.
+		//Atlased interfaces are collected and drawn with one call per atlas page.
+		atlasBatch.Clear();
 		for (unsigned int i = 0; i < sprites.size(); i++)
-			window.draw(sprites[i]);
+		{
+			webInterfaces[i]->MarkDrawn();
+
+			if (webInterfaces[i]->IsAtlased())
+				atlasBatch.Add(webInterfaces[i], sprites[i].getTransform());
+			else
+				webInterfaces[i]->Draw(window, sprites[i].getTransform());
+		}
+		atlasBatch.Draw(window);
 
 		window.display();
     }
 
+	if (pPrerender)
+	{
+		pPrerender->Close();
+		pPrerender = NULL;
+	}
+
+	//Write out whatever is still queued before the recording is cut off.
+	for (unsigned int i = 0; i < webInterfaces.size(); i++)
+		webInterfaces[i]->StopRecording();
+
 	WebSystem::EndWeb();
 	WebSystem::WaitForWebEnd();
 
@@ -0,0 +1,636 @@
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include "PaintRecorder.h"
+#include "DamageRegion.h"
+#include <cstring>
+#include <windows.h>
+
+////////////////////////////////////////////////////////////
+// Static variables
+////////////////////////////////////////////////////////////
+static const char sMagic[4] = { 'W', 'S', 'P', 'R' };
+
+////////////////////////////////////////////////////////////
+//Bytes in a record before its dirty rects: flags, width, height, time, rect count, block count and size.
+static const size_t sRecordHeaderSize = 4 * 3 + 8 + 4 * 3;
+
+//--------------------------------------------------------------------------------------------------------------------------
+//Serialization Helpers
+//--------------------------------------------------------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////
+static void Put32(std::vector<sf::Uint8>& out, sf::Uint32 value)
+{
+	out.push_back((sf::Uint8)(value));
+	out.push_back((sf::Uint8)(value >> 8));
+	out.push_back((sf::Uint8)(value >> 16));
+	out.push_back((sf::Uint8)(value >> 24));
+}
+
+////////////////////////////////////////////////////////////
+static void Put64(std::vector<sf::Uint8>& out, sf::Int64 value)
+{
+	Put32(out, (sf::Uint32)((sf::Uint64)value));
+	Put32(out, (sf::Uint32)((sf::Uint64)value >> 32));
+}
+
+////////////////////////////////////////////////////////////
+static void PutRect(std::vector<sf::Uint8>& out, const CefRect& rect)
+{
+	Put32(out, (sf::Uint32)rect.x);
+	Put32(out, (sf::Uint32)rect.y);
+	Put32(out, (sf::Uint32)rect.width);
+	Put32(out, (sf::Uint32)rect.height);
+}
+
+////////////////////////////////////////////////////////////
+//Overwrites a value written earlier, e.g. a size only known once the data after it is written.
+static void Patch32(std::vector<sf::Uint8>& out, size_t at, sf::Uint32 value)
+{
+	out[at] = (sf::Uint8)(value);
+	out[at + 1] = (sf::Uint8)(value >> 8);
+	out[at + 2] = (sf::Uint8)(value >> 16);
+	out[at + 3] = (sf::Uint8)(value >> 24);
+}
+
+////////////////////////////////////////////////////////////
+static sf::Uint32 Get32(const sf::Uint8* p)
+{
+	return (sf::Uint32)p[0] | ((sf::Uint32)p[1] << 8) | ((sf::Uint32)p[2] << 16) | ((sf::Uint32)p[3] << 24);
+}
+
+////////////////////////////////////////////////////////////
+static sf::Int64 Get64(const sf::Uint8* p)
+{
+	return (sf::Int64)((sf::Uint64)Get32(p) | ((sf::Uint64)Get32(p + 4) << 32));
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+//Paint Format Methods
+//--------------------------------------------------------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////
+void PaintFormat::EncodeRLE(const sf::Uint32* pixels, int count, std::vector<sf::Uint8>& out)
+{
+	const int maxPacket = 0x7FFF;
+
+	int i = 0;
+	while (i < count)
+	{
+		int run = 1;
+		while (i + run < count && run < maxPacket && pixels[i + run] == pixels[i])
+			run++;
+
+		if (run > 1)
+		{
+			out.push_back((sf::Uint8)(run & 0xFF));
+			out.push_back((sf::Uint8)((run >> 8) | 0x80));
+			Put32(out, pixels[i]);
+			i += run;
+			continue;
+		}
+
+		//Literals last until the next pair of equal pixels, which starts a run.
+		int literals = 1;
+		while (i + literals < count && literals < maxPacket &&
+			!(i + literals + 1 < count && pixels[i + literals] == pixels[i + literals + 1]))
+			literals++;
+
+		out.push_back((sf::Uint8)(literals & 0xFF));
+		out.push_back((sf::Uint8)(literals >> 8));
+		for (int l = 0; l < literals; l++)
+			Put32(out, pixels[i + l]);
+		i += literals;
+	}
+}
+
+////////////////////////////////////////////////////////////
+bool PaintFormat::DecodeRLE(const sf::Uint8* data, size_t size, sf::Uint32* pixels, int count)
+{
+	const sf::Uint8* end = data + size;
+	int i = 0;
+
+	while (data + 2 <= end)
+	{
+		int packet = data[0] | (data[1] << 8);
+		data += 2;
+
+		bool run = (packet & 0x8000) != 0;
+		packet &= 0x7FFF;
+		if (i + packet > count)
+			return false;
+
+		if (run)
+		{
+			if (data + 4 > end)
+				return false;
+
+			sf::Uint32 pixel = Get32(data);
+			data += 4;
+			for (int p = 0; p < packet; p++)
+				pixels[i++] = pixel;
+		}
+		else
+		{
+			if (data + packet * 4 > end)
+				return false;
+
+			for (int p = 0; p < packet; p++, data += 4)
+				pixels[i++] = Get32(data);
+		}
+	}
+
+	return data == end && i == count;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+//Paint Recorder Methods
+//--------------------------------------------------------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////
+PaintRecorder::PaintRecorder()
+: mpThread(NULL)
+, mStopping(false)
+, mWakeEvent(NULL)
+, mQueuedBytes(0)
+, mLastWidth(0)
+, mLastHeight(0)
+, mNeedFull(true)
+, mDropped(0)
+, mPreviousWidth(0)
+, mPreviousHeight(0)
+, mSinceKeyframe(0)
+, mCompress(true)
+, mKeyframeInterval(PAINT_RECORDER_KEYFRAME_INTERVAL)
+{
+
+}
+
+////////////////////////////////////////////////////////////
+PaintRecorder::~PaintRecorder()
+{
+	Stop();
+}
+
+////////////////////////////////////////////////////////////
+bool PaintRecorder::Start(const std::string& path)
+{
+	Stop();
+
+	mFile.open(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!mFile)
+		return false;
+
+	std::vector<sf::Uint8> header(sMagic, sMagic + 4);
+	Put32(header, PaintFormat::VERSION);
+	mFile.write((const char*)&header[0], header.size());
+
+	mLastWidth = 0;
+	mLastHeight = 0;
+	mNeedFull = true;
+	mDropped = 0;
+	mPrevious.clear();
+	mPreviousWidth = 0;
+	mPreviousHeight = 0;
+	mSinceKeyframe = 0;
+	mClock.restart();
+
+	mStopping = false;
+	mWakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	mpThread = new sf::Thread(&PaintRecorder::WriterThread, this);
+	mpThread->launch();
+
+	return true;
+}
+
+////////////////////////////////////////////////////////////
+void PaintRecorder::Stop()
+{
+	if (!mpThread)
+		return;
+
+	mStopping = true;
+	SetEvent(mWakeEvent);
+	mpThread->wait();
+
+	delete mpThread;
+	mpThread = NULL;
+
+	CloseHandle(mWakeEvent);
+	mWakeEvent = NULL;
+
+	mFile.close();
+}
+
+////////////////////////////////////////////////////////////
+void PaintRecorder::Record(const void* buffer, int width, int height, const CefRenderHandler::RectList& dirtyRects)
+{
+	if (!mpThread || !buffer || width <= 0 || height <= 0)
+		return;
+
+	CefRect view(0, 0, width, height);
+	bool full = mNeedFull || width != mLastWidth || height != mLastHeight;
+
+	size_t bytes = 0;
+	if (full)
+	{
+		bytes = width * height * 4;
+	}
+	else
+	{
+		for (unsigned int i = 0; i < dirtyRects.size(); i++)
+		{
+			CefRect rect = DamageRegion::Intersect(dirtyRects[i], view);
+			bytes += rect.width * rect.height * 4;
+		}
+	}
+
+	//Never wait for the writer.  Dropping a paint only costs a keyframe later.
+	{
+		sf::Lock lock(mMutex);
+		if (!mJobs.empty() && mQueuedBytes + bytes > PAINT_RECORDER_MAX_QUEUED)
+		{
+			mDropped++;
+			mNeedFull = true;
+			return;
+		}
+	}
+
+	Job* job = new Job();
+	job->time = mClock.getElapsedTime().asMicroseconds();
+	job->width = width;
+	job->height = height;
+	job->full = full;
+	job->pixels.resize(bytes);
+
+	const sf::Uint8* src = (const sf::Uint8*)buffer;
+	if (full)
+		memcpy(&job->pixels[0], src, bytes);
+
+	size_t offset = 0;
+	for (unsigned int i = 0; i < dirtyRects.size(); i++)
+	{
+		CefRect rect = DamageRegion::Intersect(dirtyRects[i], view);
+		if (rect.IsEmpty())
+			continue;
+
+		job->rects.push_back(rect);
+		if (full)
+			continue;
+
+		for (int y = 0; y < rect.height; y++)
+		{
+			memcpy(&job->pixels[offset], src + ((rect.y + y) * width + rect.x) * 4, rect.width * 4);
+			offset += rect.width * 4;
+		}
+	}
+
+	mLastWidth = width;
+	mLastHeight = height;
+	mNeedFull = false;
+
+	{
+		sf::Lock lock(mMutex);
+		mJobs.push(job);
+		mQueuedBytes += bytes;
+	}
+
+	SetEvent(mWakeEvent);
+}
+
+////////////////////////////////////////////////////////////
+void PaintRecorder::WriterThread()
+{
+	while (true)
+	{
+		Job* job = NULL;
+		{
+			sf::Lock lock(mMutex);
+			if (!mJobs.empty())
+			{
+				job = mJobs.front();
+				mJobs.pop();
+				mQueuedBytes -= job->pixels.size();
+			}
+		}
+
+		if (!job)
+		{
+			//Only stop once everything queued before Stop() has been written.
+			if (mStopping)
+				break;
+
+			//A job queued since we looked has already set the event, so this does not miss it.
+			WaitForSingleObject(mWakeEvent, INFINITE);
+			continue;
+		}
+
+		WriteJob(*job);
+		delete job;
+	}
+
+	mFile.flush();
+}
+
+////////////////////////////////////////////////////////////
+void PaintRecorder::WriteJob(const Job& job)
+{
+	size_t frameBytes = job.width * job.height * 4;
+	bool keyframe = job.full || mSinceKeyframe + 1 >= mKeyframeInterval ||
+		job.width != mPreviousWidth || job.height != mPreviousHeight;
+
+	mRecord.clear();
+	Put32(mRecord, keyframe ? PaintFormat::FLAG_KEYFRAME : 0);
+	Put32(mRecord, (sf::Uint32)job.width);
+	Put32(mRecord, (sf::Uint32)job.height);
+	Put64(mRecord, job.time);
+	Put32(mRecord, (sf::Uint32)job.rects.size());
+	Put32(mRecord, keyframe ? 1 : (sf::Uint32)job.rects.size());
+	size_t sizeAt = mRecord.size();
+	Put32(mRecord, 0);
+
+	for (unsigned int i = 0; i < job.rects.size(); i++)
+		PutRect(mRecord, job.rects[i]);
+
+	if (job.full)
+	{
+		mPrevious.assign(job.pixels.begin(), job.pixels.end());
+		mPreviousWidth = job.width;
+		mPreviousHeight = job.height;
+	}
+
+	//A keyframe only needs the view after the paint, so bring our copy up to date and write that.
+	size_t offset = 0;
+	for (unsigned int i = 0; i < job.rects.size() && !job.full; i++)
+	{
+		const CefRect& rect = job.rects[i];
+		const sf::Uint8* pixels = &job.pixels[offset];
+
+		if (!keyframe)
+			WriteBlock(rect, pixels, mCompress);
+
+		for (int y = 0; y < rect.height; y++)
+			memcpy(&mPrevious[((rect.y + y) * job.width + rect.x) * 4], pixels + y * rect.width * 4, rect.width * 4);
+
+		offset += rect.width * rect.height * 4;
+	}
+
+	if (keyframe && frameBytes > 0)
+	{
+		WriteBlock(CefRect(0, 0, job.width, job.height), &mPrevious[0], false);
+		mSinceKeyframe = 0;
+	}
+	else
+	{
+		mSinceKeyframe++;
+	}
+
+	Patch32(mRecord, sizeAt, (sf::Uint32)(mRecord.size() - sRecordHeaderSize));
+	mFile.write((const char*)&mRecord[0], mRecord.size());
+}
+
+////////////////////////////////////////////////////////////
+void PaintRecorder::WriteBlock(const CefRect& rect, const sf::Uint8* pixels, bool delta)
+{
+	int count = rect.width * rect.height;
+	size_t raw = count * 4;
+
+	PaintFormat::Encoding encoding = PaintFormat::ENCODING_RAW;
+	mEncoded.clear();
+
+	if (mCompress && count > 0)
+	{
+		const sf::Uint32* source = (const sf::Uint32*)pixels;
+
+		//Unchanged pixels xor to zero, which run length encodes to almost nothing.
+		if (delta)
+		{
+			mDelta.resize(count);
+			for (int y = 0; y < rect.height; y++)
+			{
+				const sf::Uint32* previous = (const sf::Uint32*)&mPrevious[((rect.y + y) * mPreviousWidth + rect.x) * 4];
+				const sf::Uint32* current = source + y * rect.width;
+				sf::Uint32* out = &mDelta[y * rect.width];
+				for (int x = 0; x < rect.width; x++)
+					out[x] = current[x] ^ previous[x];
+			}
+			source = &mDelta[0];
+		}
+
+		PaintFormat::EncodeRLE(source, count, mEncoded);
+		if (mEncoded.size() < raw)
+			encoding = delta ? PaintFormat::ENCODING_DELTA : PaintFormat::ENCODING_RLE;
+	}
+
+	PutRect(mRecord, rect);
+	Put32(mRecord, encoding);
+
+	if (encoding == PaintFormat::ENCODING_RAW)
+	{
+		Put32(mRecord, (sf::Uint32)raw);
+		mRecord.insert(mRecord.end(), pixels, pixels + raw);
+	}
+	else
+	{
+		Put32(mRecord, (sf::Uint32)mEncoded.size());
+		mRecord.insert(mRecord.end(), mEncoded.begin(), mEncoded.end());
+	}
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+//Paint Reader Methods
+//--------------------------------------------------------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////
+PaintReader::PaintReader()
+: mCurrent(-1)
+, mWidth(0)
+, mHeight(0)
+{
+
+}
+
+////////////////////////////////////////////////////////////
+bool PaintReader::Open(const std::string& path)
+{
+	Close();
+
+	mFile.open(path.c_str(), std::ios::in | std::ios::binary);
+	if (!mFile)
+		return false;
+
+	sf::Uint8 header[8];
+	if (!mFile.read((char*)header, 8) || memcmp(header, sMagic, 4) != 0 || Get32(header + 4) != PaintFormat::VERSION)
+	{
+		Close();
+		return false;
+	}
+
+	mFile.seekg(0, std::ios::end);
+	std::streamoff length = mFile.tellg();
+	std::streamoff offset = 8;
+
+	//Only the record headers are read here, the pixels are read when a paint is asked for.
+	sf::Uint8 record[sRecordHeaderSize];
+	while (offset + (std::streamoff)sRecordHeaderSize <= length)
+	{
+		mFile.seekg(offset);
+		if (!mFile.read((char*)record, sRecordHeaderSize))
+			break;
+
+		//A record cut short by a crash is left out.
+		std::streamoff next = offset + (std::streamoff)sRecordHeaderSize + Get32(record + 28);
+		if (next > length)
+			break;
+
+		Entry entry;
+		entry.offset = offset;
+		entry.keyframe = (Get32(record) & PaintFormat::FLAG_KEYFRAME) != 0;
+		entry.time = Get64(record + 12);
+		mIndex.push_back(entry);
+
+		offset = next;
+	}
+
+	mFile.clear();
+	return true;
+}
+
+////////////////////////////////////////////////////////////
+void PaintReader::Close()
+{
+	if (mFile.is_open())
+		mFile.close();
+	mFile.clear();
+
+	mIndex.clear();
+	mCurrent = -1;
+	mFrame.clear();
+	mWidth = 0;
+	mHeight = 0;
+	mRects.clear();
+}
+
+////////////////////////////////////////////////////////////
+bool PaintReader::ReadPaint(int paint)
+{
+	if (paint < 0 || paint >= (int)mIndex.size())
+		return false;
+
+	if (paint == mCurrent)
+		return true;
+
+	int keyframe = paint;
+	while (keyframe >= 0 && !mIndex[keyframe].keyframe)
+		keyframe--;
+	if (keyframe < 0)
+		return false;
+
+	//Carry on from where we are if that is past the keyframe, otherwise start at it.
+	int start = keyframe;
+	if (mCurrent >= keyframe && mCurrent < paint)
+		start = mCurrent + 1;
+
+	for (int p = start; p <= paint; p++)
+	{
+		if (!Decode(p))
+		{
+			mCurrent = -1;
+			return false;
+		}
+		mCurrent = p;
+	}
+
+	return true;
+}
+
+////////////////////////////////////////////////////////////
+bool PaintReader::Decode(int paint)
+{
+	sf::Uint8 header[sRecordHeaderSize];
+	mFile.clear();
+	mFile.seekg(mIndex[paint].offset);
+	if (!mFile.read((char*)header, sRecordHeaderSize))
+		return false;
+
+	bool keyframe = (Get32(header) & PaintFormat::FLAG_KEYFRAME) != 0;
+	int width = (int)Get32(header + 4);
+	int height = (int)Get32(header + 8);
+	sf::Uint32 rectCount = Get32(header + 20);
+	sf::Uint32 blockCount = Get32(header + 24);
+	sf::Uint32 size = Get32(header + 28);
+
+	mRecord.resize(size);
+	if (size > 0 && !mFile.read((char*)&mRecord[0], size))
+		return false;
+
+	if (keyframe)
+	{
+		mWidth = width;
+		mHeight = height;
+		mFrame.assign(width * height * 4, 0);
+	}
+	else if (width != mWidth || height != mHeight)
+	{
+		return false;
+	}
+
+	const sf::Uint8* p = mRecord.empty() ? NULL : &mRecord[0];
+	const sf::Uint8* end = p + mRecord.size();
+	if ((size_t)(end - p) < rectCount * 16)
+		return false;
+
+	mRects.clear();
+	for (sf::Uint32 r = 0; r < rectCount; r++, p += 16)
+		mRects.push_back(CefRect((int)Get32(p), (int)Get32(p + 4), (int)Get32(p + 8), (int)Get32(p + 12)));
+
+	CefRect view(0, 0, mWidth, mHeight);
+	for (sf::Uint32 b = 0; b < blockCount; b++)
+	{
+		if (end - p < 24)
+			return false;
+
+		CefRect rect((int)Get32(p), (int)Get32(p + 4), (int)Get32(p + 8), (int)Get32(p + 12));
+		sf::Uint32 encoding = Get32(p + 16);
+		sf::Uint32 bytes = Get32(p + 20);
+		p += 24;
+
+		if ((sf::Uint32)(end - p) < bytes || !DamageRegion::Contains(view, rect) || rect.width < 0 || rect.height < 0)
+			return false;
+
+		int count = rect.width * rect.height;
+		const sf::Uint32* pixels = (const sf::Uint32*)p;
+		if (encoding != PaintFormat::ENCODING_RAW)
+		{
+			mBlock.resize(count > 0 ? count : 1);
+			if (!PaintFormat::DecodeRLE(p, bytes, &mBlock[0], count))
+				return false;
+			pixels = &mBlock[0];
+		}
+		else if (bytes != (sf::Uint32)count * 4)
+		{
+			return false;
+		}
+
+		for (int y = 0; y < rect.height; y++)
+		{
+			sf::Uint32* row = (sf::Uint32*)&mFrame[((rect.y + y) * mWidth + rect.x) * 4];
+			const sf::Uint32* src = pixels + y * rect.width;
+
+			if (encoding == PaintFormat::ENCODING_DELTA)
+			{
+				for (int x = 0; x < rect.width; x++)
+					row[x] ^= src[x];
+			}
+			else
+			{
+				memcpy(row, src, rect.width * 4);
+			}
+		}
+
+		p += bytes;
+	}
+
+	return true;
+}
@@ -0,0 +1,408 @@
+#pragma once
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include <include/cef_render_handler.h>
+#include <SFML\System.hpp>
+#include <fstream>
+#include <queue>
+#include <string>
+#include <vector>
+
+////////////////////////////////////////////////////////////
+// Pre-processor Definitions
+////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////
+// Default number of paints between keyframes.  Seeking has
+// to decode at most this many paints from the keyframe before.
+//
+////////////////////////////////////////////////////////////
+#ifndef PAINT_RECORDER_KEYFRAME_INTERVAL
+#define PAINT_RECORDER_KEYFRAME_INTERVAL 120
+#endif
+
+////////////////////////////////////////////////////////////
+// Bytes of paints a PaintRecorder queues for its writer thread
+// before it starts dropping them.  A dropped paint makes the
+// next one a keyframe, so the recording stays decodable.
+//
+////////////////////////////////////////////////////////////
+#ifndef PAINT_RECORDER_MAX_QUEUED
+#define PAINT_RECORDER_MAX_QUEUED (64 * 1024 * 1024)
+#endif
+
+////////////////////////////////////////////////////////////
+/// \brief Layout of the files written by PaintRecorder and read by PaintReader.
+///
+/// A file is the magic "WSPR" and a version, followed by one record per paint:
+///
+///	flags, width, height, time, dirty rect count, block count, size of the rest of the record
+///	the dirty rects, as x, y, width, height
+///	the blocks, each as x, y, width, height, encoding, size, data
+///
+/// Times are microseconds since recording started.  Pixels are BGRA, as cef paints them.
+/// A keyframe has a single block holding the whole view after its paint.  Any other
+/// record has a block per dirty rect, which may be encoded against the frame before it.
+/// All values are 32 bit little endian, except the time which is 64 bit.
+///
+////////////////////////////////////////////////////////////
+namespace PaintFormat
+{
+	////////////////////////////////////////////////////////////
+	/// \brief Version written after the magic.
+	///
+	////////////////////////////////////////////////////////////
+	static const sf::Uint32 VERSION = 1;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Record flags.
+	///
+	////////////////////////////////////////////////////////////
+	enum Flags
+	{
+		FLAG_KEYFRAME = 1	///< The record can be decoded without the ones before it.
+	};
+
+	////////////////////////////////////////////////////////////
+	/// \brief Ways a block's pixels can be stored.
+	///
+	////////////////////////////////////////////////////////////
+	enum Encoding
+	{
+		ENCODING_RAW,	///< Tightly packed pixels.
+		ENCODING_RLE,	///< Run length encoded pixels.
+		ENCODING_DELTA	///< Run length encoded xor of the pixels with the previous frame.
+	};
+
+	////////////////////////////////////////////////////////////
+	/// \brief Run length encodes pixels.
+	///
+	/// Packets are a 16 bit count followed by either one pixel repeated count & 0x7FFF
+	/// times, when the top bit is set, or count literal pixels.
+	///
+	/// \param pixels	Pixels to encode.
+	/// \param count	Number of pixels.
+	/// \param out		Receives the encoded bytes, appended.
+	///
+	////////////////////////////////////////////////////////////
+	void EncodeRLE(const sf::Uint32* pixels, int count, std::vector<sf::Uint8>& out);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Decodes pixels encoded by EncodeRLE().
+	///
+	/// \param data		Encoded bytes.
+	/// \param size		Number of encoded bytes.
+	/// \param pixels	Receives the pixels.
+	/// \param count	Number of pixels expected.
+	///
+	/// \return False if the data is corrupt or does not hold exactly count pixels.
+	///
+	////////////////////////////////////////////////////////////
+	bool DecodeRLE(const sf::Uint8* data, size_t size, sf::Uint32* pixels, int count);
+}
+
+////////////////////////////////////////////////////////////
+/// \brief Records the paints of a view to a file, for QA and reproducing bugs.
+///
+/// Record() only copies the dirty rects and queues them, so the thread painting never waits
+/// on the disk.  A writer thread encodes them against its own copy of the previous frame and
+/// writes them out.  Every so often, and whenever the view changes size, a keyframe holding
+/// the whole view is written so that PaintReader can seek without decoding from the start.
+///
+/// If the writer falls too far behind, paints are dropped rather than queued, and the next
+/// one recorded becomes a keyframe.
+///
+////////////////////////////////////////////////////////////
+class PaintRecorder
+{
+public:
+	PaintRecorder();
+	~PaintRecorder();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Opens the file and starts the writer thread.
+	///
+	/// \param path		File to record to.  It is overwritten.
+	///
+	/// \return False if the file could not be opened.
+	///
+	////////////////////////////////////////////////////////////
+	bool Start(const std::string& path);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Writes out every queued paint, then stops the writer thread and closes the file.
+	///
+	////////////////////////////////////////////////////////////
+	void Stop();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns whether a recording is in progress.
+	///
+	////////////////////////////////////////////////////////////
+	bool IsRecording() { return mpThread != NULL; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Queues a paint to be written.  Can be called from any one thread at a time.
+	///
+	/// \param buffer		The full view buffer handed to OnPaint.
+	/// \param width		Width of the view.
+	/// \param height		Height of the view.
+	/// \param dirtyRects	Rects which changed in this paint.
+	///
+	////////////////////////////////////////////////////////////
+	void Record(const void* buffer, int width, int height, const CefRenderHandler::RectList& dirtyRects);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Sets whether blocks are run length and delta encoded, or stored raw.
+	///
+	/// \param compress		True to compress, the default.
+	///
+	////////////////////////////////////////////////////////////
+	void SetCompression(bool compress) { mCompress = compress; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Sets the number of paints between keyframes.
+	///
+	/// \param interval		Paints between keyframes, at least 1.
+	///
+	////////////////////////////////////////////////////////////
+	void SetKeyframeInterval(int interval) { mKeyframeInterval = interval < 1 ? 1 : interval; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the number of paints dropped because the writer fell behind.
+	///
+	////////////////////////////////////////////////////////////
+	unsigned int GetDroppedCount() { return mDropped; }
+
+private:
+	////////////////////////////////////////////////////////////
+	/// \brief A paint waiting for the writer thread.
+	///
+	////////////////////////////////////////////////////////////
+	struct Job
+	{
+	public:
+		sf::Int64 time;
+		int width;
+		int height;
+
+		////////////////////////////////////////////////////////////
+		/// \brief The dirty rects, and the rects pixels holds.  Those are the
+		/// same unless full is set, in which case pixels holds the whole view.
+		///
+		////////////////////////////////////////////////////////////
+		std::vector<CefRect> rects;
+		bool full;
+		std::vector<sf::Uint8> pixels;
+	};
+
+	////////////////////////////////////////////////////////////
+	/// \brief Runs the writer thread until Stop().
+	///
+	////////////////////////////////////////////////////////////
+	void WriterThread();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Encodes and writes one paint.  Writer thread only.
+	///
+	////////////////////////////////////////////////////////////
+	void WriteJob(const Job& job);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Appends one block to mRecord.  Writer thread only.
+	///
+	/// \param rect		Where the block goes in the view.
+	/// \param pixels	Tightly packed pixels of the block.
+	/// \param delta	True to encode against mPrevious.
+	///
+	////////////////////////////////////////////////////////////
+	void WriteBlock(const CefRect& rect, const sf::Uint8* pixels, bool delta);
+
+	////////////////////////////////////////////////////////////
+	/// \brief The file, only touched by the writer thread while it runs.
+	///
+	////////////////////////////////////////////////////////////
+	std::ofstream mFile;
+
+	////////////////////////////////////////////////////////////
+	/// \brief The writer thread, NULL when not recording.
+	///
+	////////////////////////////////////////////////////////////
+	sf::Thread* mpThread;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Tells the writer thread to finish the queue and end.
+	///
+	////////////////////////////////////////////////////////////
+	volatile bool mStopping;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Auto reset event set when a job is queued or the recording stops.
+	///
+	/// The writer thread sleeps on it while the queue is empty.  Exists while recording.
+	///
+	////////////////////////////////////////////////////////////
+	HANDLE mWakeEvent;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Paints waiting for the writer, and the bytes of pixels they hold.  Guarded by mMutex.
+	///
+	////////////////////////////////////////////////////////////
+	std::queue<Job*> mJobs;
+	size_t mQueuedBytes;
+	sf::Mutex mMutex;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Time since Start().
+	///
+	////////////////////////////////////////////////////////////
+	sf::Clock mClock;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Recording side.  Size of the last paint queued, and whether the next has to
+	/// carry the whole view because the one before was dropped.
+	///
+	////////////////////////////////////////////////////////////
+	int mLastWidth;
+	int mLastHeight;
+	bool mNeedFull;
+	volatile unsigned int mDropped;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Writer side.  The view as of the last paint written, what deltas are against.
+	///
+	////////////////////////////////////////////////////////////
+	std::vector<sf::Uint8> mPrevious;
+	int mPreviousWidth;
+	int mPreviousHeight;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Writer side.  Paints written since the last keyframe.
+	///
+	////////////////////////////////////////////////////////////
+	int mSinceKeyframe;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Writer side.  The record being built, and scratch space for encoding.
+	///
+	////////////////////////////////////////////////////////////
+	std::vector<sf::Uint8> mRecord;
+	std::vector<sf::Uint8> mEncoded;
+	std::vector<sf::Uint32> mDelta;
+
+	bool mCompress;
+	int mKeyframeInterval;
+};
+
+////////////////////////////////////////////////////////////
+/// \brief Reads files written by PaintRecorder, rebuilding the full view after any paint.
+///
+/// Reading paints in order decodes each once.  Jumping elsewhere decodes forward from the
+/// nearest keyframe before the paint.
+///
+////////////////////////////////////////////////////////////
+class PaintReader
+{
+public:
+	PaintReader();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Opens a recording and indexes its paints.
+	///
+	/// \param path		File written by PaintRecorder.
+	///
+	/// \return False if the file could not be opened or is not a recording.
+	///
+	////////////////////////////////////////////////////////////
+	bool Open(const std::string& path);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Closes the recording.
+	///
+	////////////////////////////////////////////////////////////
+	void Close();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the number of paints in the recording.
+	///
+	////////////////////////////////////////////////////////////
+	int GetPaintCount() { return (int)mIndex.size(); }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns when a paint happened, in microseconds since recording started.
+	///
+	/// \param paint	Index of the paint.
+	///
+	////////////////////////////////////////////////////////////
+	sf::Int64 GetPaintTime(int paint) { return mIndex[paint].time; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Rebuilds the view as it was after a paint.
+	///
+	/// \param paint	Index of the paint.
+	///
+	/// \return False if the paint is out of range or the file is corrupt.
+	///
+	////////////////////////////////////////////////////////////
+	bool ReadPaint(int paint);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the BGRA pixels of the view after the paint last read.
+	///
+	////////////////////////////////////////////////////////////
+	const sf::Uint8* GetFrame() { return mFrame.empty() ? NULL : &mFrame[0]; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the size of the view after the paint last read.
+	///
+	////////////////////////////////////////////////////////////
+	int GetWidth() { return mWidth; }
+	int GetHeight() { return mHeight; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the dirty rects of the paint last read.
+	///
+	////////////////////////////////////////////////////////////
+	const CefRenderHandler::RectList& GetRects() { return mRects; }
+
+private:
+	////////////////////////////////////////////////////////////
+	/// \brief Where a paint's record is.
+	///
+	////////////////////////////////////////////////////////////
+	struct Entry
+	{
+	public:
+		std::streamoff offset;
+		sf::Int64 time;
+		bool keyframe;
+	};
+
+	////////////////////////////////////////////////////////////
+	/// \brief Decodes the record of one paint on top of mFrame.
+	///
+	////////////////////////////////////////////////////////////
+	bool Decode(int paint);
+
+	std::ifstream mFile;
+	std::vector<Entry> mIndex;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Index of the paint mFrame is the result of, -1 if none.
+	///
+	////////////////////////////////////////////////////////////
+	int mCurrent;
+
+	std::vector<sf::Uint8> mFrame;
+	int mWidth;
+	int mHeight;
+	CefRenderHandler::RectList mRects;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Scratch space for a record and a decoded block.
+	///
+	////////////////////////////////////////////////////////////
+	std::vector<sf::Uint8> mRecord;
+	std::vector<sf::Uint32> mBlock;
+};
@@ -0,0 +1,255 @@
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include "PaintReplay.h"
+#include "WebSystem.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <new>
+
+////////////////////////////////////////////////////////////
+// Static variables
+////////////////////////////////////////////////////////////
+#if PAINT_REPLAY_COUNT_ALLOCATIONS
+static volatile long sAllocations = 0;
+
+//Count every allocation of the program.  Only the difference over a paint is looked at,
+//and with no browsers running nothing else allocates while a replay runs.
+////////////////////////////////////////////////////////////
+void* operator new(size_t size)
+{
+	InterlockedIncrement(&sAllocations);
+
+	void* p = malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+////////////////////////////////////////////////////////////
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+////////////////////////////////////////////////////////////
+void operator delete(void* p)
+{
+	free(p);
+}
+
+////////////////////////////////////////////////////////////
+void operator delete[](void* p)
+{
+	free(p);
+}
+#endif
+
+//--------------------------------------------------------------------------------------------------------------------------
+//Paint Replay Methods
+//--------------------------------------------------------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////
+PaintReplay::PaintReplay()
+: mUseReader(false)
+, mSyntheticPaints(0)
+, mSeed(1)
+, mRealTime(false)
+, mpBuffer(NULL)
+, mWidth(0)
+, mHeight(0)
+, mTime(0)
+{
+
+}
+
+////////////////////////////////////////////////////////////
+bool PaintReplay::OpenRecording(const std::string& path)
+{
+	mSynthetic.clear();
+	mSyntheticPaints = 0;
+
+	mUseReader = mReader.Open(path);
+	return mUseReader;
+}
+
+////////////////////////////////////////////////////////////
+void PaintReplay::UseSynthetic(int width, int height, int paints)
+{
+	mReader.Close();
+	mUseReader = false;
+
+	mWidth = width;
+	mHeight = height;
+	mSyntheticPaints = paints;
+	mSeed = 1;
+
+	//Start from a page of horizontal bands, so scrolling moves something.
+	mSynthetic.resize(width * height);
+	for (int y = 0; y < height; y++)
+	{
+		sf::Uint32 color = (y / 20) % 2 ? 0xFFF0F0F0 : 0xFFFFFFFF;
+		std::fill(mSynthetic.begin() + y * width, mSynthetic.begin() + (y + 1) * width, color);
+	}
+}
+
+////////////////////////////////////////////////////////////
+bool PaintReplay::Run(WebInterface* pWeb, Stats& stats)
+{
+	stats.paints = 0;
+	stats.rects = 0;
+	stats.bytes = 0.0;
+	stats.seconds = 0.0;
+	stats.meanLatency = 0.0f;
+	stats.medianLatency = 0.0f;
+	stats.p99Latency = 0.0f;
+	stats.maxLatency = 0.0f;
+	stats.allocations = 0;
+
+	int count = mUseReader ? mReader.GetPaintCount() : mSyntheticPaints;
+	if (count <= 0)
+		return false;
+
+	std::vector<float> latencies;
+	latencies.reserve(count);
+
+	bool result = true;
+	sf::Clock wallClock;
+	for (int i = 0; i < count; i++)
+	{
+		if (!PreparePaint(i))
+		{
+			result = false;
+			break;
+		}
+
+		//Paints of another size are dropped by the WebInterface, as they are when cef is resizing.
+		if (pWeb->GetWidth() != mWidth || pWeb->GetHeight() != mHeight)
+			pWeb->SetSize(mWidth, mHeight);
+
+		if (mRealTime)
+		{
+			sf::Int64 wait = mTime - wallClock.getElapsedTime().asMicroseconds();
+			if (wait > 0)
+				sf::sleep(sf::microseconds(wait));
+		}
+
+		unsigned int allocations = GetAllocationCount();
+		sf::Clock paintClock;
+
+		pWeb->Paint(mRects, mpBuffer, mWidth, mHeight);
+		pWeb->UpdateTexture();
+
+		sf::Int64 elapsed = paintClock.getElapsedTime().asMicroseconds();
+		stats.allocations += GetAllocationCount() - allocations;
+
+		latencies.push_back(elapsed / 1000.0f);
+		stats.seconds += elapsed / 1000000.0;
+		stats.paints++;
+		stats.rects += mRects.size();
+		for (unsigned int r = 0; r < mRects.size(); r++)
+			stats.bytes += (double)mRects[r].width * mRects[r].height * 4;
+	}
+
+	if (latencies.empty())
+		return false;
+
+	double total = 0.0;
+	for (unsigned int i = 0; i < latencies.size(); i++)
+		total += latencies[i];
+	stats.meanLatency = (float)(total / latencies.size());
+
+	std::sort(latencies.begin(), latencies.end());
+	stats.medianLatency = latencies[latencies.size() / 2];
+	stats.p99Latency = latencies[(latencies.size() * 99) / 100];
+	stats.maxLatency = latencies.back();
+
+	return result;
+}
+
+////////////////////////////////////////////////////////////
+void PaintReplay::PrintStats(const Stats& stats)
+{
+	double seconds = stats.seconds > 0.0 ? stats.seconds : 0.000001;
+
+	printf("Paints:       %u (%u rects)\n", stats.paints, stats.rects);
+	printf("Throughput:   %.0f paints/s, %.1f MB/s\n", stats.paints / seconds, stats.bytes / (1024.0 * 1024.0) / seconds);
+	printf("Latency (ms): mean %.3f, p50 %.3f, p99 %.3f, max %.3f\n", stats.meanLatency, stats.medianLatency, stats.p99Latency, stats.maxLatency);
+#if PAINT_REPLAY_COUNT_ALLOCATIONS
+	printf("Allocations:  %u (%.2f per paint)\n", stats.allocations, stats.paints ? (double)stats.allocations / stats.paints : 0.0);
+#else
+	printf("Allocations:  not counted, PAINT_REPLAY_COUNT_ALLOCATIONS is 0\n");
+#endif
+}
+
+////////////////////////////////////////////////////////////
+unsigned int PaintReplay::GetAllocationCount()
+{
+#if PAINT_REPLAY_COUNT_ALLOCATIONS
+	return (unsigned int)sAllocations;
+#else
+	return 0;
+#endif
+}
+
+////////////////////////////////////////////////////////////
+bool PaintReplay::PreparePaint(int paint)
+{
+	if (mUseReader)
+	{
+		if (!mReader.ReadPaint(paint))
+			return false;
+
+		mRects = mReader.GetRects();
+		mpBuffer = mReader.GetFrame();
+		mWidth = mReader.GetWidth();
+		mHeight = mReader.GetHeight();
+		mTime = mReader.GetPaintTime(paint);
+		return mpBuffer != NULL;
+	}
+
+	Synthesize(paint);
+	mpBuffer = &mSynthetic[0];
+	mTime = (sf::Int64)paint * 1000000 / 60;
+	return true;
+}
+
+////////////////////////////////////////////////////////////
+void PaintReplay::Synthesize(int paint)
+{
+	mRects.clear();
+
+	//A small spinner in the corner, changing every paint.
+	int size = 32 < mWidth && 32 < mHeight ? 32 : 1;
+	CefRect spinner(mWidth - size, 0, size, size);
+	sf::Uint32 color = 0xFF000000 | (paint * 0x00050A0F);
+	for (int y = spinner.y; y < spinner.y + spinner.height; y++)
+		std::fill(mSynthetic.begin() + y * mWidth + spinner.x, mSynthetic.begin() + y * mWidth + spinner.x + spinner.width, color);
+	mRects.push_back(spinner);
+
+	//A line of text somewhere every few paints.
+	if (paint % 4 == 0)
+	{
+		mSeed = mSeed * 1103515245 + 12345;
+		CefRect line(0, (int)((mSeed >> 8) % mHeight), mWidth / 2, 16);
+		if (line.y + line.height > mHeight)
+			line.height = mHeight - line.y;
+
+		for (int y = line.y; y < line.y + line.height; y++)
+		{
+			for (int x = line.x; x < line.x + line.width; x++)
+				mSynthetic[y * mWidth + x] = (x / 6 + y + paint) % 3 ? 0xFFFFFFFF : 0xFF202020;
+		}
+		mRects.push_back(line);
+	}
+
+	//Scroll the whole view every second.
+	if (paint % 60 == 59)
+	{
+		int offset = 40 < mHeight ? 40 : 0;
+		std::rotate(mSynthetic.begin(), mSynthetic.begin() + offset * mWidth, mSynthetic.end());
+		mRects.clear();
+		mRects.push_back(CefRect(0, 0, mWidth, mHeight));
+	}
+}
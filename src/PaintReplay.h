@@ -0,0 +1,176 @@
+#pragma once
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include <include/cef_render_handler.h>
+#include <SFML\System.hpp>
+#include <string>
+#include <vector>
+#include "PaintRecorder.h"
+
+////////////////////////////////////////////////////////////
+// Pre-processor Definitions
+////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////
+// Count heap allocations made while replaying, by replacing
+// the global operator new of the whole program.  Only define
+// it as 1 in a benchmark harness such as test_base, never in
+// a program with its own operator new.
+//
+////////////////////////////////////////////////////////////
+#ifndef PAINT_REPLAY_COUNT_ALLOCATIONS
+#define PAINT_REPLAY_COUNT_ALLOCATIONS 0
+#endif
+
+class WebInterface;
+
+////////////////////////////////////////////////////////////
+/// \brief Feeds recorded or synthetic paints through a WebInterface, to measure the paint pipeline.
+///
+/// Each paint goes through WebInterface::Paint() and WebInterface::UpdateTexture(), the same
+/// code cef drives, but without cef, so runs are quick and repeat exactly.  Paints are fed
+/// as fast as possible, or spaced out as they were recorded.
+///
+/// Only the time spent in the WebInterface is measured.  Decoding the recording and
+/// generating synthetic paints happen between measurements.
+///
+////////////////////////////////////////////////////////////
+class PaintReplay
+{
+public:
+	////////////////////////////////////////////////////////////
+	/// \brief Results of a run.
+	///
+	////////////////////////////////////////////////////////////
+	struct Stats
+	{
+	public:
+		unsigned int paints;
+		unsigned int rects;
+
+		////////////////////////////////////////////////////////////
+		/// \brief Dirty pixels fed in, in bytes.
+		///
+		////////////////////////////////////////////////////////////
+		double bytes;
+
+		////////////////////////////////////////////////////////////
+		/// \brief Time spent painting and uploading, in seconds.
+		///
+		////////////////////////////////////////////////////////////
+		double seconds;
+
+		////////////////////////////////////////////////////////////
+		/// \brief Time from handing a paint over to it being on the texture, in milliseconds.
+		///
+		////////////////////////////////////////////////////////////
+		float meanLatency;
+		float medianLatency;
+		float p99Latency;
+		float maxLatency;
+
+		////////////////////////////////////////////////////////////
+		/// \brief Heap allocations made while painting and uploading.
+		///
+		////////////////////////////////////////////////////////////
+		unsigned int allocations;
+	};
+
+	PaintReplay();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Replays a file written by PaintRecorder.
+	///
+	/// \param path		The recording.
+	///
+	/// \return False if the recording could not be opened.
+	///
+	////////////////////////////////////////////////////////////
+	bool OpenRecording(const std::string& path);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Replays generated paints: a small animation every frame, a line of text
+	/// every few frames, and a scroll of the whole view every second.
+	///
+	/// \param width	Width of the view.
+	/// \param height	Height of the view.
+	/// \param paints	Number of paints, one every 60th of a second.
+	///
+	////////////////////////////////////////////////////////////
+	void UseSynthetic(int width, int height, int paints);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Sets whether paints are spaced out as they were recorded.
+	///
+	/// \param realTime		True to keep the recorded timing, false to go as fast as possible.
+	///
+	////////////////////////////////////////////////////////////
+	void SetRealTime(bool realTime) { mRealTime = realTime; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Feeds every paint through a WebInterface.
+	///
+	/// The WebInterface is resized to match the paints.  Its texture must be usable on the
+	/// calling thread, so an OpenGL context is needed unless it is headless.
+	///
+	/// \param pWeb		WebInterface to feed, normally one with no browser.
+	/// \param stats	Receives the results.
+	///
+	/// \return False if there was nothing to replay or the recording is corrupt.
+	///
+	////////////////////////////////////////////////////////////
+	bool Run(WebInterface* pWeb, Stats& stats);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Prints the results of a run to stdout.
+	///
+	////////////////////////////////////////////////////////////
+	static void PrintStats(const Stats& stats);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the number of heap allocations made so far by the whole program.
+	///
+	/// \return The count, always 0 if PAINT_REPLAY_COUNT_ALLOCATIONS is 0.
+	///
+	////////////////////////////////////////////////////////////
+	static unsigned int GetAllocationCount();
+
+private:
+	////////////////////////////////////////////////////////////
+	/// \brief Sets up mRects, mpBuffer, mWidth, mHeight and mTime for a paint.
+	///
+	/// \return False if the paint could not be read.
+	///
+	////////////////////////////////////////////////////////////
+	bool PreparePaint(int paint);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Draws the changes of a synthetic paint into mSynthetic.
+	///
+	////////////////////////////////////////////////////////////
+	void Synthesize(int paint);
+
+	PaintReader mReader;
+	bool mUseReader;
+
+	////////////////////////////////////////////////////////////
+	/// \brief The synthetic view, and how many paints to make of it.
+	///
+	////////////////////////////////////////////////////////////
+	std::vector<sf::Uint32> mSynthetic;
+	int mSyntheticPaints;
+	sf::Uint32 mSeed;
+
+	bool mRealTime;
+
+	////////////////////////////////////////////////////////////
+	/// \brief The paint being fed.
+	///
+	////////////////////////////////////////////////////////////
+	CefRenderHandler::RectList mRects;
+	const void* mpBuffer;
+	int mWidth;
+	int mHeight;
+	sf::Int64 mTime;
+};
@@ -0,0 +1,530 @@
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include "PixelConverter.h"
+#include <SFML\System\Clock.hpp>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#ifdef PIXEL_CONVERTER_X86
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#ifdef PIXEL_CONVERTER_AVX2
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+////////////////////////////////////////////////////////////
+// gcc needs to be told which instruction sets a function may use,
+// msvc lets any function use any intrinsic.
+#if defined(__GNUC__) && !defined(_MSC_VER)
+#define PIXEL_CONVERTER_TARGET(isa) __attribute__((target(isa)))
+#else
+#define PIXEL_CONVERTER_TARGET(isa)
+#endif
+
+////////////////////////////////////////////////////////////
+// Static variables
+////////////////////////////////////////////////////////////
+PixelConverter::Kernel PixelConverter::sKernel = PixelConverter::KERNEL_COUNT;
+
+//--------------------------------------------------------------------------------------------------------------------------
+//Row Kernels
+//--------------------------------------------------------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////
+//Swaps the red and blue channels of a single pixel.
+static inline sf::Uint32 SwizzlePixel(sf::Uint32 p)
+{
+	return (p & 0xFF00FF00) | ((p & 0x00FF0000) >> 16) | ((p & 0x000000FF) << 16);
+}
+
+////////////////////////////////////////////////////////////
+static void RowScalar(sf::Uint32* dst, const sf::Uint32* src, int count)
+{
+	for (int i = 0; i < count; i++)
+		dst[i] = SwizzlePixel(src[i]);
+}
+
+////////////////////////////////////////////////////////////
+//Adds a row of pixels onto a row of sums, one channel at a time.
+static void AccumulateScalar(sf::Uint32* sums, const sf::Uint8* src, int count)
+{
+	for (int i = 0; i < count; i++)
+		sums[i] += src[i];
+}
+
+////////////////////////////////////////////////////////////
+//Averages the sums of each destination pixel's block.
+static void ResolveScalar(sf::Uint32* dst, const sf::Uint32* sums, const int* columns, int width, int rows, bool swapRB)
+{
+	for (int x = 0; x < width; x++)
+	{
+		sf::Uint32 sum[4] = { 0, 0, 0, 0 };
+		for (int c = columns[x]; c < columns[x + 1]; c++)
+		{
+			for (int i = 0; i < 4; i++)
+				sum[i] += sums[c * 4 + i];
+		}
+
+		//Same arithmetic as the sse2 version, so both give identical results.
+		float scale = 1.0f / (float)((columns[x + 1] - columns[x]) * rows);
+		sf::Uint8* out = (sf::Uint8*)(dst + x);
+		for (int i = 0; i < 4; i++)
+			out[i] = (sf::Uint8)(int)((float)sum[i] * scale + 0.5f);
+
+		if (swapRB)
+		{
+			sf::Uint8 red = out[2];
+			out[2] = out[0];
+			out[0] = red;
+		}
+	}
+}
+
+#ifdef PIXEL_CONVERTER_X86
+////////////////////////////////////////////////////////////
+PIXEL_CONVERTER_TARGET("sse2")
+static void RowSSE2(sf::Uint32* dst, const sf::Uint32* src, int count)
+{
+	const __m128i keep = _mm_set1_epi32(0xFF00FF00);
+	const __m128i low = _mm_set1_epi32(0x000000FF);
+
+	int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i p = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i r = _mm_and_si128(_mm_srli_epi32(p, 16), low);
+		__m128i b = _mm_slli_epi32(_mm_and_si128(p, low), 16);
+		p = _mm_or_si128(_mm_and_si128(p, keep), _mm_or_si128(r, b));
+		_mm_storeu_si128((__m128i*)(dst + i), p);
+	}
+
+	for (; i < count; i++)
+		dst[i] = SwizzlePixel(src[i]);
+}
+
+////////////////////////////////////////////////////////////
+PIXEL_CONVERTER_TARGET("ssse3")
+static void RowSSSE3(sf::Uint32* dst, const sf::Uint32* src, int count)
+{
+	const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+	int i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128i p0 = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i p1 = _mm_loadu_si128((const __m128i*)(src + i + 4));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_shuffle_epi8(p0, shuffle));
+		_mm_storeu_si128((__m128i*)(dst + i + 4), _mm_shuffle_epi8(p1, shuffle));
+	}
+
+	for (; i < count; i++)
+		dst[i] = SwizzlePixel(src[i]);
+}
+
+#ifdef PIXEL_CONVERTER_AVX2
+////////////////////////////////////////////////////////////
+PIXEL_CONVERTER_TARGET("avx2")
+static void RowAVX2(sf::Uint32* dst, const sf::Uint32* src, int count)
+{
+	const __m256i shuffle = _mm256_setr_epi8(
+		2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+		2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+	int i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		__m256i p0 = _mm256_loadu_si256((const __m256i*)(src + i));
+		__m256i p1 = _mm256_loadu_si256((const __m256i*)(src + i + 8));
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_shuffle_epi8(p0, shuffle));
+		_mm256_storeu_si256((__m256i*)(dst + i + 8), _mm256_shuffle_epi8(p1, shuffle));
+	}
+
+	for (; i < count; i++)
+		dst[i] = SwizzlePixel(src[i]);
+}
+#endif
+
+////////////////////////////////////////////////////////////
+//Adds 16 channels at a time of a row of pixels onto a row of sums.
+PIXEL_CONVERTER_TARGET("sse2")
+static void AccumulateSSE2(sf::Uint32* sums, const sf::Uint8* src, int count)
+{
+	const __m128i zero = _mm_setzero_si128();
+
+	int i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i p = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i lo = _mm_unpacklo_epi8(p, zero);
+		__m128i hi = _mm_unpackhi_epi8(p, zero);
+
+		__m128i* s = (__m128i*)(sums + i);
+		_mm_storeu_si128(s + 0, _mm_add_epi32(_mm_loadu_si128(s + 0), _mm_unpacklo_epi16(lo, zero)));
+		_mm_storeu_si128(s + 1, _mm_add_epi32(_mm_loadu_si128(s + 1), _mm_unpackhi_epi16(lo, zero)));
+		_mm_storeu_si128(s + 2, _mm_add_epi32(_mm_loadu_si128(s + 2), _mm_unpacklo_epi16(hi, zero)));
+		_mm_storeu_si128(s + 3, _mm_add_epi32(_mm_loadu_si128(s + 3), _mm_unpackhi_epi16(hi, zero)));
+	}
+
+	for (; i < count; i++)
+		sums[i] += src[i];
+}
+
+////////////////////////////////////////////////////////////
+//Averages the sums of each destination pixel's block, with all four channels of a pixel in one register.
+PIXEL_CONVERTER_TARGET("sse2")
+static void ResolveSSE2(sf::Uint32* dst, const sf::Uint32* sums, const int* columns, int width, int rows, bool swapRB)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 half = _mm_set1_ps(0.5f);
+
+	for (int x = 0; x < width; x++)
+	{
+		__m128i sum = zero;
+		for (int c = columns[x]; c < columns[x + 1]; c++)
+			sum = _mm_add_epi32(sum, _mm_loadu_si128((const __m128i*)(sums + c * 4)));
+
+		if (swapRB)
+			sum = _mm_shuffle_epi32(sum, _MM_SHUFFLE(3, 0, 1, 2));
+
+		const __m128 scale = _mm_set1_ps(1.0f / (float)((columns[x + 1] - columns[x]) * rows));
+		__m128i average = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(sum), scale), half));
+		average = _mm_packs_epi32(average, zero);
+		average = _mm_packus_epi16(average, zero);
+		dst[x] = (sf::Uint32)_mm_cvtsi128_si32(average);
+	}
+}
+
+////////////////////////////////////////////////////////////
+//Runs cpuid for the given leaf and sub leaf.
+static void Cpuid(int regs[4], int leaf, int subLeaf)
+{
+#if defined(_MSC_VER)
+	__cpuidex(regs, leaf, subLeaf);
+#else
+	unsigned int a, b, c, d;
+	__cpuid_count(leaf, subLeaf, a, b, c, d);
+	regs[0] = (int)a; regs[1] = (int)b; regs[2] = (int)c; regs[3] = (int)d;
+#endif
+}
+
+////////////////////////////////////////////////////////////
+//Checks that the os saves the ymm registers on a context switch.
+static bool OSSupportsAVX()
+{
+	int regs[4];
+	Cpuid(regs, 1, 0);
+	//OSXSAVE and AVX bits.
+	if ((regs[2] & (1 << 27)) == 0 || (regs[2] & (1 << 28)) == 0)
+		return false;
+
+#if defined(_MSC_VER)
+#if _MSC_VER >= 1600
+	unsigned long long xcr0 = _xgetbv(0);
+#else
+	unsigned long long xcr0 = 0;
+#endif
+#else
+	unsigned int eax, edx;
+	__asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	unsigned long long xcr0 = ((unsigned long long)edx << 32) | eax;
+#endif
+
+	return (xcr0 & 6) == 6;
+}
+#endif
+
+PixelConverter::RowKernel PixelConverter::sRowKernels[KERNEL_COUNT] = {
+	&RowScalar,
+#ifdef PIXEL_CONVERTER_X86
+	&RowSSE2,
+	&RowSSSE3,
+#else
+	NULL,
+	NULL,
+#endif
+#ifdef PIXEL_CONVERTER_AVX2
+	&RowAVX2,
+#else
+	NULL,
+#endif
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+//API Methods
+//--------------------------------------------------------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////
+void PixelConverter::CopyBGRAToRGBA(sf::Uint8* dst, int dstStride, const sf::Uint8* src, int srcStride, int width, int height)
+{
+	if (sKernel == KERNEL_COUNT)
+		Init();
+
+	RowKernel row = sRowKernels[sKernel];
+
+	//When both sides are tightly packed the whole rectangle can be converted as one long row.
+	if (dstStride == width * 4 && srcStride == width * 4)
+	{
+		row((sf::Uint32*)dst, (const sf::Uint32*)src, width * height);
+		return;
+	}
+
+	for (int y = 0; y < height; y++)
+	{
+		row((sf::Uint32*)(dst + y * dstStride), (const sf::Uint32*)(src + y * srcStride), width);
+	}
+}
+
+////////////////////////////////////////////////////////////
+void PixelConverter::CopyBGRA(sf::Uint8* dst, int dstStride, const sf::Uint8* src, int srcStride, int width, int height)
+{
+	if (dstStride == width * 4 && srcStride == width * 4)
+	{
+		memcpy(dst, src, width * height * 4);
+		return;
+	}
+
+	for (int y = 0; y < height; y++)
+	{
+		memcpy(dst + y * dstStride, src + y * srcStride, width * 4);
+	}
+}
+
+////////////////////////////////////////////////////////////
+void PixelConverter::Downscale(sf::Uint8* dst, int dstStride, int dstWidth, int dstHeight,
+	const sf::Uint8* src, int srcStride, int srcWidth, int srcHeight, bool swapRB)
+{
+	if (dstWidth <= 0 || dstHeight <= 0 || dstWidth > srcWidth || dstHeight > srcHeight)
+		return;
+
+	if (sKernel == KERNEL_COUNT)
+		Init();
+
+	bool simd = false;
+#ifdef PIXEL_CONVERTER_X86
+	simd = sKernel != KERNEL_SCALAR;
+#endif
+
+	//Destination column x covers source columns columns[x] to columns[x + 1].
+	std::vector<int> columns(dstWidth + 1);
+	for (int x = 0; x <= dstWidth; x++)
+		columns[x] = (int)((long long)x * srcWidth / dstWidth);
+
+	std::vector<sf::Uint32> sums(srcWidth * 4);
+
+	for (int y = 0; y < dstHeight; y++)
+	{
+		int top = (int)((long long)y * srcHeight / dstHeight);
+		int bottom = (int)((long long)(y + 1) * srcHeight / dstHeight);
+
+		//Sum the block's rows first, then each destination pixel only adds up a few columns.
+		memset(&sums[0], 0, sums.size() * sizeof(sf::Uint32));
+		sf::Uint32* row = (sf::Uint32*)(dst + y * dstStride);
+
+#ifdef PIXEL_CONVERTER_X86
+		if (simd)
+		{
+			for (int r = top; r < bottom; r++)
+				AccumulateSSE2(&sums[0], src + r * srcStride, srcWidth * 4);
+			ResolveSSE2(row, &sums[0], &columns[0], dstWidth, bottom - top, swapRB);
+			continue;
+		}
+#endif
+
+		for (int r = top; r < bottom; r++)
+			AccumulateScalar(&sums[0], src + r * srcStride, srcWidth * 4);
+		ResolveScalar(row, &sums[0], &columns[0], dstWidth, bottom - top, swapRB);
+	}
+}
+
+////////////////////////////////////////////////////////////
+PixelConverter::Kernel PixelConverter::GetKernel()
+{
+	if (sKernel == KERNEL_COUNT)
+		Init();
+
+	return sKernel;
+}
+
+////////////////////////////////////////////////////////////
+bool PixelConverter::SetKernel(Kernel kernel)
+{
+	if (!IsSupported(kernel))
+		return false;
+
+	sKernel = kernel;
+	return true;
+}
+
+////////////////////////////////////////////////////////////
+bool PixelConverter::IsSupported(Kernel kernel)
+{
+	if (kernel < 0 || kernel >= KERNEL_COUNT || !sRowKernels[kernel])
+		return false;
+
+#ifdef PIXEL_CONVERTER_X86
+	int regs[4];
+	switch (kernel)
+	{
+	case KERNEL_SSE2:
+		Cpuid(regs, 1, 0);
+		return (regs[3] & (1 << 26)) != 0;
+	case KERNEL_SSSE3:
+		Cpuid(regs, 1, 0);
+		return (regs[2] & (1 << 9)) != 0;
+	case KERNEL_AVX2:
+		Cpuid(regs, 0, 0);
+		if (regs[0] < 7 || !OSSupportsAVX())
+			return false;
+		Cpuid(regs, 7, 0);
+		return (regs[1] & (1 << 5)) != 0;
+	default:
+		break;
+	}
+#endif
+
+	return kernel == KERNEL_SCALAR;
+}
+
+////////////////////////////////////////////////////////////
+const char* PixelConverter::GetKernelName(Kernel kernel)
+{
+	switch (kernel)
+	{
+	case KERNEL_SCALAR:	return "scalar";
+	case KERNEL_SSE2:	return "sse2";
+	case KERNEL_SSSE3:	return "ssse3";
+	case KERNEL_AVX2:	return "avx2";
+	default:			return "unknown";
+	}
+}
+
+////////////////////////////////////////////////////////////
+void PixelConverter::Benchmark(int width, int height, int iterations)
+{
+	//Pad the source rows the same way a dirty rect inside a larger view would be.
+	const int srcWidth = width + 64;
+	std::vector<sf::Uint32> src(srcWidth * height);
+	std::vector<sf::Uint32> dst(width * height);
+	std::vector<sf::Uint32> reference(width * height);
+
+	for (unsigned int i = 0; i < src.size(); i++)
+		src[i] = i * 2654435761u;
+
+	const sf::Uint8* srcRect = (const sf::Uint8*)&src[32];
+	Kernel previous = GetKernel();
+
+	SetKernel(KERNEL_SCALAR);
+	CopyBGRAToRGBA((sf::Uint8*)&reference[0], width * 4, srcRect, srcWidth * 4, width, height);
+
+	printf("PixelConverter: %dx%d rect, %d iterations\n", width, height, iterations);
+
+	for (int k = 0; k < KERNEL_COUNT; k++)
+	{
+		Kernel kernel = (Kernel)k;
+		if (!SetKernel(kernel))
+		{
+			printf("  %-8s unsupported\n", GetKernelName(kernel));
+			continue;
+		}
+
+		memset(&dst[0], 0, dst.size() * sizeof(sf::Uint32));
+		CopyBGRAToRGBA((sf::Uint8*)&dst[0], width * 4, srcRect, srcWidth * 4, width, height);
+		bool valid = memcmp(&dst[0], &reference[0], dst.size() * sizeof(sf::Uint32)) == 0;
+
+		sf::Clock clock;
+		for (int i = 0; i < iterations; i++)
+			CopyBGRAToRGBA((sf::Uint8*)&dst[0], width * 4, srcRect, srcWidth * 4, width, height);
+		float seconds = clock.getElapsedTime().asSeconds();
+
+		double bytes = (double)width * height * 4 * iterations;
+		printf("  %-8s %8.2f GB/s%s\n", GetKernelName(kernel),
+			seconds > 0.0f ? bytes / seconds / 1e9 : 0.0,
+			valid ? "" : "  (OUTPUT MISMATCH)");
+	}
+
+	//Uploading BGRA directly skips the conversion, leaving only the copy.
+	sf::Clock clock;
+	for (int i = 0; i < iterations; i++)
+		CopyBGRA((sf::Uint8*)&dst[0], width * 4, srcRect, srcWidth * 4, width, height);
+	float seconds = clock.getElapsedTime().asSeconds();
+
+	double bytes = (double)width * height * 4 * iterations;
+	printf("  %-8s %8.2f GB/s\n", "copy", seconds > 0.0f ? bytes / seconds / 1e9 : 0.0);
+
+	SetKernel(previous);
+}
+
+////////////////////////////////////////////////////////////
+void PixelConverter::BenchmarkDownscale(int srcWidth, int srcHeight, int dstWidth, int iterations)
+{
+	int dstHeight = (int)((long long)srcHeight * dstWidth / srcWidth);
+	if (dstHeight < 1)
+		dstHeight = 1;
+
+	std::vector<sf::Uint32> src(srcWidth * srcHeight);
+	std::vector<sf::Uint32> dst(dstWidth * dstHeight);
+	std::vector<sf::Uint32> reference(dstWidth * dstHeight);
+
+	for (unsigned int i = 0; i < src.size(); i++)
+		src[i] = i * 2654435761u;
+
+	Kernel previous = GetKernel();
+
+	SetKernel(KERNEL_SCALAR);
+	Downscale((sf::Uint8*)&reference[0], dstWidth * 4, dstWidth, dstHeight, (const sf::Uint8*)&src[0], srcWidth * 4, srcWidth, srcHeight, true);
+
+	printf("Downscale: %dx%d to %dx%d, %d iterations\n", srcWidth, srcHeight, dstWidth, dstHeight, iterations);
+
+	//Every x86 kernel downscales with sse2, so only the two paths are timed.
+	Kernel kernels[2] = { KERNEL_SCALAR, KERNEL_SSE2 };
+	for (int k = 0; k < 2; k++)
+	{
+		if (!SetKernel(kernels[k]))
+		{
+			printf("  %-8s unsupported\n", GetKernelName(kernels[k]));
+			continue;
+		}
+
+		memset(&dst[0], 0, dst.size() * sizeof(sf::Uint32));
+		Downscale((sf::Uint8*)&dst[0], dstWidth * 4, dstWidth, dstHeight, (const sf::Uint8*)&src[0], srcWidth * 4, srcWidth, srcHeight, true);
+		bool valid = memcmp(&dst[0], &reference[0], dst.size() * sizeof(sf::Uint32)) == 0;
+
+		sf::Clock clock;
+		for (int i = 0; i < iterations; i++)
+			Downscale((sf::Uint8*)&dst[0], dstWidth * 4, dstWidth, dstHeight, (const sf::Uint8*)&src[0], srcWidth * 4, srcWidth, srcHeight, true);
+		float seconds = clock.getElapsedTime().asSeconds();
+
+		printf("  %-8s %8.3f ms%s\n", GetKernelName(kernels[k]),
+			seconds * 1000.0f / iterations,
+			valid ? "" : "  (OUTPUT MISMATCH)");
+	}
+
+	SetKernel(previous);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+//Internal Methods
+//--------------------------------------------------------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////
+void PixelConverter::Init()
+{
+	sKernel = KERNEL_SCALAR;
+
+	for (int k = KERNEL_COUNT - 1; k > KERNEL_SCALAR; k--)
+	{
+		if (IsSupported((Kernel)k))
+		{
+			sKernel = (Kernel)k;
+			break;
+		}
+	}
+}
@@ -0,0 +1,184 @@
+#pragma once
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include <SFML\Config.hpp>
+
+////////////////////////////////////////////////////////////
+// Pre-processor Definitions
+////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////
+// SIMD kernels are only available on x86 and x64 targets.
+//
+////////////////////////////////////////////////////////////
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define PIXEL_CONVERTER_X86
+#endif
+
+////////////////////////////////////////////////////////////
+// AVX2 intrinsics first shipped with Visual Studio 2012.  gcc enables them per function.
+//
+////////////////////////////////////////////////////////////
+#if defined(PIXEL_CONVERTER_X86) && ((defined(_MSC_VER) && _MSC_VER >= 1700) || defined(__GNUC__))
+#define PIXEL_CONVERTER_AVX2
+#endif
+
+////////////////////////////////////////////////////////////
+/// \brief Converts the BGRA pixels handed to us by cef into the RGBA pixels SFML expects.
+///
+/// Copying a dirty rectangle out of the full size cef buffer and swizzling it
+/// are done in a single pass.  The kernel used for the pass is picked the first
+/// time it is needed, based on what the cpu running the program supports.
+///
+////////////////////////////////////////////////////////////
+class PixelConverter
+{
+public:
+	////////////////////////////////////////////////////////////
+	/// \brief Available conversion kernels.
+	///
+	////////////////////////////////////////////////////////////
+	enum Kernel
+	{
+		KERNEL_SCALAR,	///< Plain c++, always available.
+		KERNEL_SSE2,	///< 4 pixels per step using mask and shift.
+		KERNEL_SSSE3,	///< 8 pixels per step using a byte shuffle.
+		KERNEL_AVX2,	///< 16 pixels per step using a byte shuffle.
+
+		KERNEL_COUNT
+	};
+
+	////////////////////////////////////////////////////////////
+	/// \brief Copies a rectangle of BGRA pixels while converting it to RGBA.
+	///
+	/// \param dst			First pixel of the destination rectangle.
+	/// \param dstStride	Bytes between the start of two destination rows.
+	/// \param src			First pixel of the source rectangle.
+	/// \param srcStride	Bytes between the start of two source rows.
+	/// \param width		Width of the rectangle in pixels.
+	/// \param height		Height of the rectangle in pixels.
+	///
+	////////////////////////////////////////////////////////////
+	static void CopyBGRAToRGBA(sf::Uint8* dst, int dstStride, const sf::Uint8* src, int srcStride, int width, int height);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Copies a rectangle of pixels without converting them.
+	///
+	/// Used when the texture takes BGRA directly.  Parameters are the same as CopyBGRAToRGBA().
+	///
+	////////////////////////////////////////////////////////////
+	static void CopyBGRA(sf::Uint8* dst, int dstStride, const sf::Uint8* src, int srcStride, int width, int height);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Shrinks an image with a box filter, optionally swapping its red and blue channels.
+	///
+	/// Every destination pixel is the rounded average of the block of source pixels it covers,
+	/// so nothing is skipped however far the image is shrunk.  The sums are built a row at a time
+	/// and averaged four channels at once with sse2 when the active kernel is not KERNEL_SCALAR.
+	///
+	/// \param dst			First pixel of the destination image.
+	/// \param dstStride	Bytes between the start of two destination rows.
+	/// \param dstWidth		Width of the destination, at most srcWidth.
+	/// \param dstHeight	Height of the destination, at most srcHeight.
+	/// \param src			First pixel of the source image.
+	/// \param srcStride	Bytes between the start of two source rows.
+	/// \param srcWidth		Width of the source.
+	/// \param srcHeight	Height of the source.
+	/// \param swapRB		True to also convert BGRA to RGBA, or the other way around.
+	///
+	////////////////////////////////////////////////////////////
+	static void Downscale(sf::Uint8* dst, int dstStride, int dstWidth, int dstHeight,
+		const sf::Uint8* src, int srcStride, int srcWidth, int srcHeight, bool swapRB);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the kernel currently used for conversions.
+	///
+	/// \return The active kernel.
+	///
+	////////////////////////////////////////////////////////////
+	static Kernel GetKernel();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Forces a specific kernel to be used for conversions.
+	///
+	/// \param kernel	Kernel to use.
+	///
+	/// \return False if the kernel is not supported on this cpu, in which case nothing changes.
+	///
+	////////////////////////////////////////////////////////////
+	static bool SetKernel(Kernel kernel);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Checks whether a kernel was compiled in and can run on this cpu.
+	///
+	/// \param kernel	Kernel to check.
+	///
+	/// \return True if the kernel can be used.
+	///
+	////////////////////////////////////////////////////////////
+	static bool IsSupported(Kernel kernel);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns a printable name for a kernel.
+	///
+	/// \param kernel	Kernel to name.
+	///
+	/// \return Name of the kernel.
+	///
+	////////////////////////////////////////////////////////////
+	static const char* GetKernelName(Kernel kernel);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Times every supported kernel and prints its throughput to stdout.
+	///
+	/// The rectangle converted is taken from the middle of a source buffer which is
+	/// wider than it, so that strided reads are measured the same way OnPaint does them.
+	///
+	/// \param width		Width of the converted rectangle.
+	/// \param height		Height of the converted rectangle.
+	/// \param iterations	Number of conversions to time for each kernel.
+	///
+	////////////////////////////////////////////////////////////
+	static void Benchmark(int width = 1920, int height = 1080, int iterations = 200);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Times Downscale() with and without sse2 and prints the results to stdout.
+	///
+	/// \param srcWidth		Width of the source image.
+	/// \param srcHeight	Height of the source image.
+	/// \param dstWidth		Width of the thumbnail, its height keeps the aspect ratio.
+	/// \param iterations	Number of downscales to time for each kernel.
+	///
+	////////////////////////////////////////////////////////////
+	static void BenchmarkDownscale(int srcWidth = 1920, int srcHeight = 1080, int dstWidth = 256, int iterations = 100);
+
+private:
+	////////////////////////////////////////////////////////////
+	/// \brief Function pointer to a kernel which converts a single row.
+	///
+	////////////////////////////////////////////////////////////
+	typedef void(*RowKernel) (
+		sf::Uint32* dst,
+		const sf::Uint32* src,
+		int count
+		);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Picks the fastest supported kernel if none has been picked yet.
+	///
+	////////////////////////////////////////////////////////////
+	static void Init();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Row kernels indexed by Kernel.
+	///
+	////////////////////////////////////////////////////////////
+	static RowKernel sRowKernels[KERNEL_COUNT];
+
+	////////////////////////////////////////////////////////////
+	/// \brief Kernel currently in use, KERNEL_COUNT until Init() has run.
+	///
+	////////////////////////////////////////////////////////////
+	static Kernel sKernel;
+};
@@ -0,0 +1,751 @@
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include "SelfTests.h"
+#include "StagingArena.h"
+#include "FrameHandoff.h"
+#include "CommandQueue.h"
+#include "InterfaceRegistry.h"
+#include <SFML\System.hpp>
+#include <windows.h>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <deque>
+
+////////////////////////////////////////////////////////////
+/// Steps a test's random sequence and returns its next value, 24 bits wide.
+////////////////////////////////////////////////////////////
+static unsigned int Random(unsigned int& seed)
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+//Staging Arena
+//--------------------------------------------------------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////
+bool SelfTests::TestStagingArena(int iterations)
+{
+	struct Live
+	{
+	public:
+		char* block;
+		size_t size;
+		unsigned char fill;
+		bool ring;
+	};
+
+	StagingArena arena;
+	arena.Reset(64 * 1024);
+
+	std::vector<Live> live;
+	unsigned int seed = 12345;
+	unsigned int heap = 0;
+	int blocks = 0;
+	int errors = 0;
+
+	for (int i = 0; i < iterations || !live.empty(); i++)
+	{
+		unsigned int random = Random(seed);
+
+		if (i < iterations && (live.empty() || (live.size() < 48 && random % 3 != 0)))
+		{
+			//Mostly rect sized, sometimes bigger than the whole ring.
+			Live l;
+			l.size = random % 64 == 0 ? 80 * 1024 : 1 + random % 4096;
+			l.fill = (unsigned char)(1 + blocks % 255);
+			l.block = arena.Allocate(l.size);
+			l.ring = arena.GetHeapAllocations() == heap;
+			heap = arena.GetHeapAllocations();
+
+			if (l.ring && ((size_t)l.block & 15) != 0)
+				errors++;
+
+			memset(l.block, l.fill, l.size);
+			live.push_back(l);
+			blocks++;
+		}
+		else
+		{
+			//Paints are consumed in order, with the odd one out of turn.
+			unsigned int index = random % 8 == 0 ? (random >> 3) % live.size() : 0;
+			Live l = live[index];
+			live.erase(live.begin() + index);
+
+			for (size_t b = 0; b < l.size; b++)
+			{
+				if ((unsigned char)l.block[b] != l.fill)
+				{
+					errors++;
+					break;
+				}
+			}
+
+			arena.Release(l.block);
+		}
+	}
+
+	//With nothing live the ring starts again from the bottom, so half of it must fit.
+	unsigned int before = arena.GetHeapAllocations();
+	arena.Release(arena.Allocate(arena.GetCapacity() / 2));
+	if (arena.GetHeapAllocations() != before)
+		errors++;
+
+	printf("Staging arena: %d blocks, %u from the heap, %d errors\n", blocks, arena.GetHeapAllocations(), errors);
+	return errors == 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+//Frame Handoff
+//--------------------------------------------------------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////
+/// Number of frame checksums TestFrameHandoff() remembers.
+////////////////////////////////////////////////////////////
+static const int sTestHistory = 4096;
+
+////////////////////////////////////////////////////////////
+/// State shared between TestFrameHandoff() and its reader thread.
+////////////////////////////////////////////////////////////
+struct HandoffTest
+{
+public:
+	FrameHandoff* pHandoff;
+	const sf::Uint32* sums;
+	sf::Uint32* texture;
+	volatile long done;
+	volatile long lastSeen;
+	int pickedUp;
+	int torn;
+	int outOfOrder;
+};
+
+////////////////////////////////////////////////////////////
+static sf::Uint32 ChecksumFrame(const FrameHandoff::Frame& frame)
+{
+	sf::Uint32 sum = 2166136261u;
+
+	for (unsigned int r = 0; r < frame.rects.size(); r++)
+	{
+		const CefRect& rect = frame.rects[r];
+		sum = (sum ^ (rect.x | rect.y << 16)) * 16777619u;
+		sum = (sum ^ (rect.width | rect.height << 16)) * 16777619u;
+
+		const sf::Uint32* pPixels = (const sf::Uint32*)(frame.pixels + frame.offsets[r]);
+		for (int p = 0; p < rect.width * rect.height; p++)
+			sum = (sum ^ pPixels[p]) * 16777619u;
+	}
+
+	return sum;
+}
+
+////////////////////////////////////////////////////////////
+static void HandoffReaderThread(HandoffTest* pTest)
+{
+	const int width = pTest->pHandoff->GetWidth();
+	long last = 0;
+
+	for (;;)
+	{
+		//Only stop once a frame published before done was set has been looked for.
+		bool finished = pTest->done != 0;
+
+		const FrameHandoff::Frame* pFrame = pTest->pHandoff->AcquireFrame();
+		if (!pFrame)
+		{
+			if (finished)
+				break;
+
+			Sleep(0);
+			continue;
+		}
+
+		//Every frame covers the top left pixel, which holds the number of the frame.
+		long number = 0;
+		for (unsigned int r = 0; r < pFrame->rects.size(); r++)
+		{
+			if (pFrame->rects[r].x == 0 && pFrame->rects[r].y == 0)
+				number = *(const sf::Uint32*)(pFrame->pixels + pFrame->offsets[r]);
+		}
+
+		if (number <= last)
+			pTest->outOfOrder++;
+		else if (ChecksumFrame(*pFrame) != pTest->sums[number % sTestHistory])
+			pTest->torn++;
+
+		for (unsigned int r = 0; r < pFrame->rects.size(); r++)
+		{
+			const CefRect& rect = pFrame->rects[r];
+			const sf::Uint8* pSource = pFrame->pixels + pFrame->offsets[r];
+			for (int y = 0; y < rect.height; y++)
+				memcpy(pTest->texture + (rect.y + y) * width + rect.x, pSource + y * rect.width * 4, rect.width * 4);
+		}
+
+		pTest->pickedUp++;
+		if (number > last)
+			last = number;
+		InterlockedExchange(&pTest->lastSeen, last);
+	}
+}
+
+////////////////////////////////////////////////////////////
+bool SelfTests::TestFrameHandoff(int frames)
+{
+	const int width = 128;
+	const int height = 96;
+
+	std::vector<sf::Uint32> view;
+	std::vector<sf::Uint32> texture;
+	std::vector<sf::Uint32> sums(sTestHistory);
+	int errors = 0;
+
+	for (int pass = 0; pass < 2; pass++)
+	{
+		FrameHandoff handoff;
+		handoff.Reset(width, height);
+		handoff.SetTileSize(pass * 32);
+
+		view.assign(width * height, 0);
+		texture.assign(width * height, 0);
+
+		HandoffTest test;
+		test.pHandoff = &handoff;
+		test.sums = &sums[0];
+		test.texture = &texture[0];
+		test.done = 0;
+		test.lastSeen = 0;
+		test.pickedUp = 0;
+		test.torn = 0;
+		test.outOfOrder = 0;
+
+		sf::Thread reader(&HandoffReaderThread, &test);
+		reader.launch();
+
+		unsigned int seed = 12345;
+		for (int n = 1; n <= frames; n++)
+		{
+			//Keep the checksum of every frame the reader can still pick up.
+			while (n - test.lastSeen > sTestHistory / 4)
+				Sleep(0);
+
+			CefRenderHandler::RectList dirty;
+			dirty.push_back(CefRect(0, 0, 1, 1));
+
+			int count = 1 + Random(seed) % 3;
+			for (int i = 0; i < count; i++)
+			{
+				unsigned int random = Random(seed);
+				int x = random % width;
+				int y = (random >> 8) % height;
+				random = Random(seed);
+				int w = 1 + random % 32;
+				int h = 1 + (random >> 12) % 32;
+				dirty.push_back(CefRect(x, y, w < width - x ? w : width - x, h < height - y ? h : height - y));
+			}
+
+			for (unsigned int r = 0; r < dirty.size(); r++)
+			{
+				for (int y = dirty[r].y; y < dirty[r].y + dirty[r].height; y++)
+				{
+					for (int x = dirty[r].x; x < dirty[r].x + dirty[r].width; x++)
+						view[y * width + x] = n;
+				}
+			}
+
+			FrameHandoff::Frame* pFrame = handoff.BeginFrame(dirty);
+			for (unsigned int r = 0; r < pFrame->rects.size(); r++)
+			{
+				const CefRect& rect = pFrame->rects[r];
+				sf::Uint8* pDest = pFrame->pixels + pFrame->offsets[r];
+				for (int y = 0; y < rect.height; y++)
+					memcpy(pDest + y * rect.width * 4, &view[(rect.y + y) * width + rect.x], rect.width * 4);
+			}
+
+			sums[n % sTestHistory] = ChecksumFrame(*pFrame);
+			handoff.EndFrame();
+		}
+
+		InterlockedExchange(&test.done, 1);
+		reader.wait();
+
+		int wrong = 0;
+		for (int p = 0; p < width * height; p++)
+		{
+			if (texture[p] != view[p])
+				wrong++;
+		}
+
+		printf("Frame handoff: tile %d, %d frames written, %d picked up, %d torn, %d out of order, %d pixels wrong\n",
+			pass * 32, frames, test.pickedUp, test.torn, test.outOfOrder, wrong);
+		errors += test.torn + test.outOfOrder + wrong;
+	}
+
+	return errors == 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+//Damage Region
+//--------------------------------------------------------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////
+bool SelfTests::TestDamageRegion(int rounds)
+{
+	const int width = 64;
+	const int height = 48;
+
+	DamageRegion region;
+	region.SetViewSize(width, height);
+
+	std::vector<unsigned char> mask(width * height);
+	std::vector<unsigned char> covered(width * height);
+	std::vector<CefRect> pieces;
+	unsigned int seed = 12345;
+	int total = 0;
+	int full = 0;
+	int errors = 0;
+
+	for (int round = 0; round < rounds; round++)
+	{
+		unsigned int random = Random(seed);
+		region.Clear();
+		region.SetPromotionThreshold(0.25f + (random % 4) * 0.25f);
+		mask.assign(width * height, 0);
+
+		//Rects of every size, some of them hanging off the edges of the view.
+		int count = 1 + (random >> 4) % 24;
+		for (int i = 0; i < count; i++)
+		{
+			random = Random(seed);
+			CefRect rect((int)(random % (width + 8)) - 8, (int)((random >> 7) % (height + 8)) - 8, 0, 0);
+			random = Random(seed);
+			rect.width = 1 + random % ((random & 0x3800) == 0 ? width : 12);
+			rect.height = 1 + (random >> 12) % ((random & 0x3800) == 0 ? height : 12);
+			region.Add(rect);
+
+			CefRect clipped = DamageRegion::Intersect(rect, CefRect(0, 0, width, height));
+			for (int y = clipped.y; y < clipped.y + clipped.height; y++)
+			{
+				for (int x = clipped.x; x < clipped.x + clipped.width; x++)
+					mask[y * width + x] = 1;
+			}
+		}
+
+		const std::vector<CefRect>& rects = region.GetRects();
+		CefRect bounds = region.GetBounds();
+		covered.assign(width * height, 0);
+		int area = 0;
+		bool overlap = false;
+
+		for (unsigned int r = 0; r < rects.size(); r++)
+		{
+			const CefRect& rect = rects[r];
+			if (rect.IsEmpty() || !DamageRegion::Contains(CefRect(0, 0, width, height), rect) || !DamageRegion::Contains(bounds, rect))
+			{
+				errors++;
+				continue;
+			}
+
+			for (int y = rect.y; y < rect.y + rect.height; y++)
+			{
+				for (int x = rect.x; x < rect.x + rect.width; x++)
+				{
+					if (covered[y * width + x]++)
+						overlap = true;
+				}
+			}
+
+			area += rect.width * rect.height;
+		}
+
+		bool missed = false;
+		for (int p = 0; p < width * height; p++)
+		{
+			if (mask[p] && !covered[p])
+				missed = true;
+		}
+
+		if (overlap || missed || area != region.GetArea() || region.IsEmpty() != rects.empty())
+			errors++;
+
+		if (region.IsFull())
+		{
+			if (area != width * height)
+				errors++;
+			full++;
+		}
+
+		//Cut every rect along a grid, and check the pieces tile it exactly.
+		int cellSize = 1 + Random(seed) % 40;
+		for (unsigned int r = 0; r < rects.size(); r++)
+		{
+			const CefRect& rect = rects[r];
+			pieces.clear();
+			DamageRegion::SplitToGrid(rect, cellSize, pieces);
+
+			int pieceArea = 0;
+			for (unsigned int i = 0; i < pieces.size(); i++)
+			{
+				const CefRect& piece = pieces[i];
+				if (piece.IsEmpty() || !DamageRegion::Contains(rect, piece) ||
+					piece.x / cellSize != (piece.x + piece.width - 1) / cellSize ||
+					piece.y / cellSize != (piece.y + piece.height - 1) / cellSize)
+				{
+					errors++;
+					break;
+				}
+
+				for (int y = piece.y; y < piece.y + piece.height; y++)
+				{
+					for (int x = piece.x; x < piece.x + piece.width; x++)
+					{
+						if (--covered[y * width + x] != 0)
+							overlap = true;
+					}
+				}
+
+				pieceArea += piece.width * piece.height;
+			}
+
+			if (overlap || pieceArea != rect.width * rect.height)
+			{
+				errors++;
+				break;
+			}
+		}
+
+		total += (int)rects.size();
+	}
+
+	printf("Damage region: %d rounds, %d rects, %d promoted to the whole view, %d errors\n", rounds, total, full, errors);
+	return errors == 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+//Command Queue
+//--------------------------------------------------------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////
+/// Number of threads TestCommandQueue() pushes from.
+////////////////////////////////////////////////////////////
+static const int sTestPushers = 4;
+
+////////////////////////////////////////////////////////////
+/// State of one thread pushing for TestCommandQueue().
+////////////////////////////////////////////////////////////
+struct QueuePusher
+{
+public:
+	CommandQueue* pQueue;
+	volatile long* pFinished;
+	int index;
+	int commands;
+};
+
+////////////////////////////////////////////////////////////
+static void QueuePusherThread(QueuePusher* pPusher)
+{
+	WebCommand command(WebCommand::COMMAND_MOUSE_MOVE);
+	command.clicks = pPusher->index;
+
+	for (int i = 0; i < pPusher->commands; i++)
+	{
+		command.line = i;
+		command.deltaX = i * 7 + pPusher->index;
+
+		while (!pPusher->pQueue->Push(command))
+			Sleep(0);
+	}
+
+	InterlockedIncrement(pPusher->pFinished);
+}
+
+////////////////////////////////////////////////////////////
+bool SelfTests::TestCommandQueue(int commands)
+{
+	CommandQueue queue(64);
+	volatile long finished = 0;
+
+	QueuePusher pushers[sTestPushers];
+	sf::Thread* threads[sTestPushers];
+	for (int p = 0; p < sTestPushers; p++)
+	{
+		pushers[p].pQueue = &queue;
+		pushers[p].pFinished = &finished;
+		pushers[p].index = p;
+		pushers[p].commands = commands;
+		threads[p] = new sf::Thread(&QueuePusherThread, &pushers[p]);
+		threads[p]->launch();
+	}
+
+	int next[sTestPushers] = { 0 };
+	std::vector<WebCommand> batch;
+	int popped = 0;
+	int errors = 0;
+
+	for (;;)
+	{
+		//Only stop once a pop started after every pusher was done comes back empty.
+		bool done = finished == sTestPushers;
+
+		batch.clear();
+		if (queue.PopBatch(batch, 64) == 0)
+		{
+			if (done)
+				break;
+
+			Sleep(0);
+			continue;
+		}
+
+		for (unsigned int c = 0; c < batch.size(); c++)
+		{
+			const WebCommand& command = batch[c];
+			if (command.type != WebCommand::COMMAND_MOUSE_MOVE || command.clicks < 0 || command.clicks >= sTestPushers ||
+				command.line != next[command.clicks] || command.deltaX != command.line * 7 + command.clicks)
+			{
+				errors++;
+			}
+			else
+			{
+				next[command.clicks]++;
+			}
+		}
+
+		popped += (int)batch.size();
+	}
+
+	for (int p = 0; p < sTestPushers; p++)
+	{
+		threads[p]->wait();
+		delete threads[p];
+
+		if (next[p] != commands)
+			errors++;
+	}
+
+	printf("Command queue: %d threads, %d commands popped of %d, %d errors\n", sTestPushers, popped, sTestPushers * commands, errors);
+	return errors == 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+//Interface Registry
+//--------------------------------------------------------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////
+/// Stand-in for a WebInterface.  The registry never looks inside what it holds.
+////////////////////////////////////////////////////////////
+struct RegistryEntry
+{
+public:
+	volatile long magic;
+	int id;
+};
+
+static const long sEntryMagic = 0x57454249;
+
+////////////////////////////////////////////////////////////
+/// State shared between TestInterfaceRegistry() and its threads.
+////////////////////////////////////////////////////////////
+struct RegistryTest
+{
+public:
+	InterfaceRegistry* pRegistry;
+
+	//Entries waiting for the cef thread, and entries it added, oldest first.
+	sf::Mutex mutex;
+	std::deque<RegistryEntry*> waiting;
+	std::deque<RegistryEntry*> added;
+
+	volatile long nextId;
+	volatile long seeds;
+	volatile long stop;
+	volatile long finds;
+	volatile long hits;
+	volatile long retired;
+	volatile long bad;
+};
+
+////////////////////////////////////////////////////////////
+static bool CheckEntry(const RegistryEntry* pEntry, int id)
+{
+	return pEntry->magic == sEntryMagic && (id == 0 || pEntry->id == id);
+}
+
+////////////////////////////////////////////////////////////
+static void RegistryCefThread(RegistryTest* pTest)
+{
+	unsigned int seed = (unsigned int)InterlockedIncrement(&pTest->seeds) * 2654435761u;
+	long bad = 0;
+
+	while (!pTest->stop)
+	{
+		RegistryEntry* pEntry = NULL;
+		{
+			sf::Lock lock(pTest->mutex);
+			if (!pTest->waiting.empty())
+			{
+				pEntry = pTest->waiting.front();
+				pTest->waiting.pop_front();
+			}
+		}
+
+		if (pEntry)
+		{
+			pTest->pRegistry->Add(pEntry->id, (WebInterface*)pEntry);
+
+			sf::Lock lock(pTest->mutex);
+			pTest->added.push_back(pEntry);
+		}
+
+		//Browsers sometimes go away before their WebInterface does.
+		unsigned int random = Random(seed);
+		if (random % 50 == 0)
+			pTest->pRegistry->Remove(1 + (random / 50) % (pTest->nextId + 1));
+
+		{
+			InterfaceRegistry::ReadScope scope;
+			int id = 1 + (random >> 6) % (pTest->nextId + 1);
+			RegistryEntry* pFound = (RegistryEntry*)pTest->pRegistry->Find(id);
+			if (pFound && !CheckEntry(pFound, id))
+				bad++;
+		}
+	}
+
+	InterlockedExchangeAdd(&pTest->bad, bad);
+}
+
+////////////////////////////////////////////////////////////
+static void RegistryAppThread(RegistryTest* pTest)
+{
+	while (!pTest->stop)
+	{
+		RegistryEntry* pOldest = NULL;
+		bool full = false;
+		{
+			sf::Lock lock(pTest->mutex);
+			full = pTest->waiting.size() >= 16;
+
+			if (pTest->added.size() > 40)
+			{
+				pOldest = pTest->added.front();
+				pTest->added.pop_front();
+			}
+		}
+
+		if (!full)
+		{
+			RegistryEntry* pEntry = new RegistryEntry;
+			pEntry->magic = sEntryMagic;
+			pEntry->id = InterlockedIncrement(&pTest->nextId);
+
+			sf::Lock lock(pTest->mutex);
+			pTest->waiting.push_back(pEntry);
+		}
+
+		if (pOldest)
+		{
+			pTest->pRegistry->Retire((WebInterface*)pOldest);
+			pOldest->magic = 0;
+			delete pOldest;
+			InterlockedIncrement(&pTest->retired);
+		}
+		else if (full)
+		{
+			Sleep(0);
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////
+static void RegistryReaderThread(RegistryTest* pTest)
+{
+	unsigned int seed = (unsigned int)InterlockedIncrement(&pTest->seeds) * 2654435761u;
+	long finds = 0;
+	long hits = 0;
+	long bad = 0;
+
+	while (!pTest->stop)
+	{
+		//Mostly look for recent ids, which are the ones likely to be retired soon.
+		{
+			InterfaceRegistry::ReadScope scope;
+			for (int i = 0; i < 8; i++)
+			{
+				int id = pTest->nextId - (int)(Random(seed) % 64);
+				if (id < 1)
+					id = 1;
+
+				RegistryEntry* pFound = (RegistryEntry*)pTest->pRegistry->Find(id);
+				finds++;
+
+				if (pFound)
+				{
+					hits++;
+					if (!CheckEntry(pFound, id))
+						bad++;
+				}
+			}
+		}
+
+		InterfaceRegistry::Iterator iterator(*pTest->pRegistry);
+		while (RegistryEntry* pFound = (RegistryEntry*)iterator.Next())
+		{
+			if (!CheckEntry(pFound, 0))
+				bad++;
+		}
+	}
+
+	InterlockedExchangeAdd(&pTest->finds, finds);
+	InterlockedExchangeAdd(&pTest->hits, hits);
+	InterlockedExchangeAdd(&pTest->bad, bad);
+}
+
+////////////////////////////////////////////////////////////
+bool SelfTests::TestInterfaceRegistry(float seconds)
+{
+	InterfaceRegistry registry;
+
+	RegistryTest test;
+	test.pRegistry = &registry;
+	test.nextId = 0;
+	test.seeds = 0;
+	test.stop = 0;
+	test.finds = 0;
+	test.hits = 0;
+	test.retired = 0;
+	test.bad = 0;
+
+	sf::Thread* threads[5];
+	threads[0] = new sf::Thread(&RegistryCefThread, &test);
+	threads[1] = new sf::Thread(&RegistryAppThread, &test);
+	threads[2] = new sf::Thread(&RegistryAppThread, &test);
+	threads[3] = new sf::Thread(&RegistryReaderThread, &test);
+	threads[4] = new sf::Thread(&RegistryReaderThread, &test);
+
+	for (int t = 0; t < 5; t++)
+		threads[t]->launch();
+
+	sf::sleep(sf::seconds(seconds));
+	InterlockedExchange(&test.stop, 1);
+
+	for (int t = 0; t < 5; t++)
+	{
+		threads[t]->wait();
+		delete threads[t];
+	}
+
+	for (unsigned int i = 0; i < test.added.size(); i++)
+	{
+		registry.Retire((WebInterface*)test.added[i]);
+		delete test.added[i];
+	}
+	for (unsigned int i = 0; i < test.waiting.size(); i++)
+		delete test.waiting[i];
+
+	printf("Interface registry: %ld ids, %ld finds, %ld found, %ld retired, %ld bad reads\n",
+		test.nextId, test.finds, test.hits, test.retired, test.bad);
+	return test.bad == 0;
+}
@@ -0,0 +1,90 @@
+#pragma once
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////
+/// \brief Checks of the lock free and packing parts of WebSystem, built into test_base only.
+///
+/// Each check drives one part with random input, prints one line of results to stdout,
+/// and returns whether it found no error.  Main runs them with the -test_ arguments.
+/// The random input repeats exactly from run to run.
+///
+////////////////////////////////////////////////////////////
+class SelfTests
+{
+public:
+	////////////////////////////////////////////////////////////
+	/// \brief Checks StagingArena against random allocations and releases.
+	///
+	/// Blocks are released mostly in the order they were allocated, as paints are, and
+	/// sometimes out of order.  Every block is filled when allocated and checked when
+	/// released, so blocks which overlap are caught.  Blocks in the ring are checked for
+	/// alignment, and once everything is released the ring must be reusable as a whole.
+	///
+	/// \param iterations	Number of allocations and releases.
+	///
+	/// \return True if no error was found.
+	///
+	////////////////////////////////////////////////////////////
+	static bool TestStagingArena(int iterations = 1000000);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Passes random frames through FrameHandoff between two threads.
+	///
+	/// The calling thread writes frames as the cef thread does and a second thread picks
+	/// them up as the draw thread does.  Every frame is checksummed before it is published
+	/// and checked when it is picked up, so a frame the writer touched after handing it over
+	/// is caught.  Once the writer is done the reader's copy of the view must match the
+	/// writer's.  The test runs once with whole rects and once cut along a tile grid.
+	///
+	/// \param frames	Number of frames to write in each run.
+	///
+	/// \return True if no error was found.
+	///
+	////////////////////////////////////////////////////////////
+	static bool TestFrameHandoff(int frames = 20000);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Checks DamageRegion against a pixel mask, with regions built from random rects.
+	///
+	/// Every region must be made of disjoint rects inside the view which cover every damaged
+	/// pixel, and its area and bounds must agree with its rects.  The rects of each region are
+	/// also cut along a random grid, and the pieces must tile them without crossing a cell edge.
+	///
+	/// \param rounds	Number of regions to build.
+	///
+	/// \return True if no error was found.
+	///
+	////////////////////////////////////////////////////////////
+	static bool TestDamageRegion(int rounds = 100000);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Pushes into a small CommandQueue from several threads while popping.
+	///
+	/// Each pushing thread numbers its commands, retrying whenever the queue is full.  The
+	/// commands of each thread must come out in the order they went in, none missing and
+	/// none repeated, with every field intact.
+	///
+	/// \param commands	Number of commands each thread pushes.
+	///
+	/// \return True if no error was found.
+	///
+	////////////////////////////////////////////////////////////
+	static bool TestCommandQueue(int commands = 200000);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Adds, removes, retires and finds in an InterfaceRegistry from several threads at once.
+	///
+	/// One thread adds and removes as the cef thread does, two retire and destroy the oldest
+	/// entries as the app does, and two look entries up and walk the registry.  Entries are
+	/// stand-ins, marked when destroyed, so a reader which finds one that is destroyed or
+	/// belongs to another id is caught.  Best run under AddressSanitizer or a debug heap.
+	///
+	/// \param seconds	How long to run for.
+	///
+	/// \return True if no bad read was found.
+	///
+	////////////////////////////////////////////////////////////
+	static bool TestInterfaceRegistry(float seconds = 4.0f);
+};
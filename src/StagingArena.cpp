@@ -0,0 +1,149 @@
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include "StagingArena.h"
+
+////////////////////////////////////////////////////////////
+StagingArena::StagingArena()
+: mpAllocation(NULL)
+, mpStorage(NULL)
+, mCapacity(0)
+, mHead(0)
+, mTail(0)
+, mWrapEnd(0)
+, mWrapped(false)
+, mBlocks(0)
+, mHeapAllocations(0)
+{
+
+}
+
+////////////////////////////////////////////////////////////
+StagingArena::~StagingArena()
+{
+	delete[] mpAllocation;
+}
+
+////////////////////////////////////////////////////////////
+void StagingArena::Reset(size_t capacity)
+{
+	//Round down so every block boundary stays aligned.
+	capacity &= ~(size_t)15;
+
+	if (capacity != mCapacity)
+	{
+		delete[] mpAllocation;
+		mpAllocation = NULL;
+		mpStorage = NULL;
+
+		if (capacity > 0)
+		{
+			mpAllocation = new char[capacity + 15];
+			mpStorage = (char*)(((size_t)mpAllocation + 15) & ~(size_t)15);
+		}
+
+		mCapacity = capacity;
+	}
+
+	mHead = 0;
+	mTail = 0;
+	mWrapEnd = 0;
+	mWrapped = false;
+	mBlocks = 0;
+	mHeapAllocations = 0;
+}
+
+////////////////////////////////////////////////////////////
+char* StagingArena::Allocate(size_t size)
+{
+	size_t need = (sizeof(BlockHeader) + size + 15) & ~(size_t)15;
+	size_t offset = mCapacity;
+
+	if (mBlocks == 0)
+	{
+		//Nothing is live, so start again from the bottom for the most contiguous space.
+		mHead = 0;
+		mTail = 0;
+		mWrapped = false;
+	}
+
+	if (!mWrapped)
+	{
+		if (mCapacity - mHead >= need)
+		{
+			offset = mHead;
+		}
+		else if (mTail >= need)
+		{
+			//Leave the gap at the top unused and wrap around to the bottom.
+			mWrapEnd = mHead;
+			mWrapped = true;
+			offset = 0;
+		}
+	}
+	else if (mTail - mHead >= need)
+	{
+		offset = mHead;
+	}
+
+	if (offset == mCapacity)
+	{
+		//The ring is full, fall back to the heap.
+		mHeapAllocations++;
+		return new char[size];
+	}
+
+	BlockHeader* header = (BlockHeader*)(mpStorage + offset);
+	header->size = need;
+	header->released = false;
+
+	mHead = offset + need;
+	mBlocks++;
+
+	return (char*)(header + 1);
+}
+
+////////////////////////////////////////////////////////////
+void StagingArena::Release(char* block)
+{
+	if (!block)
+		return;
+
+	if (!Owns(block))
+	{
+		delete[] block;
+		return;
+	}
+
+	BlockHeader* header = (BlockHeader*)block - 1;
+	header->released = true;
+
+	//Reclaim every released block at the tail.
+	while (mBlocks > 0)
+	{
+		if (mWrapped && mTail == mWrapEnd)
+		{
+			mTail = 0;
+			mWrapped = false;
+		}
+
+		BlockHeader* tail = (BlockHeader*)(mpStorage + mTail);
+		if (!tail->released)
+			break;
+
+		mTail += tail->size;
+		mBlocks--;
+	}
+
+	if (mWrapped && mTail == mWrapEnd)
+	{
+		mTail = 0;
+		mWrapped = false;
+	}
+}
+
+////////////////////////////////////////////////////////////
+bool StagingArena::Owns(const char* block) const
+{
+	return mpStorage && block >= mpStorage && block < mpStorage + mCapacity;
+}
@@ -0,0 +1,144 @@
+#pragma once
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include <cstddef>
+
+////////////////////////////////////////////////////////////
+/// \brief Ring allocator for the rect sized buffers passed from OnPaint to the draw thread.
+///
+/// Blocks are carved out of one preallocated region in the order they are requested.
+/// They may be released in any order, but space only becomes reusable once every block
+/// allocated before it has also been released.  Since rects are consumed in the order they
+/// were painted this is almost always immediate.
+///
+/// When the ring is full (the draw thread has fallen far behind) blocks come from the heap
+/// instead, so Allocate() never fails.  Release() tells the two apart by itself.
+///
+/// The arena does no locking of its own.  WebInterface only touches it while holding its mutex.
+///
+////////////////////////////////////////////////////////////
+class StagingArena
+{
+public:
+	StagingArena();
+	~StagingArena();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Discards all blocks and resizes the ring.
+	///
+	/// Any block handed out before this call must no longer be used.
+	///
+	/// \param capacity		Size of the ring in bytes.
+	///
+	////////////////////////////////////////////////////////////
+	void Reset(size_t capacity);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Hands out a block of at least the requested size.
+	///
+	/// \param size		Size of the block in bytes.
+	///
+	/// \return Pointer to the block.
+	///
+	////////////////////////////////////////////////////////////
+	char* Allocate(size_t size);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Gives a block back to the arena.
+	///
+	/// \param block	Block returned by Allocate().
+	///
+	////////////////////////////////////////////////////////////
+	void Release(char* block);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the size of the ring.
+	///
+	/// \return Size of the ring in bytes.
+	///
+	////////////////////////////////////////////////////////////
+	size_t GetCapacity() const { return mCapacity; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns how many blocks had to come from the heap since the last Reset().
+	///
+	/// \return Number of heap allocations.
+	///
+	////////////////////////////////////////////////////////////
+	unsigned int GetHeapAllocations() const { return mHeapAllocations; }
+
+private:
+	////////////////////////////////////////////////////////////
+	/// \brief Stored in front of every block inside the ring.
+	///
+	/// Padded so that the block following it stays 16 byte aligned for the pixel kernels.
+	///
+	////////////////////////////////////////////////////////////
+	struct BlockHeader
+	{
+		size_t size;
+		bool released;
+		char padding[16 - sizeof(size_t) - sizeof(bool)];
+	};
+
+	////////////////////////////////////////////////////////////
+	/// \brief Checks whether a block lives inside the ring.
+	///
+	////////////////////////////////////////////////////////////
+	bool Owns(const char* block) const;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Storage for the ring, over allocated so it can be aligned.
+	///
+	////////////////////////////////////////////////////////////
+	char* mpAllocation;
+
+	////////////////////////////////////////////////////////////
+	/// \brief 16 byte aligned start of the ring.
+	///
+	////////////////////////////////////////////////////////////
+	char* mpStorage;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Size of the ring in bytes.
+	///
+	////////////////////////////////////////////////////////////
+	size_t mCapacity;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Offset at which the next block will be placed.
+	///
+	////////////////////////////////////////////////////////////
+	size_t mHead;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Offset of the oldest block which has not been reclaimed.
+	///
+	////////////////////////////////////////////////////////////
+	size_t mTail;
+
+	////////////////////////////////////////////////////////////
+	/// \brief End of the live data at the top of the ring after mHead has wrapped to the start.
+	///
+	////////////////////////////////////////////////////////////
+	size_t mWrapEnd;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Whether mHead has wrapped around behind mTail.
+	///
+	////////////////////////////////////////////////////////////
+	bool mWrapped;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Number of blocks inside the ring which have not been reclaimed.
+	///
+	////////////////////////////////////////////////////////////
+	unsigned int mBlocks;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Number of blocks which came from the heap since the last Reset().
+	///
+	////////////////////////////////////////////////////////////
+	unsigned int mHeapAllocations;
+};
@@ -0,0 +1,354 @@
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include "TextureAtlas.h"
+#include "WebSystem.h"
+
+//--------------------------------------------------------------------------------------------------------------------------
+//Texture Atlas Methods
+//--------------------------------------------------------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////
+TextureAtlas::TextureAtlas()
+: mPageSize(TEXTURE_ATLAS_PAGE_SIZE)
+{
+
+}
+
+////////////////////////////////////////////////////////////
+TextureAtlas::~TextureAtlas()
+{
+	for (unsigned int i = 0; i < mPages.size(); i++)
+	{
+		delete mPages[i].texture;
+	}
+}
+
+////////////////////////////////////////////////////////////
+void TextureAtlas::SetPageSize(int size)
+{
+	sf::Lock lock(mMutex);
+
+	mPageSize = size;
+}
+
+////////////////////////////////////////////////////////////
+int TextureAtlas::GetPageSize()
+{
+	sf::Lock lock(mMutex);
+
+	int maximum = (int)sf::Texture::getMaximumSize();
+	return mPageSize < maximum ? mPageSize : maximum;
+}
+
+////////////////////////////////////////////////////////////
+bool TextureAtlas::Allocate(int width, int height, Region& region)
+{
+	int paddedWidth = width + TEXTURE_ATLAS_PADDING * 2;
+	int paddedHeight = height + TEXTURE_ATLAS_PADDING * 2;
+	int pageSize = GetPageSize();
+
+	sf::Lock lock(mMutex);
+
+	int x = 0, y = 0;
+	int page = -1;
+
+	for (unsigned int i = 0; i < mPages.size() && page < 0; i++)
+	{
+		if (mPages[i].texture && Place(mPages[i], paddedWidth, paddedHeight, x, y))
+			page = i;
+	}
+
+	if (page < 0)
+	{
+		if (paddedWidth > pageSize || paddedHeight > pageSize)
+			return false;
+
+		//Reuse the slot of a page which was emptied, so page indices stay small and stable.
+		for (unsigned int i = 0; i < mPages.size() && page < 0; i++)
+		{
+			if (!mPages[i].texture)
+				page = i;
+		}
+		if (page < 0)
+		{
+			page = mPages.size();
+			mPages.push_back(Page());
+		}
+
+		Page& fresh = mPages[page];
+		fresh.size = pageSize;
+		fresh.regions = 0;
+		fresh.top = 0;
+		fresh.shelves.clear();
+
+		sf::Image img; img.create(pageSize, pageSize, sf::Color(0, 0, 0, 0));
+		fresh.texture = new sf::Texture();
+		fresh.texture->loadFromImage(img);
+		fresh.texture->setSmooth(true);
+
+		Place(fresh, paddedWidth, paddedHeight, x, y);
+	}
+	else
+	{
+		//Reused space still holds whatever was there before, padding included.
+		sf::Image img; img.create(paddedWidth, paddedHeight, sf::Color(0, 0, 0, 0));
+		mPages[page].texture->update(img, x, y);
+	}
+
+	mPages[page].regions++;
+
+	region.page = page;
+	region.rect = sf::IntRect(x + TEXTURE_ATLAS_PADDING, y + TEXTURE_ATLAS_PADDING, width, height);
+	return true;
+}
+
+////////////////////////////////////////////////////////////
+void TextureAtlas::Free(const Region& region)
+{
+	sf::Lock lock(mMutex);
+
+	if (region.page < 0 || region.page >= (int)mPages.size() || !mPages[region.page].texture)
+		return;
+
+	Page& page = mPages[region.page];
+	int x = region.rect.left - TEXTURE_ATLAS_PADDING;
+	int y = region.rect.top - TEXTURE_ATLAS_PADDING;
+	int width = region.rect.width + TEXTURE_ATLAS_PADDING * 2;
+
+	//The texture may still be drawn from, so it stays until CollectEmptyPages().  The page
+	//starts over empty meanwhile, and Allocate() clears whatever space it hands out again.
+	if (--page.regions == 0)
+	{
+		page.shelves.clear();
+		page.top = 0;
+		return;
+	}
+
+	for (unsigned int s = 0; s < page.shelves.size(); s++)
+	{
+		Shelf& shelf = page.shelves[s];
+		if (shelf.y != y)
+			continue;
+
+		//Join the freed span with the spans either side of it.
+		std::vector<std::pair<int, int> >& spans = shelf.spans;
+		for (unsigned int i = 0; i < spans.size();)
+		{
+			if (spans[i].first + spans[i].second == x)
+			{
+				x = spans[i].first;
+				width += spans[i].second;
+				spans[i] = spans.back();
+				spans.pop_back();
+			}
+			else if (x + width == spans[i].first)
+			{
+				width += spans[i].second;
+				spans[i] = spans.back();
+				spans.pop_back();
+			}
+			else
+			{
+				i++;
+			}
+		}
+
+		if (x + width == shelf.end)
+			shelf.end = x;
+		else
+			spans.push_back(std::make_pair(x, width));
+
+		break;
+	}
+}
+
+////////////////////////////////////////////////////////////
+void TextureAtlas::CollectEmptyPages()
+{
+	sf::Lock lock(mMutex);
+
+	for (unsigned int i = 0; i < mPages.size(); i++)
+	{
+		if (mPages[i].texture && mPages[i].regions == 0)
+		{
+			delete mPages[i].texture;
+			mPages[i].texture = NULL;
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////
+sf::Texture* TextureAtlas::GetPage(int page)
+{
+	sf::Lock lock(mMutex);
+
+	if (page < 0 || page >= (int)mPages.size())
+		return NULL;
+
+	return mPages[page].texture;
+}
+
+////////////////////////////////////////////////////////////
+bool TextureAtlas::Place(Page& page, int width, int height, int& x, int& y)
+{
+	//Best fitting shelf, so short regions do not eat the tall shelves.
+	int best = -1;
+	int bestSpan = -1;
+	for (unsigned int s = 0; s < page.shelves.size(); s++)
+	{
+		Shelf& shelf = page.shelves[s];
+		if (height > shelf.height || (best >= 0 && shelf.height >= page.shelves[best].height))
+			continue;
+
+		//Shelves much taller than the region waste too much of themselves.
+		if (height < shelf.height / 2)
+			continue;
+
+		int span = -1;
+		for (unsigned int i = 0; i < shelf.spans.size(); i++)
+		{
+			if (shelf.spans[i].second >= width)
+			{
+				span = i;
+				break;
+			}
+		}
+
+		if (span >= 0 || shelf.end + width <= page.size)
+		{
+			best = s;
+			bestSpan = span;
+		}
+	}
+
+	if (best >= 0)
+	{
+		Shelf& shelf = page.shelves[best];
+		y = shelf.y;
+
+		if (bestSpan >= 0)
+		{
+			std::pair<int, int>& span = shelf.spans[bestSpan];
+			x = span.first;
+			span.first += width;
+			span.second -= width;
+			if (span.second == 0)
+			{
+				span = shelf.spans.back();
+				shelf.spans.pop_back();
+			}
+		}
+		else
+		{
+			x = shelf.end;
+			shelf.end += width;
+		}
+
+		return true;
+	}
+
+	if (page.top + height > page.size || width > page.size)
+		return false;
+
+	Shelf shelf;
+	shelf.y = page.top;
+	shelf.height = height;
+	shelf.end = width;
+	page.shelves.push_back(shelf);
+	page.top += height;
+
+	x = 0;
+	y = shelf.y;
+	return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+//Atlas Batch Methods
+//--------------------------------------------------------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////
+void AtlasBatch::Clear()
+{
+	//Groups unused last frame are dropped, their page may have been collected since.
+	unsigned int kept = 0;
+	for (unsigned int i = 0; i < mGroups.size(); i++)
+	{
+		if (mGroups[i].vertices.getVertexCount() == 0)
+			continue;
+
+		if (kept != i)
+			mGroups[kept] = mGroups[i];
+		mGroups[kept].vertices.clear();
+		kept++;
+	}
+
+	mGroups.resize(kept);
+}
+
+////////////////////////////////////////////////////////////
+void AtlasBatch::Add(const sf::Texture* texture, const sf::IntRect& textureRect, const sf::Transform& transform, const sf::Shader* shader)
+{
+	Group* pGroup = NULL;
+	for (unsigned int i = 0; i < mGroups.size() && !pGroup; i++)
+	{
+		if (mGroups[i].texture == texture && mGroups[i].shader == shader)
+			pGroup = &mGroups[i];
+	}
+
+	if (!pGroup)
+	{
+		mGroups.push_back(Group());
+		pGroup = &mGroups.back();
+		pGroup->texture = texture;
+		pGroup->shader = shader;
+		pGroup->vertices.setPrimitiveType(sf::Quads);
+	}
+
+	float width = (float)textureRect.width;
+	float height = (float)textureRect.height;
+	float left = (float)textureRect.left;
+	float top = (float)textureRect.top;
+
+	//Texture coordinates are in pixels, the same as for sf::Sprite.
+	sf::VertexArray& v = pGroup->vertices;
+	v.append(sf::Vertex(transform.transformPoint(0.0f, 0.0f), sf::Vector2f(left, top)));
+	v.append(sf::Vertex(transform.transformPoint(0.0f, height), sf::Vector2f(left, top + height)));
+	v.append(sf::Vertex(transform.transformPoint(width, height), sf::Vector2f(left + width, top + height)));
+	v.append(sf::Vertex(transform.transformPoint(width, 0.0f), sf::Vector2f(left + width, top)));
+}
+
+////////////////////////////////////////////////////////////
+void AtlasBatch::Add(WebInterface* pWeb, const sf::Transform& transform)
+{
+	const sf::Shader* shader = pWeb->GetRenderStates().shader;
+
+	if (!pWeb->IsTiled())
+	{
+		Add(pWeb->GetTexture(), pWeb->GetTextureRect(), transform, shader);
+		return;
+	}
+
+	//Every tile is its own texture, so each gets its own group.
+	for (int i = 0; i < pWeb->GetTileCount(); i++)
+	{
+		sf::IntRect rect = pWeb->GetTileRect(i);
+		sf::Transform tile = transform;
+		tile.translate((float)rect.left, (float)rect.top);
+		Add(pWeb->GetTile(i), sf::IntRect(0, 0, rect.width, rect.height), tile, shader);
+	}
+}
+
+////////////////////////////////////////////////////////////
+void AtlasBatch::Draw(sf::RenderTarget& target, sf::RenderStates states)
+{
+	for (unsigned int i = 0; i < mGroups.size(); i++)
+	{
+		if (mGroups[i].vertices.getVertexCount() == 0)
+			continue;
+
+		states.texture = mGroups[i].texture;
+		states.shader = mGroups[i].shader;
+		target.draw(mGroups[i].vertices, states);
+	}
+}
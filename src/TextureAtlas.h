@@ -0,0 +1,251 @@
+#pragma once
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include <SFML\Graphics.hpp>
+#include <vector>
+
+////////////////////////////////////////////////////////////
+// Pre-processor Definitions
+////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////
+// Default width and height of an atlas page.  Clamped to the
+// largest texture the driver supports.
+//
+////////////////////////////////////////////////////////////
+#ifndef TEXTURE_ATLAS_PAGE_SIZE
+#define TEXTURE_ATLAS_PAGE_SIZE 2048
+#endif
+
+////////////////////////////////////////////////////////////
+// Empty pixels kept around each region so that smooth
+// filtering does not pull in the neighbouring region.
+//
+////////////////////////////////////////////////////////////
+#ifndef TEXTURE_ATLAS_PADDING
+#define TEXTURE_ATLAS_PADDING 1
+#endif
+
+class WebInterface;
+
+////////////////////////////////////////////////////////////
+/// \brief Packs many small images into a few large shared textures.
+///
+/// Each page is one texture, filled with shelves: rows as tall as the first region
+/// placed in them, which later regions of a similar height are packed along.
+/// Freed space on a shelf is reused by regions which fit in it.  A page whose regions
+/// have all been freed keeps its texture until CollectEmptyPages() releases it.
+///
+/// Allocating and freeing are thread safe, the pages themselves are ordinary textures.
+/// Textures are only ever deleted by CollectEmptyPages(), so the thread drawing the pages
+/// decides when they go.
+///
+////////////////////////////////////////////////////////////
+class TextureAtlas
+{
+public:
+	////////////////////////////////////////////////////////////
+	/// \brief A part of a page handed out by Allocate().
+	///
+	////////////////////////////////////////////////////////////
+	struct Region
+	{
+	public:
+		int page;
+		sf::IntRect rect;
+	};
+
+	TextureAtlas();
+	~TextureAtlas();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Sets the size of pages created from now on.
+	///
+	/// \param size		Width and height of a page in pixels.
+	///
+	////////////////////////////////////////////////////////////
+	void SetPageSize(int size);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the size of pages created from now on.
+	///
+	////////////////////////////////////////////////////////////
+	int GetPageSize();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Finds room for an image, creating a page if needed.
+	///
+	/// The region is cleared to transparent.
+	///
+	/// \param width	Width of the image.
+	/// \param height	Height of the image.
+	/// \param region	Receives the page and rect of the image.
+	///
+	/// \return False if the image is too big for a page.
+	///
+	////////////////////////////////////////////////////////////
+	bool Allocate(int width, int height, Region& region);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Gives a region back to the atlas.
+	///
+	/// Can be called from any thread.  The texture of a page left empty is kept, see
+	/// CollectEmptyPages().
+	///
+	/// \param region	Region returned by Allocate().
+	///
+	////////////////////////////////////////////////////////////
+	void Free(const Region& region);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Releases the textures of pages which hold no regions.
+	///
+	/// Only call on the thread which draws the pages, while none of their textures are
+	/// waiting to be drawn.
+	///
+	////////////////////////////////////////////////////////////
+	void CollectEmptyPages();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the texture of a page.
+	///
+	/// \param page		Page of a region.
+	///
+	/// \return The texture, or NULL if the page was emptied and collected.
+	///
+	////////////////////////////////////////////////////////////
+	sf::Texture* GetPage(int page);
+
+private:
+	////////////////////////////////////////////////////////////
+	/// \brief A row of a page.
+	///
+	////////////////////////////////////////////////////////////
+	struct Shelf
+	{
+	public:
+		int y;
+		int height;
+
+		////////////////////////////////////////////////////////////
+		/// \brief Start of the never used space at the end of the shelf.
+		///
+		////////////////////////////////////////////////////////////
+		int end;
+
+		////////////////////////////////////////////////////////////
+		/// \brief Freed spans before end, as (x, width), never touching each other.
+		///
+		////////////////////////////////////////////////////////////
+		std::vector<std::pair<int, int> > spans;
+	};
+
+	////////////////////////////////////////////////////////////
+	/// \brief One texture and its shelves.
+	///
+	////////////////////////////////////////////////////////////
+	struct Page
+	{
+	public:
+		sf::Texture* texture;
+		int size;
+		int regions;
+		int top;
+		std::vector<Shelf> shelves;
+	};
+
+	////////////////////////////////////////////////////////////
+	/// \brief Tries to place a padded image on a page.
+	///
+	/// \return True and the position of the padded image if it fit.
+	///
+	////////////////////////////////////////////////////////////
+	static bool Place(Page& page, int width, int height, int& x, int& y);
+
+	////////////////////////////////////////////////////////////
+	/// \brief The pages.  Their indices never change, emptied pages are reused.
+	///
+	////////////////////////////////////////////////////////////
+	std::vector<Page> mPages;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Size of pages created from now on.
+	///
+	////////////////////////////////////////////////////////////
+	int mPageSize;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Guards the pages and their shelves.
+	///
+	////////////////////////////////////////////////////////////
+	sf::Mutex mMutex;
+};
+
+////////////////////////////////////////////////////////////
+/// \brief Collects textured quads and draws all those sharing a texture in one call.
+///
+/// Meant for WebInterfaces living in the atlas: every interface on the same page is
+/// drawn by a single sf::VertexArray draw, instead of a bind and a draw per sprite.
+/// Refill it each frame with Clear() and Add(), then Draw().
+///
+////////////////////////////////////////////////////////////
+class AtlasBatch
+{
+public:
+	////////////////////////////////////////////////////////////
+	/// \brief Removes all quads, keeping the memory for the next frame.
+	///
+	////////////////////////////////////////////////////////////
+	void Clear();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Adds a rect of a texture, drawn as a quad the size of the rect.
+	///
+	/// \param texture		Texture the rect is taken from.
+	/// \param textureRect	Rect of the texture to draw.
+	/// \param transform	Placement of the quad, e.g. an sf::Sprite's getTransform().
+	/// \param shader		Shader to draw with, quads with different shaders are drawn separately.
+	///
+	////////////////////////////////////////////////////////////
+	void Add(const sf::Texture* texture, const sf::IntRect& textureRect, const sf::Transform& transform, const sf::Shader* shader = NULL);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Adds the texture of a WebInterface, with its render states.
+	///
+	/// Tiled WebInterfaces add a quad per tile.
+	///
+	/// \param pWeb			The WebInterface to draw.
+	/// \param transform	Placement of the WebInterface.
+	///
+	////////////////////////////////////////////////////////////
+	void Add(WebInterface* pWeb, const sf::Transform& transform);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Draws every quad, one call per texture and shader.
+	///
+	/// \param target	Target to draw to.
+	/// \param states	States applied on top of the quads' own transforms.
+	///
+	////////////////////////////////////////////////////////////
+	void Draw(sf::RenderTarget& target, sf::RenderStates states = sf::RenderStates::Default);
+
+private:
+	////////////////////////////////////////////////////////////
+	/// \brief Quads sharing a texture and shader.
+	///
+	////////////////////////////////////////////////////////////
+	struct Group
+	{
+	public:
+		const sf::Texture* texture;
+		const sf::Shader* shader;
+		sf::VertexArray vertices;
+	};
+
+	////////////////////////////////////////////////////////////
+	/// \brief The groups, kept between frames so their vertex arrays keep their memory.
+	///
+	////////////////////////////////////////////////////////////
+	std::vector<Group> mGroups;
+};
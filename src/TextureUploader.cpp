@@ -0,0 +1,508 @@
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include "TextureUploader.h"
+#include <SFML\OpenGL.hpp>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#if defined(SFML_SYSTEM_LINUX)
+#include <GL/glx.h>
+#endif
+
+//--------------------------------------------------------------------------------------------------------------------------
+//OpenGL Definitions
+//--------------------------------------------------------------------------------------------------------------------------
+
+//The OpenGL headers shipped with windows stop at 1.1, so everything newer is declared here.
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+#ifndef GL_BGRA
+#define GL_BGRA 0x80E1
+#endif
+#ifndef GL_PIXEL_UNPACK_BUFFER
+#define GL_PIXEL_UNPACK_BUFFER 0x88EC
+#endif
+#ifndef GL_STREAM_DRAW
+#define GL_STREAM_DRAW 0x88E0
+#endif
+#ifndef GL_WRITE_ONLY
+#define GL_WRITE_ONLY 0x88B9
+#endif
+#ifndef GL_MAP_WRITE_BIT
+#define GL_MAP_WRITE_BIT 0x0002
+#endif
+#ifndef GL_MAP_INVALIDATE_BUFFER_BIT
+#define GL_MAP_INVALIDATE_BUFFER_BIT 0x0008
+#endif
+#ifndef GL_MAP_UNSYNCHRONIZED_BIT
+#define GL_MAP_UNSYNCHRONIZED_BIT 0x0020
+#endif
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#endif
+#ifndef GL_SYNC_FLUSH_COMMANDS_BIT
+#define GL_SYNC_FLUSH_COMMANDS_BIT 0x00000001
+#endif
+#ifndef GL_ALREADY_SIGNALED
+#define GL_ALREADY_SIGNALED 0x911A
+#endif
+#ifndef GL_CONDITION_SATISFIED
+#define GL_CONDITION_SATISFIED 0x911C
+#endif
+
+typedef void (APIENTRY *GenBuffersProc) (GLsizei n, GLuint* buffers);
+typedef void (APIENTRY *DeleteBuffersProc) (GLsizei n, const GLuint* buffers);
+typedef void (APIENTRY *BindBufferProc) (GLenum target, GLuint buffer);
+typedef void (APIENTRY *BufferDataProc) (GLenum target, ptrdiff_t size, const GLvoid* data, GLenum usage);
+typedef void (APIENTRY *BufferStorageProc) (GLenum target, ptrdiff_t size, const GLvoid* data, GLbitfield flags);
+typedef GLvoid* (APIENTRY *MapBufferProc) (GLenum target, GLenum access);
+typedef GLvoid* (APIENTRY *MapBufferRangeProc) (GLenum target, ptrdiff_t offset, ptrdiff_t length, GLbitfield access);
+typedef GLboolean (APIENTRY *UnmapBufferProc) (GLenum target);
+typedef void* (APIENTRY *FenceSyncProc) (GLenum condition, GLbitfield flags);
+typedef GLenum (APIENTRY *ClientWaitSyncProc) (void* sync, GLbitfield flags, sf::Uint64 timeout);
+typedef void (APIENTRY *DeleteSyncProc) (void* sync);
+
+////////////////////////////////////////////////////////////
+// Static variables
+////////////////////////////////////////////////////////////
+static bool sLoaded = false;
+static bool sHasPBO = false;
+static bool sHasSync = false;
+static bool sHasStorage = false;
+
+static GenBuffersProc glGenBuffersPtr = NULL;
+static DeleteBuffersProc glDeleteBuffersPtr = NULL;
+static BindBufferProc glBindBufferPtr = NULL;
+static BufferDataProc glBufferDataPtr = NULL;
+static BufferStorageProc glBufferStoragePtr = NULL;
+static MapBufferProc glMapBufferPtr = NULL;
+static MapBufferRangeProc glMapBufferRangePtr = NULL;
+static UnmapBufferProc glUnmapBufferPtr = NULL;
+static FenceSyncProc glFenceSyncPtr = NULL;
+static ClientWaitSyncProc glClientWaitSyncPtr = NULL;
+static DeleteSyncProc glDeleteSyncPtr = NULL;
+
+////////////////////////////////////////////////////////////
+//Looks up an OpenGL entry point in the current context.
+static void* GetProc(const char* name)
+{
+#if defined(SFML_SYSTEM_WINDOWS)
+	void* proc = (void*)wglGetProcAddress(name);
+
+	//Some drivers hand back small integers instead of NULL for missing functions.
+	if (proc == (void*)1 || proc == (void*)2 || proc == (void*)3 || proc == (void*)-1)
+		return NULL;
+
+	return proc;
+#elif defined(SFML_SYSTEM_LINUX)
+	return (void*)glXGetProcAddress((const GLubyte*)name);
+#else
+	return NULL;
+#endif
+}
+
+////////////////////////////////////////////////////////////
+//Checks the context version against a minimum.
+static bool HasVersion(int major, int minor)
+{
+	const char* version = (const char*)glGetString(GL_VERSION);
+	int haveMajor = 0, haveMinor = 0;
+	if (!version || sscanf(version, "%d.%d", &haveMajor, &haveMinor) != 2)
+		return false;
+
+	return haveMajor > major || (haveMajor == major && haveMinor >= minor);
+}
+
+////////////////////////////////////////////////////////////
+//Checks for a whole word in the extension string.
+static bool HasExtension(const char* name)
+{
+	const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+	if (!extensions)
+		return false;
+
+	size_t length = strlen(name);
+	for (const char* found = strstr(extensions, name); found; found = strstr(found + length, name))
+	{
+		if ((found == extensions || found[-1] == ' ') && (found[length] == ' ' || found[length] == '\0'))
+			return true;
+	}
+
+	return false;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+//Texture Uploader Methods
+//--------------------------------------------------------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////
+TextureUploader::TextureUploader()
+: mBackend(BACKEND_CLIENT)
+, mCurrent(0)
+, mpTexture(NULL)
+, mFormat(FORMAT_RGBA)
+, mpMapped(NULL)
+, mMappedUsed(0)
+, mMappedSize(0)
+{
+	for (int i = 0; i < TEXTURE_UPLOADER_BUFFERS; i++)
+	{
+		mBuffers[i].buffer = 0;
+		mBuffers[i].capacity = 0;
+		mBuffers[i].fence = NULL;
+		mBuffers[i].persistent = NULL;
+	}
+}
+
+////////////////////////////////////////////////////////////
+TextureUploader::~TextureUploader()
+{
+	DestroyBuffers();
+}
+
+////////////////////////////////////////////////////////////
+bool TextureUploader::SetBackend(Backend backend)
+{
+	if (backend == BACKEND_PBO && !IsPBOSupported())
+		backend = BACKEND_CLIENT;
+
+	if (backend != mBackend)
+	{
+		DestroyBuffers();
+		mBackend = backend;
+	}
+
+	return backend == mBackend;
+}
+
+////////////////////////////////////////////////////////////
+bool TextureUploader::IsPBOSupported()
+{
+	LoadFunctions();
+	return sHasPBO;
+}
+
+////////////////////////////////////////////////////////////
+void TextureUploader::Begin(sf::Texture* texture, size_t bytes, Format format)
+{
+	mpTexture = texture;
+	mFormat = format;
+	mpMapped = NULL;
+	mMappedUsed = 0;
+	mMappedSize = 0;
+	mPending.clear();
+
+	if (mBackend == BACKEND_PBO && bytes > 0)
+	{
+		mpMapped = MapBuffer(bytes);
+		mMappedSize = mpMapped ? bytes : 0;
+	}
+}
+
+////////////////////////////////////////////////////////////
+void TextureUploader::Add(const sf::Uint8* pixels, int x, int y, int width, int height)
+{
+	Add(mpTexture, pixels, x, y, width, height);
+}
+
+////////////////////////////////////////////////////////////
+void TextureUploader::Add(sf::Texture* texture, const sf::Uint8* pixels, int x, int y, int width, int height)
+{
+	size_t size = width * height * 4;
+
+	//Without a mapped buffer, or if the caller under counted, fall back to a direct upload.
+	if (!mpMapped)
+	{
+		Update(texture, pixels, x, y, width, height, mFormat);
+		return;
+	}
+	if (mMappedUsed + size > mMappedSize)
+	{
+		//The pointer would be taken as an offset into the bound buffer.
+		glBindBufferPtr(GL_PIXEL_UNPACK_BUFFER, 0);
+		Update(texture, pixels, x, y, width, height, mFormat);
+		glBindBufferPtr(GL_PIXEL_UNPACK_BUFFER, mBuffers[mCurrent].buffer);
+		return;
+	}
+
+	memcpy(mpMapped + mMappedUsed, pixels, size);
+
+	PendingRect pending;
+	pending.texture = texture;
+	pending.x = x;
+	pending.y = y;
+	pending.width = width;
+	pending.height = height;
+	pending.offset = mMappedUsed;
+	mPending.push_back(pending);
+
+	mMappedUsed += size;
+}
+
+////////////////////////////////////////////////////////////
+void TextureUploader::End()
+{
+	if (!mpMapped)
+		return;
+
+	PixelBuffer& buffer = mBuffers[mCurrent];
+
+	if (!buffer.persistent)
+		glUnmapBufferPtr(GL_PIXEL_UNPACK_BUFFER);
+
+	//Keep the binding sfml thinks is current, the same way sf::Texture::update() does.
+	GLint previous = 0;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous);
+
+	//With a buffer bound, the pixel pointer is an offset into it.
+	GLenum format = mFormat == FORMAT_BGRA ? GL_BGRA : GL_RGBA;
+	sf::Texture* bound = NULL;
+	for (unsigned int i = 0; i < mPending.size(); i++)
+	{
+		const PendingRect& r = mPending[i];
+		if (r.texture != bound)
+		{
+			bound = r.texture;
+			sf::Texture::bind(bound);
+		}
+
+		glTexSubImage2D(GL_TEXTURE_2D, 0, r.x, r.y, r.width, r.height, format, GL_UNSIGNED_BYTE,
+			(const GLvoid*)r.offset);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, previous);
+
+	//Everything else sfml uploads comes from client memory, so nothing may stay bound.
+	glBindBufferPtr(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	if (sHasSync)
+	{
+		//MapBuffer() only hands out buffers without a pending fence, this is in case one slipped by.
+		if (buffer.fence)
+			glDeleteSyncPtr(buffer.fence);
+		buffer.fence = glFenceSyncPtr(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	mpMapped = NULL;
+	mPending.clear();
+}
+
+////////////////////////////////////////////////////////////
+void TextureUploader::Update(sf::Texture* texture, const sf::Uint8* pixels, int x, int y, int width, int height, Format format)
+{
+	if (format == FORMAT_RGBA)
+	{
+		texture->update(pixels, width, height, x, y);
+		return;
+	}
+
+	ensureGlContext();
+
+	GLint previous = 0;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous);
+	sf::Texture::bind(texture);
+
+	glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, GL_BGRA, GL_UNSIGNED_BYTE, pixels);
+
+	glBindTexture(GL_TEXTURE_2D, previous);
+}
+
+////////////////////////////////////////////////////////////
+sf::Uint8* TextureUploader::MapBuffer(size_t bytes)
+{
+	ensureGlContext();
+
+	mCurrent = (mCurrent + 1) % TEXTURE_UPLOADER_BUFFERS;
+	PixelBuffer& buffer = mBuffers[mCurrent];
+
+	//Has the gpu finished reading this buffer?  Every batch leaves a fence when sync objects exist,
+	// so then no fence means nothing is pending.  Without them we can not know, so assume not.
+	bool idle = !buffer.fence && (sHasSync || buffer.capacity == 0);
+	if (buffer.fence)
+	{
+		GLenum status = glClientWaitSyncPtr(buffer.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+			buffer.persistent ? TEXTURE_UPLOADER_WAIT : 0);
+		idle = status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+
+		if (idle)
+		{
+			glDeleteSyncPtr(buffer.fence);
+			buffer.fence = NULL;
+		}
+	}
+
+	//Persistent storage can not be orphaned, so if the gpu is stuck on it upload directly.
+	if (buffer.persistent && !idle && bytes <= buffer.capacity)
+		return NULL;
+
+	if (!buffer.buffer)
+		glGenBuffersPtr(1, &buffer.buffer);
+	glBindBufferPtr(GL_PIXEL_UNPACK_BUFFER, buffer.buffer);
+
+	if (bytes > buffer.capacity)
+	{
+		//Grow with some headroom so that a slowly growing damage area does not reallocate every frame.
+		size_t capacity = bytes + bytes / 2;
+
+		//The fence belongs to the old storage.
+		if (buffer.fence)
+		{
+			glDeleteSyncPtr(buffer.fence);
+			buffer.fence = NULL;
+		}
+
+		if (sHasStorage)
+		{
+			//Immutable storage can not be resized, so the old buffer has to go.
+			if (buffer.persistent)
+			{
+				glUnmapBufferPtr(GL_PIXEL_UNPACK_BUFFER);
+				glBindBufferPtr(GL_PIXEL_UNPACK_BUFFER, 0);
+				glDeleteBuffersPtr(1, &buffer.buffer);
+				glGenBuffersPtr(1, &buffer.buffer);
+				glBindBufferPtr(GL_PIXEL_UNPACK_BUFFER, buffer.buffer);
+			}
+
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStoragePtr(GL_PIXEL_UNPACK_BUFFER, capacity, NULL, flags);
+			buffer.persistent = (sf::Uint8*)glMapBufferRangePtr(GL_PIXEL_UNPACK_BUFFER, 0, capacity, flags);
+		}
+		else
+		{
+			glBufferDataPtr(GL_PIXEL_UNPACK_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+		}
+
+		buffer.capacity = capacity;
+		idle = true;
+	}
+
+	if (buffer.persistent)
+		return buffer.persistent;
+
+	//A busy buffer is orphaned below, and its fence belongs to the storage left behind.
+	if (buffer.fence)
+	{
+		glDeleteSyncPtr(buffer.fence);
+		buffer.fence = NULL;
+	}
+
+	sf::Uint8* mapped = NULL;
+	if (glMapBufferRangePtr)
+	{
+		//An idle buffer can be written in place, a busy one is orphaned so the driver swaps in fresh storage.
+		GLbitfield access = GL_MAP_WRITE_BIT | (idle ? GL_MAP_UNSYNCHRONIZED_BIT : GL_MAP_INVALIDATE_BUFFER_BIT);
+		mapped = (sf::Uint8*)glMapBufferRangePtr(GL_PIXEL_UNPACK_BUFFER, 0, bytes, access);
+	}
+	else
+	{
+		if (!idle)
+			glBufferDataPtr(GL_PIXEL_UNPACK_BUFFER, buffer.capacity, NULL, GL_STREAM_DRAW);
+		mapped = (sf::Uint8*)glMapBufferPtr(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+	}
+
+	if (!mapped)
+		glBindBufferPtr(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	return mapped;
+}
+
+////////////////////////////////////////////////////////////
+void TextureUploader::DestroyBuffers()
+{
+	bool any = false;
+	for (int i = 0; i < TEXTURE_UPLOADER_BUFFERS; i++)
+		any = any || mBuffers[i].buffer || mBuffers[i].fence;
+
+	if (!any)
+		return;
+
+	//We may be destroyed on a thread without a context, buffers are shared between sfml's contexts.
+	ensureGlContext();
+
+	for (int i = 0; i < TEXTURE_UPLOADER_BUFFERS; i++)
+	{
+		PixelBuffer& buffer = mBuffers[i];
+
+		if (buffer.fence)
+			glDeleteSyncPtr(buffer.fence);
+
+		if (buffer.persistent)
+		{
+			glBindBufferPtr(GL_PIXEL_UNPACK_BUFFER, buffer.buffer);
+			glUnmapBufferPtr(GL_PIXEL_UNPACK_BUFFER);
+			glBindBufferPtr(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
+
+		if (buffer.buffer)
+			glDeleteBuffersPtr(1, &buffer.buffer);
+
+		buffer.buffer = 0;
+		buffer.capacity = 0;
+		buffer.fence = NULL;
+		buffer.persistent = NULL;
+	}
+}
+
+////////////////////////////////////////////////////////////
+void TextureUploader::LoadFunctions()
+{
+	if (sLoaded)
+		return;
+
+	ensureGlContext();
+	sLoaded = true;
+
+	if (HasVersion(2, 1) || HasExtension("GL_ARB_pixel_buffer_object"))
+	{
+		glGenBuffersPtr = (GenBuffersProc)GetProc("glGenBuffers");
+		glDeleteBuffersPtr = (DeleteBuffersProc)GetProc("glDeleteBuffers");
+		glBindBufferPtr = (BindBufferProc)GetProc("glBindBuffer");
+		glBufferDataPtr = (BufferDataProc)GetProc("glBufferData");
+		glMapBufferPtr = (MapBufferProc)GetProc("glMapBuffer");
+		glUnmapBufferPtr = (UnmapBufferProc)GetProc("glUnmapBuffer");
+
+		//Old drivers only expose the ARB names.
+		if (!glGenBuffersPtr)
+		{
+			glGenBuffersPtr = (GenBuffersProc)GetProc("glGenBuffersARB");
+			glDeleteBuffersPtr = (DeleteBuffersProc)GetProc("glDeleteBuffersARB");
+			glBindBufferPtr = (BindBufferProc)GetProc("glBindBufferARB");
+			glBufferDataPtr = (BufferDataProc)GetProc("glBufferDataARB");
+			glMapBufferPtr = (MapBufferProc)GetProc("glMapBufferARB");
+			glUnmapBufferPtr = (UnmapBufferProc)GetProc("glUnmapBufferARB");
+		}
+
+		sHasPBO = glGenBuffersPtr && glDeleteBuffersPtr && glBindBufferPtr &&
+			glBufferDataPtr && glMapBufferPtr && glUnmapBufferPtr;
+	}
+
+	if (!sHasPBO)
+		return;
+
+	if (HasVersion(3, 0) || HasExtension("GL_ARB_map_buffer_range"))
+		glMapBufferRangePtr = (MapBufferRangeProc)GetProc("glMapBufferRange");
+
+	if (HasVersion(3, 2) || HasExtension("GL_ARB_sync"))
+	{
+		glFenceSyncPtr = (FenceSyncProc)GetProc("glFenceSync");
+		glClientWaitSyncPtr = (ClientWaitSyncProc)GetProc("glClientWaitSync");
+		glDeleteSyncPtr = (DeleteSyncProc)GetProc("glDeleteSync");
+		sHasSync = glFenceSyncPtr && glClientWaitSyncPtr && glDeleteSyncPtr;
+	}
+
+	//Persistent mapping needs map buffer range to map with, and fences to know when to write.
+	if (glMapBufferRangePtr && sHasSync && (HasVersion(4, 4) || HasExtension("GL_ARB_buffer_storage")))
+	{
+		glBufferStoragePtr = (BufferStorageProc)GetProc("glBufferStorage");
+		sHasStorage = glBufferStoragePtr != NULL;
+	}
+}
@@ -0,0 +1,279 @@
+#pragma once
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include <SFML\Graphics\Texture.hpp>
+#include <SFML\Window\GlResource.hpp>
+#include <vector>
+
+////////////////////////////////////////////////////////////
+// Pre-processor Definitions
+////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////
+// Number of pixel buffers each TextureUploader streams through.
+// A buffer is only written again once the gpu has finished
+// reading it, which with three in flight it almost always has.
+//
+////////////////////////////////////////////////////////////
+#ifndef TEXTURE_UPLOADER_BUFFERS
+#define TEXTURE_UPLOADER_BUFFERS 3
+#endif
+
+////////////////////////////////////////////////////////////
+// Longest a persistently mapped buffer is waited on, in
+// nanoseconds, before the batch is uploaded directly instead.
+//
+////////////////////////////////////////////////////////////
+#ifndef TEXTURE_UPLOADER_WAIT
+#define TEXTURE_UPLOADER_WAIT 100000000
+#endif
+
+////////////////////////////////////////////////////////////
+/// \brief Uploads batches of rects to a texture, optionally streaming them through pixel buffer objects.
+///
+/// With BACKEND_CLIENT each rect goes straight to sf::Texture::update(), which makes the driver
+/// copy it out of our memory before the call returns.
+///
+/// With BACKEND_PBO the rects of a batch are written into a pixel buffer object and the texture
+/// updates read from that buffer, so the driver can return immediately and copy on the gpu.
+/// The buffers are used round robin.  Where the driver supports it they are persistently
+/// mapped, otherwise they are mapped for each batch and orphaned if the gpu is still reading.
+/// Fences mark when the gpu is done with a buffer, when sync objects are available.
+///
+/// Everything must happen on the thread which draws, as it needs its OpenGL context.
+///
+////////////////////////////////////////////////////////////
+class TextureUploader : sf::GlResource
+{
+public:
+	////////////////////////////////////////////////////////////
+	/// \brief Ways of getting pixels to the texture.
+	///
+	////////////////////////////////////////////////////////////
+	enum Backend
+	{
+		////////////////////////////////////////////////////////////
+		/// Synchronous uploads from client memory.  Always available, and the default.
+		///
+		////////////////////////////////////////////////////////////
+		BACKEND_CLIENT,
+
+		////////////////////////////////////////////////////////////
+		/// Asynchronous uploads streamed through pixel buffer objects.
+		///
+		////////////////////////////////////////////////////////////
+		BACKEND_PBO
+	};
+
+	////////////////////////////////////////////////////////////
+	/// \brief Channel orders the pixels handed to the uploader can be in.
+	///
+	////////////////////////////////////////////////////////////
+	enum Format
+	{
+		////////////////////////////////////////////////////////////
+		/// What sf::Texture::update() takes.  The default.
+		///
+		////////////////////////////////////////////////////////////
+		FORMAT_RGBA,
+
+		////////////////////////////////////////////////////////////
+		/// What cef paints.  OpenGL reorders the channels while uploading,
+		/// so the pixels can go straight from cef to the texture.
+		///
+		////////////////////////////////////////////////////////////
+		FORMAT_BGRA
+	};
+
+	TextureUploader();
+	~TextureUploader();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Selects how pixels get to the texture.
+	///
+	/// \param backend	The backend to use.
+	///
+	/// \return False if the backend is not supported, in which case BACKEND_CLIENT is used.
+	///
+	////////////////////////////////////////////////////////////
+	bool SetBackend(Backend backend);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns how pixels get to the texture.
+	///
+	////////////////////////////////////////////////////////////
+	Backend GetBackend() const { return mBackend; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Starts a batch of uploads to a texture.
+	///
+	/// \param texture	Texture the batch is uploaded to.
+	/// \param bytes	Total size of all rects which will be added to the batch.
+	/// \param format	Channel order of the pixels of every rect in the batch.
+	///
+	////////////////////////////////////////////////////////////
+	void Begin(sf::Texture* texture, size_t bytes, Format format = FORMAT_RGBA);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Adds a rect of tightly packed pixels to the batch.
+	///
+	/// The pixels are copied before this returns.
+	///
+	/// \param pixels	Pixels of the rect.
+	/// \param x		Horizontal position of the rect on the texture.
+	/// \param y		Vertical position of the rect on the texture.
+	/// \param width	Width of the rect.
+	/// \param height	Height of the rect.
+	///
+	////////////////////////////////////////////////////////////
+	void Add(const sf::Uint8* pixels, int x, int y, int width, int height);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Adds a rect of tightly packed pixels for another texture to the batch.
+	///
+	/// Lets one batch, and one pixel buffer, feed several textures such as the tiles of a view.
+	///
+	/// \param texture	Texture the rect is uploaded to.
+	/// \param pixels	Pixels of the rect.
+	/// \param x		Horizontal position of the rect on the texture.
+	/// \param y		Vertical position of the rect on the texture.
+	/// \param width	Width of the rect.
+	/// \param height	Height of the rect.
+	///
+	////////////////////////////////////////////////////////////
+	void Add(sf::Texture* texture, const sf::Uint8* pixels, int x, int y, int width, int height);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Finishes the batch, issuing any texture updates which are still outstanding.
+	///
+	////////////////////////////////////////////////////////////
+	void End();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Updates a rect of a texture right away, like sf::Texture::update() but in either format.
+	///
+	/// Can be called from any thread.
+	///
+	/// \param texture	Texture to update.
+	/// \param pixels	Tightly packed pixels of the rect.
+	/// \param x		Horizontal position of the rect on the texture.
+	/// \param y		Vertical position of the rect on the texture.
+	/// \param width	Width of the rect.
+	/// \param height	Height of the rect.
+	/// \param format	Channel order of the pixels.
+	///
+	////////////////////////////////////////////////////////////
+	static void Update(sf::Texture* texture, const sf::Uint8* pixels, int x, int y, int width, int height, Format format);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Checks whether the driver can stream through pixel buffer objects.
+	///
+	/// \return True if BACKEND_PBO can be used.
+	///
+	////////////////////////////////////////////////////////////
+	static bool IsPBOSupported();
+
+private:
+	////////////////////////////////////////////////////////////
+	/// \brief A rect waiting in the mapped buffer for its texture update.
+	///
+	////////////////////////////////////////////////////////////
+	struct PendingRect
+	{
+	public:
+		sf::Texture* texture;
+		int x;
+		int y;
+		int width;
+		int height;
+		size_t offset;
+	};
+
+	////////////////////////////////////////////////////////////
+	/// \brief One pixel buffer object and what we know about it.
+	///
+	////////////////////////////////////////////////////////////
+	struct PixelBuffer
+	{
+	public:
+		unsigned int buffer;
+		size_t capacity;
+		void* fence;
+		sf::Uint8* persistent;
+	};
+
+	////////////////////////////////////////////////////////////
+	/// \brief Maps the next buffer with room for the given number of bytes.
+	///
+	/// \return Pointer to write to, or NULL if the batch has to be uploaded directly.
+	///
+	////////////////////////////////////////////////////////////
+	sf::Uint8* MapBuffer(size_t bytes);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Deletes the buffers and their fences.
+	///
+	////////////////////////////////////////////////////////////
+	void DestroyBuffers();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Loads the OpenGL entry points needed for pixel buffer objects, once.
+	///
+	////////////////////////////////////////////////////////////
+	static void LoadFunctions();
+
+	////////////////////////////////////////////////////////////
+	/// \brief How pixels get to the texture.
+	///
+	////////////////////////////////////////////////////////////
+	Backend mBackend;
+
+	////////////////////////////////////////////////////////////
+	/// \brief The buffers streamed through.
+	///
+	////////////////////////////////////////////////////////////
+	PixelBuffer mBuffers[TEXTURE_UPLOADER_BUFFERS];
+
+	////////////////////////////////////////////////////////////
+	/// \brief Index of the buffer used by the current batch.
+	///
+	////////////////////////////////////////////////////////////
+	int mCurrent;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Texture of the current batch, for rects added without one.
+	///
+	////////////////////////////////////////////////////////////
+	sf::Texture* mpTexture;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Channel order of the current batch.
+	///
+	////////////////////////////////////////////////////////////
+	Format mFormat;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Where the current batch is written, or NULL if it goes straight to the texture.
+	///
+	////////////////////////////////////////////////////////////
+	sf::Uint8* mpMapped;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Bytes of the mapped buffer used so far.
+	///
+	////////////////////////////////////////////////////////////
+	size_t mMappedUsed;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Bytes the mapped buffer has room for.
+	///
+	////////////////////////////////////////////////////////////
+	size_t mMappedSize;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Rects written to the mapped buffer.  Emptied with clear() to keep its capacity.
+	///
+	////////////////////////////////////////////////////////////
+	std::vector<PendingRect> mPending;
+};
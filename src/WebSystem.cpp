@@ -3,6 +3,10 @@
 // Headers
 ////////////////////////////////////////////////////////////
 #include "WebSystem.h"
+#include "PixelConverter.h"
+#include <cassert>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <utility>
 
@@ -16,10 +20,35 @@ CefRefPtr<WebApp> WebSystem::sApp = NULL;
 CefRefPtr<WebSystem> WebSystem::sInstance = NULL;
 sf::Thread* WebSystem::spThread = NULL;
 bool WebSystem::sEndThread = false;
-std::queue<WebSystem::RegScheme> WebSystem::sRegSchemeQueue;
-std::queue<WebInterface*> WebSystem::sMakeWebInterfaceQueue;
-std::map<int, WebInterface*> WebSystem::sWebInterfaces;
+WebSystem::ThreadMode WebSystem::sThreadMode = WebSystem::THREAD_ADAPTIVE;
+HANDLE WebSystem::sWakeEvent = NULL;
+sf::Clock WebSystem::sActivityClock;
+CommandQueue WebSystem::sCommands;
+std::vector<WebCommand> WebSystem::sCommandBatch;
+unsigned long WebSystem::sWebThreadId = 0;
+std::queue<WebSystem::SnapshotRequest> WebSystem::sSnapshotQueue;
+std::vector<CefRefPtr<WebInterface> > WebSystem::sSnapshotReleases;
+sf::Mutex WebSystem::sSnapshotMutex;
+sf::Thread* WebSystem::spSnapshotThread = NULL;
+HANDLE WebSystem::sSnapshotEvent = NULL;
+std::vector<CefRefPtr<CefBrowser> > WebSystem::sBrowserPool;
+int WebSystem::sPoolPending = 0;
+int WebSystem::sPoolSize = 0;
+WebInterfaceSpec WebSystem::sPoolSpec(0, 0, "about:blank", false);
+sf::Mutex WebSystem::sPoolMutex;
+InterfaceRegistry WebSystem::sWebInterfaces;
+std::vector<WebInterface*> WebSystem::sReleasedInterfaces;
+bool WebSystem::sDeferInterfaceDeletes = false;
+sf::Mutex WebSystem::sReleasedMutex;
 WebSystem::BindingMap WebSystem::sBindings;
+WebSystem::BindingMap WebSystem::sRendererBindings;
+std::vector<WebSystem::BoundCallback> WebSystem::sBindingCallbacks;
+std::vector<int> WebSystem::sFreeBindings;
+sf::Mutex WebSystem::sBindingMutex;
+TextureAtlas WebSystem::sAtlas;
+InputState WebSystem::sInputState;
+sf::Shader* WebInterface::spPremultipliedShader = NULL;
+bool WebInterface::sPremultipliedShaderLoaded = false;
 
 ////////////////////////////////////////////////////////////
 //These functions are taken / some slightly modified from cefclient2010 example code.  
@@ -152,409 +181,1276 @@ void WebSystem::WebThread()
 
 	CefInitialize(sArgs, settings, sApp.get());
 
+	sWebThreadId = GetCurrentThreadId();
+
 	while (!sEndThread)
 	{
+		//Messages waiting for cef mean something is going on, input, paints or loading.
+		if (HIWORD(GetQueueStatus(QS_ALLINPUT)))
+			sActivityClock.restart();
+
 		CefDoMessageLoopWork();
 
-		while (sRegSchemeQueue.size() > 0)
-		{
-			CefRegisterSchemeHandlerFactory(sRegSchemeQueue.front().mName, sRegSchemeQueue.front().mDomain, sRegSchemeQueue.front().mFactory);
-			sRegSchemeQueue.pop();
-		}
+		bool throttled = FlushThrottledPaints();
 
-		while (sMakeWebInterfaceQueue.size() > 0)
-		{
-			GetInstance()->AddBrowserToInterface(sMakeWebInterfaceQueue.front());
-			sMakeWebInterfaceQueue.pop();
-		}
+		HidePrerendered();
+
+		if (RunCommands())
+			sActivityClock.restart();
+
+		//Held back paints are checked every millisecond, so they are not let through late.
+		WaitForWork(throttled ? 1 : WEB_THREAD_MAX_WAIT);
 	}
 
+	//Spares have no WebInterface to close them.
+	for (unsigned int i = 0; i < sBrowserPool.size(); i++)
+		sBrowserPool[i]->GetHost()->CloseBrowser(true);
+	sBrowserPool.clear();
+
 	//WE SHOULD PROBABLY CHECK IF THERE ARE STILL LIVE BROWSERS HERE
 
 	CefShutdown();
 }
 
 ////////////////////////////////////////////////////////////
-void WebSystem::AddBrowserToInterface(WebInterface* pWeb)
+bool WebSystem::FlushThrottledPaints()
 {
-	AutoLock lock_scope(this);
-	CefWindowInfo info;
-	info.SetTransparentPainting(pWeb->IsTransparent());
-	info.SetAsOffScreen(pWeb->mHandle); //We're drawing offscreen so pass NULL as the window handler.  
-	CefBrowserSettings browserSettings;
-	//browserSettings.javascript_access_clipboard = STATE_ENABLED;
+	bool held = false;
 
+	InterfaceRegistry::Iterator i(sWebInterfaces);
+	while (WebInterface* pWeb = i.Next())
+	{
+		if (!pWeb->mVisible || !pWeb->mBrowser)
+			continue;
 
-	CefRefPtr<CefBrowser> browser = CefBrowserHost::CreateBrowserSync(info, this, pWeb->GetCurrentURL(), browserSettings);
-
-	pWeb->mBrowser = browser;
-
-	sWebInterfaces[browser->GetIdentifier()] = pWeb;
-}
+		//Paint() changes the held back damage under the same lock.
+		CefRect bounds;
+		{
+			sf::Lock lock(pWeb->mMutex);
 
-//--------------------------------------------------------------------------------------------------------------------------
-//API Methods
-//--------------------------------------------------------------------------------------------------------------------------
+			if (pWeb->mThrottledDamage.IsEmpty() || pWeb->mThrottleInvalidated)
+				continue;
 
-////////////////////////////////////////////////////////////
-int WebSystem::Main()
-{
-#if(PLATFORM == WINDOWS)
-	sArgs = CefMainArgs(GetModuleHandle(NULL));
-#else
-	sArgs = CefMainArgs();
-#endif
-	sApp = new WebApp();
+			if (!pWeb->IsPaintDue())
+			{
+				held = true;
+				continue;
+			}
 
-	int exit_code = CefExecuteProcess(sArgs, sApp.get());
+			bounds = pWeb->mThrottledDamage.GetBounds();
+			pWeb->mThrottleInvalidated = true;
+		}
 
-	if (exit_code >= 0)
-	{
-		return exit_code;
+		//The paint this causes is let through and applies all of the held back damage.
+		pWeb->mBrowser->GetHost()->Invalidate(bounds, PET_VIEW);
 	}
 
-	return -1;
+	return held;
 }
 
 ////////////////////////////////////////////////////////////
-void WebSystem::StartWeb()
+void WebSystem::PostCommand(const WebCommand& command)
 {
-	if (!spThread)
+	if (sWebThreadId && GetCurrentThreadId() == sWebThreadId)
 	{
-		spThread = new sf::Thread(&WebThread);
-
-		sEndThread = false;
-		spThread->launch();
+		RunCommand(command);
+		return;
 	}
-}
 
-////////////////////////////////////////////////////////////
-void WebSystem::EndWeb()
-{
-	sEndThread = true;
-}
+	//A WebInterface found through sWebInterfaces may be on its way to being deleted.
+	if (command.pWeb && !command.pWeb->TryAddRef())
+		return;
 
-////////////////////////////////////////////////////////////
-void WebSystem::WaitForWebEnd()
-{
-	if (spThread)
+	while (!sCommands.Push(command))
 	{
-		spThread->wait();
-
-		delete spThread;
-		spThread = NULL;
+		//The cef thread has fallen a whole queue behind, let it catch up.
+		WakeWebThread();
+		Sleep(0);
 	}
-}
 
-////////////////////////////////////////////////////////////
-void WebSystem::RegisterScheme(std::string name, std::string domain, CefRefPtr<CefSchemeHandlerFactory> factory)
-{
-	sRegSchemeQueue.push(RegScheme(name, domain, factory));
+	WakeWebThread();
 }
 
 ////////////////////////////////////////////////////////////
-WebInterface* WebSystem::CreateWebInterfaceSync(int width, int height, const std::string& url, bool transparent, sf::WindowHandle handle)
+bool WebSystem::RunCommands()
 {
-	WebInterface* pWeb = new WebInterface(width, height, url, transparent, handle);
+	sCommandBatch.clear();
+	if (!sCommands.PopBatch(sCommandBatch, sCommands.GetCapacity()))
+		return false;
 
-	sMakeWebInterfaceQueue.push(pWeb);
-
-	while (!pWeb->mBrowser)
+	for (unsigned int i = 0; i < sCommandBatch.size(); i++)
 	{
-		//Sleep for one millisecond to prevent 100% CPU usage.
-		//There is probably a more elegant solution for this.
-		Sleep(1); 
+		RunCommand(sCommandBatch[i]);
+
+		if (sCommandBatch[i].pWeb)
+			sCommandBatch[i].pWeb->Release();
 	}
 
-	return pWeb;
+	//Do not hold on to frames, factories or strings until the next batch.
+	sCommandBatch.clear();
+	return true;
 }
 
-//////////////////////////////////////////////////////////// 
-void WebSystem::UpdateInterfaceTextures()
+////////////////////////////////////////////////////////////
+void WebSystem::RunCommand(const WebCommand& command)
 {
-	std::map<int, WebInterface*>::iterator i;
-	for (i = sWebInterfaces.begin(); i != sWebInterfaces.end(); i++)
+	if (command.type == WebCommand::COMMAND_REGISTER_SCHEME)
 	{
-		i->second->UpdateTexture();
+		CefRegisterSchemeHandlerFactory(command.text, command.target, command.factory);
+		return;
 	}
-}
 
-//--------------------------------------------------------------------------------------------------------------------------
-//Methods called by CEF
-//--------------------------------------------------------------------------------------------------------------------------
+	if (command.type == WebCommand::COMMAND_CREATE_BROWSER)
+	{
+		GetInstance()->AddBrowserToInterface(command.pWeb);
+		return;
+	}
 
-////////////////////////////////////////////////////////////
-void WebSystem::OnBrowserCreated(CefRefPtr<CefBrowser> browser)
-{
-	//Send all JsBindings
-	BindingMap::iterator i = sBindings.begin();
-	for (; i != sBindings.end(); i++)
+	if (command.type == WebCommand::COMMAND_FILL_POOL)
 	{
-		if (i->first.second == browser->GetIdentifier())
+		if (command.flag)
 		{
-			CefRefPtr<CefProcessMessage> message = CefProcessMessage::Create("jsbinding_create");
-			message->GetArgumentList()->SetString(0, i->first.first);
-			message->GetArgumentList()->SetInt(1, i->first.second);
-
-			browser->SendProcessMessage(PID_RENDERER, message);
+			for (unsigned int i = 0; i < sBrowserPool.size(); i++)
+				sBrowserPool[i]->GetHost()->CloseBrowser(true);
+			sBrowserPool.clear();
 		}
+
+		FillPool();
+		return;
 	}
-}
 
-////////////////////////////////////////////////////////////
-void WebSystem::OnBrowserDestroyed(CefRefPtr<CefBrowser> browser)
-{
-	BindingMap::iterator i = sBindings.begin();
-	for (; i != sBindings.end();)
+	if (command.type == WebCommand::COMMAND_CLOSE)
 	{
-		if (i->first.second == browser->GetIdentifier())
-			sBindings.erase(i++);
-		else
-			++i;
+		RecycleBrowser(command.pWeb, command.flag);
+		return;
 	}
-}
 
-////////////////////////////////////////////////////////////
-void WebSystem::OnContextCreated(CefRefPtr<CefBrowser> browser, CefRefPtr<CefFrame> frame, CefRefPtr<CefV8Context> context)
-{
-	//Retrieve the context's window object.
-	CefRefPtr<CefV8Value> object = context->GetGlobal();
+	if (command.type == WebCommand::COMMAND_FLUSH_INPUT)
+	{
+		RunInput(command.pWeb);
+		return;
+	}
 
-	//Create a new callback handler.
-	CefRefPtr<CefV8Handler> handler = new WebV8Handler();
+	//Everything else goes to the browser of the interface, which may have closed since.
+	CefRefPtr<CefBrowser> browser = command.pWeb->mBrowser;
+	if (!browser)
+		return;
 
-	//Setup bindings for that web interface.	
-	BindingMap::iterator i = sBindings.begin();
-	for (; i != sBindings.end(); i++)
+	CefRefPtr<CefBrowserHost> host = browser->GetHost();
+	switch (command.type)
 	{
-		if (i->first.second == browser->GetIdentifier())
+	case WebCommand::COMMAND_FOCUS:
+		host->SendFocusEvent(command.flag);
+		break;
+	case WebCommand::COMMAND_MOUSE_CLICK:
+		host->SendMouseMoveEvent(command.mouse, false);
+		host->SendMouseClickEvent(command.mouse, command.button, command.flag, command.clicks);
+		break;
+	case WebCommand::COMMAND_MOUSE_MOVE:
+		host->SendMouseMoveEvent(command.mouse, command.flag);
+		break;
+	case WebCommand::COMMAND_MOUSE_WHEEL:
+		host->SendMouseWheelEvent(command.mouse, command.deltaX, command.deltaY);
+		break;
+	case WebCommand::COMMAND_KEY:
+		host->SendKeyEvent(command.key);
+		break;
+	case WebCommand::COMMAND_EXECUTE_JS:
 		{
-			CefRefPtr<CefV8Value> func = CefV8Value::CreateFunction(i->first.first, handler);
-
-			object->SetValue(i->first.first, func, V8_PROPERTY_ATTRIBUTE_NONE);
+			CefRefPtr<CefFrame> frame = command.frame ? command.frame : browser->GetMainFrame();
+			frame->ExecuteJavaScript(command.text, frame->GetURL(), command.line);
 		}
+		break;
+	case WebCommand::COMMAND_RESIZE:
+		host->WasResized();
+		break;
+	case WebCommand::COMMAND_INVALIDATE:
+		host->Invalidate(command.rect, PET_VIEW);
+		break;
+	case WebCommand::COMMAND_SET_HIDDEN:
+		host->WasHidden(command.flag);
+		break;
+	case WebCommand::COMMAND_ADD_BINDINGS:
+		command.pWeb->SendBindings();
+		break;
+	default:
+		break;
 	}
 }
 
 ////////////////////////////////////////////////////////////
-void WebSystem::OnContextReleased(CefRefPtr< CefBrowser > browser, CefRefPtr< CefFrame > frame, CefRefPtr< CefV8Context > context)
+void WebSystem::HidePrerendered()
 {
+	InterfaceRegistry::Iterator i(sWebInterfaces);
+	while (WebInterface* pWeb = i.Next())
+	{
+		if (!pWeb->mPrerenderHide || !pWeb->mBrowser)
+			continue;
 
-}
+		pWeb->mPrerenderHide = false;
 
-////////////////////////////////////////////////////////////
-void WebSystem::OnUncaughtException(CefRefPtr< CefBrowser > browser, CefRefPtr< CefFrame > frame, CefRefPtr< CefV8Context > context, CefRefPtr< CefV8Exception > exception, CefRefPtr< CefV8StackTrace > stackTrace)
-{
+		//Already swapped in, and shown for good.
+		if (!pWeb->mPrerender)
+			continue;
 
+		pWeb->mBrowser->GetHost()->WasHidden(true);
+	}
 }
 
 ////////////////////////////////////////////////////////////
-void WebSystem::OnRenderProcessThreadCreated(CefRefPtr<CefListValue> extra_info)
+void WebSystem::WaitForWork(unsigned int timeout)
 {
+	if (sThreadMode == THREAD_SPIN)
+		return;
+
+	if (sThreadMode == THREAD_ADAPTIVE && sActivityClock.getElapsedTime() < sf::milliseconds(WEB_THREAD_SPIN_TIME))
+		return;
 
+	//Cef's work arrives as messages to this thread, both posted tasks and its timers, so wait on
+	//those as well as our own event.  Messages already seen but left in the queue count too.
+	MsgWaitForMultipleObjectsEx(1, &sWakeEvent, timeout, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
 }
 
 ////////////////////////////////////////////////////////////
-bool WebSystem::OnProcessMessageReceived(CefRefPtr<CefBrowser> browser, CefProcessId source_process, CefRefPtr<CefProcessMessage> message)
+void WebSystem::AddBrowserToInterface(WebInterface* pWeb)
 {
-	CefString message_name = message->GetName();
+	AutoLock lock_scope(this);
+	CefWindowInfo info;
+	info.SetTransparentPainting(pWeb->IsTransparent());
+	info.SetAsOffScreen(pWeb->mHandle); //We're drawing offscreen so pass NULL as the window handler.  
+	CefBrowserSettings browserSettings;
+	//browserSettings.javascript_access_clipboard = STATE_ENABLED;
 
-	//Identify whether we are in the browser process or the render process.
-	if (CefCurrentlyOn(TID_RENDERER))
+	//Take a spare if there is one.  It only has to be shown and pointed at the url.
+	if (IsPoolable(pWeb) && !sBrowserPool.empty())
 	{
-		//Renderer
-		if (message_name == "jsbinding_create")
-		{
-			std::string name = message->GetArgumentList()->GetString(0);
+		CefRefPtr<CefBrowser> browser = sBrowserPool.back();
+		sBrowserPool.pop_back();
 
-			sBindings.insert(std::make_pair(
-				std::make_pair(name, message->GetArgumentList()->GetInt(1)), 
-				(JsBinding::JsCallback)NULL));
-
-			browser->Reload();
+		AttachBrowser(pWeb, browser);
+		if (pWeb->IsVisible())
+			browser->GetHost()->WasHidden(false);
+		browser->GetMainFrame()->LoadURL(pWeb->GetCurrentURL());
 
-			return true;
-		}
+		FillPool();
+		return;
 	}
-	else
+
+	//Returns right away, the browser arrives in OnAfterCreated() along with its client.
+	CefBrowserHost::CreateBrowser(info, new WebBrowserClient(pWeb), pWeb->GetCurrentURL(), browserSettings);
+}
+
+////////////////////////////////////////////////////////////
+void WebSystem::AttachBrowser(WebInterface* pWeb, CefRefPtr<CefBrowser> browser)
+{
+	//Bindings added from now on can be sent as soon as their command runs.
 	{
-		//Browser
-		if (message_name == "jsbinding_call")
-		{
-			if (sWebInterfaces.count(browser->GetIdentifier()))
-			{
-				WebInterface* pWeb = sWebInterfaces[browser->GetIdentifier()];
+		sf::Lock lock(pWeb->mMutex);
+		pWeb->mBrowser = browser;
+	}
+	sWebInterfaces.Add(browser->GetIdentifier(), pWeb);
 
-				std::string name;
-				CefRefPtr<CefListValue> arguments = CefListValue::Create();
-				CefRefPtr<CefV8Value> retval;
-				CefString exception;
+	//The browser asked for its size before it was known to be ours.
+	browser->GetHost()->WasResized();
 
-				CefRefPtr<CefListValue> margs = message->GetArgumentList();
-				name = margs->GetString(0);
-				int argCount = margs->GetInt(1);
-				std::string test = margs->GetString(2);
-				for (int i = 0; i < argCount; i++)
-				{
-					CefValueType type = margs->GetType(i + 2);
-					switch (type) {
-					case VTYPE_LIST: {
-						CefRefPtr<CefListValue> list = margs->GetList(i + 2);
-						arguments->SetList(i, list);
-					} break;
-					case VTYPE_BOOL: {
-						bool b = margs->GetBool(i + 2);
-						arguments->SetBool(i, b);
-					} break;
-					case VTYPE_DOUBLE: {
-						double d = margs->GetDouble(i + 2);
-						arguments->SetDouble(i, d);
-					} break;
-					case VTYPE_INT: {
-						int integer = margs->GetInt(i + 2);
-						arguments->SetInt(i, integer);
-					} break;
-					case VTYPE_STRING: {
-						std::string s = margs->GetString(i + 2);
-						arguments->SetString(i, s);
-					} break;
-					default:
-						break;
-					}
-				}
+	//The interface may have been hidden before it had a browser to tell.
+	if (!pWeb->IsVisible())
+		browser->GetHost()->WasHidden(true);
 
-				pWeb->JSCallback(name, arguments);
+	//Prerendered pages get the bindings of the interface they will replace.  This reloads the
+	//page, which has barely started loading.
+	if (pWeb->mpBindingSource)
+	{
+		CefRefPtr<CefBrowser> source = pWeb->mpBindingSource->mBrowser;
+		pWeb->mpBindingSource = NULL;
 
-				return true;
+		std::vector<JsBinding> bindings;
+		if (source)
+		{
+			sf::Lock lock(sBindingMutex);
+
+			BindingMap::iterator i = sBindings.begin();
+			for (; i != sBindings.end(); i++)
+			{
+				if (i->first.second == source->GetIdentifier())
+					bindings.push_back(JsBinding(i->first.first, sBindingCallbacks[i->second & BINDING_SLOT_MASK].mfpCallback));
 			}
 		}
+
+		sf::Lock lock(pWeb->mMutex);
+		pWeb->mPendingBindings.insert(pWeb->mPendingBindings.end(), bindings.begin(), bindings.end());
 	}
 
-	return false;
+	//Those added before the browser existed go along with the prerender ones, in one reload.
+	pWeb->SendBindings();
+
+	if (pWeb->mfpCreatedCallback)
+		pWeb->mfpCreatedCallback(pWeb);
 }
 
 ////////////////////////////////////////////////////////////
-void WebSystem::OnLoadStart(CefRefPtr<CefBrowser> browser, CefRefPtr<CefFrame> frame)
+bool WebSystem::IsPoolable(WebInterface* pWeb)
 {
+	sf::Lock lock(sPoolMutex);
 
+	return sPoolSize > 0 && pWeb->IsTransparent() == sPoolSpec.mTransparent && pWeb->mHandle == sPoolSpec.mHandle;
 }
 
 ////////////////////////////////////////////////////////////
-void WebSystem::OnLoadEnd(CefRefPtr<CefBrowser> browser, CefRefPtr<CefFrame> frame, int httpStatusCode)
+void WebSystem::FillPool()
 {
+	int size;
+	WebInterfaceSpec spec(0, 0, "", false);
+	{
+		sf::Lock lock(sPoolMutex);
+		size = sPoolSize;
+		spec = sPoolSpec;
+	}
 
-}
+	while ((int)sBrowserPool.size() + sPoolPending > size && !sBrowserPool.empty())
+	{
+		sBrowserPool.back()->GetHost()->CloseBrowser(true);
+		sBrowserPool.pop_back();
+	}
 
-////////////////////////////////////////////////////////////
-void WebSystem::OnAfterCreated(CefRefPtr<CefBrowser> browser)
-{
-	AutoLock lock_scope(this);
-}
+	CefWindowInfo info;
+	info.SetTransparentPainting(spec.mTransparent);
+	info.SetAsOffScreen(spec.mHandle);
+	CefBrowserSettings browserSettings;
 
-////////////////////////////////////////////////////////////
-void WebSystem::OnBeforeClose(CefRefPtr<CefBrowser> browser)
-{
-	AutoLock lock_scope(this);
+	while ((int)sBrowserPool.size() + sPoolPending < size)
+	{
+		if (!CefBrowserHost::CreateBrowser(info, new WebBrowserClient(NULL), "about:blank", browserSettings))
+			break;
 
-	//Free the browser pointer so that the browser can be destroyed.
-	if (sWebInterfaces.count(browser->GetIdentifier()))
-		sWebInterfaces[browser->GetIdentifier()]->ClearBrowser();
+		sPoolPending++;
+	}
 }
 
 ////////////////////////////////////////////////////////////
-bool WebSystem::GetViewRect(CefRefPtr<CefBrowser> browser, CefRect &rect)
+void WebSystem::RecycleBrowser(WebInterface* pWeb, bool force)
 {
-	if (!sWebInterfaces.count(browser->GetIdentifier()))
+	CefRefPtr<CefBrowser> browser = pWeb->mBrowser;
+	if (!browser)
+		return;
+
+	int size;
 	{
-		rect = CefRect();
-		return true;
+		sf::Lock lock(sPoolMutex);
+		size = sPoolSize;
 	}
-	WebInterface* pWeb = sWebInterfaces[browser->GetIdentifier()];
-	if (!pWeb)
+
+	if (!IsPoolable(pWeb) || (int)sBrowserPool.size() + sPoolPending >= size)
 	{
-		rect = CefRect();
-		return true;
+		browser->GetHost()->CloseBrowser(force);
+		return;
 	}
 
-	rect = CefRect(0, 0, pWeb->GetWidth(), pWeb->GetHeight());
-	return true;
+	//Cut the browser loose from the interface.  It gets no more paints, input or binding calls.
+	int id = browser->GetIdentifier();
+	sWebInterfaces.Remove(id);
+	pWeb->ClearBrowser();
+	ClearBindings(id);
+
+	CefRefPtr<CefProcessMessage> message = CefProcessMessage::Create("jsbinding_clear");
+	message->GetArgumentList()->SetInt(0, id);
+	browser->SendProcessMessage(PID_RENDERER, message);
+
+	//Leave the page, which also drops its javascript context, and wait out of sight.
+	browser->StopLoad();
+	browser->GetHost()->SendFocusEvent(false);
+	browser->GetHost()->WasHidden(true);
+	browser->GetMainFrame()->LoadURL("about:blank");
+
+	sBrowserPool.push_back(browser);
 }
 
 ////////////////////////////////////////////////////////////
-void WebSystem::OnPaint(CefRefPtr<CefBrowser> browser, PaintElementType type, const RectList& dirtyRects, const void* buffer, int width, int height)
+int WebSystem::InternBinding(const std::string& name, int browser, JsBinding::JsCallback callback)
 {
-	////Get the web interface we will be working with. 
-	if (!sWebInterfaces.count(browser->GetIdentifier())) return;
-	WebInterface* pWeb = sWebInterfaces[browser->GetIdentifier()];
-	if (!pWeb)
-		return;
+	sf::Lock lock(sBindingMutex);
 
-	if (!buffer)
-		return;
+	//A name already bound keeps its callback, as it did when bindings were found by name.
+	std::pair<BindingMap::iterator, bool> result = sBindings.insert(std::make_pair(std::make_pair(name, browser), 0));
+	if (!result.second)
+		return result.first->second;
 
-	if (type == PET_VIEW)
+	int slot;
+	if (!sFreeBindings.empty())
+	{
+		slot = sFreeBindings.back();
+		sFreeBindings.pop_back();
+		sBindingCallbacks[slot].mGeneration = (sBindingCallbacks[slot].mGeneration + 1) & BINDING_GENERATION_MASK;
+	}
+	else
 	{
-		int old_width = pWeb->mTextureWidth;
-		int old_height = pWeb->mTextureHeight;
+		slot = (int)sBindingCallbacks.size();
+		sBindingCallbacks.push_back(BoundCallback());
+		sBindingCallbacks[slot].mGeneration = 0;
+	}
+
+	BoundCallback& bound = sBindingCallbacks[slot];
+	bound.mfpCallback = callback;
+	bound.mBrowser = browser;
 
-		//Retrieve current size of browser view.
-		pWeb->mTextureWidth = width;
-		pWeb->mTextureHeight = height;
+	result.first->second = (bound.mGeneration << BINDING_SLOT_BITS) | slot;
+	return result.first->second;
+}
+
+////////////////////////////////////////////////////////////
+void WebSystem::ClearBindings(int browser)
+{
+	sf::Lock lock(sBindingMutex);
 
-		//Check if we need to resize the texture before drawing to it.
-		if (old_width != pWeb->mTextureWidth || old_height != pWeb->mTextureHeight)
+	BindingMap::iterator i = sBindings.begin();
+	for (; i != sBindings.end();)
+	{
+		if (i->first.second == browser)
 		{
-			//This literally has never been called since the creation of this project, thus 
-			//it was never updated, and the outdated code has now been removed.
-			//printf("Called resize code in onpaint.\n");
+			//Every ID in sBindings was given a slot by InternBinding().  The render process keeps
+			//its IDs in sRendererBindings, so nothing here is ever freed twice.
+			int slot = i->second & BINDING_SLOT_MASK;
+			assert(slot < (int)sBindingCallbacks.size());
+
+			//The render process may still send the ID, which the next generation of the slot refuses.
+			sBindingCallbacks[slot].mfpCallback = NULL;
+			sBindingCallbacks[slot].mBrowser = 0;
+			sFreeBindings.push_back(slot);
+			sBindings.erase(i++);
 		}
 		else
-		{
-			//We want to work on the buffer byte by byte so get a pointer with a new type.
-			char* bitmap = (char*)(buffer);
+			++i;
+	}
+}
 
-			sf::Lock lock(pWeb->mMutex);
-			//Update the dirty rectangles.
-			CefRenderHandler::RectList::const_iterator i = dirtyRects.begin();
-			for (; i != dirtyRects.end(); ++i)
-			{
-				const CefRect& rect = *i;
-				//Create a rect sized buffer for the new rectangle data.
-				char* rectBuffer = new char[rect.width * (rect.height + 1) * BYTES_PER_PIXEL];
+////////////////////////////////////////////////////////////
+void WebSystem::EraseRendererBindings(int browser)
+{
+	sf::Lock lock(sBindingMutex);
 
-				for (int jj = 0; jj < rect.height; jj++)
-				{
-					//Copy the new rectangle data out of the full size buffer into our rect sized one.  
-					memcpy(
-						rectBuffer + jj * rect.width * BYTES_PER_PIXEL,
-						bitmap + ((rect.x + ((rect.y + jj) * pWeb->mTextureWidth)) * BYTES_PER_PIXEL),
-						rect.width * BYTES_PER_PIXEL
-						);
-				}
+	BindingMap::iterator i = sRendererBindings.begin();
+	for (; i != sRendererBindings.end();)
+	{
+		if (i->first.second == browser)
+			sRendererBindings.erase(i++);
+		else
+			++i;
+	}
+}
+
+////////////////////////////////////////////////////////////
+bool WebSystem::CallBinding(int browser, int id, CefRefPtr<CefListValue> arguments)
+{
+	JsBinding::JsCallback callback = NULL;
+	{
+		sf::Lock lock(sBindingMutex);
+
+		int slot = id & BINDING_SLOT_MASK;
+		if (id >= 0 && slot < (int)sBindingCallbacks.size())
+		{
+			const BoundCallback& bound = sBindingCallbacks[slot];
+			if (bound.mGeneration == id >> BINDING_SLOT_BITS && bound.mBrowser == browser)
+				callback = bound.mfpCallback;
+		}
+	}
+
+	//Called without the lock, as callbacks may add bindings of their own.
+	if (!callback)
+		return false;
+
+	return callback(arguments);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+//API Methods
+//--------------------------------------------------------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////
+int WebSystem::Main()
+{
+#if(PLATFORM == WINDOWS)
+	sArgs = CefMainArgs(GetModuleHandle(NULL));
+#else
+	sArgs = CefMainArgs();
+#endif
+	sApp = new WebApp();
+
+	int exit_code = CefExecuteProcess(sArgs, sApp.get());
+
+	if (exit_code >= 0)
+	{
+		return exit_code;
+	}
+
+	return -1;
+}
+
+////////////////////////////////////////////////////////////
+void WebSystem::StartWeb()
+{
+	if (!spThread)
+	{
+		spThread = new sf::Thread(&WebThread);
+
+		sEndThread = false;
+		sWakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+		{
+			sf::Lock lock(sReleasedMutex);
+			sDeferInterfaceDeletes = true;
+		}
+
+		spThread->launch();
+	}
+}
+
+////////////////////////////////////////////////////////////
+void WebSystem::EndWeb()
+{
+	sEndThread = true;
+	WakeWebThread();
+	WakeSnapshotThread();
+}
+
+////////////////////////////////////////////////////////////
+void WebSystem::WaitForWebEnd()
+{
+	if (spThread)
+	{
+		spThread->wait();
+
+		delete spThread;
+		spThread = NULL;
+	}
+
+	if (sWakeEvent)
+	{
+		CloseHandle(sWakeEvent);
+		sWakeEvent = NULL;
+	}
+
+	sf::Thread* pSnapshotThread = NULL;
+	{
+		sf::Lock lock(sSnapshotMutex);
+		pSnapshotThread = spSnapshotThread;
+		spSnapshotThread = NULL;
+	}
+
+	if (pSnapshotThread)
+	{
+		pSnapshotThread->wait();
+		delete pSnapshotThread;
+
+		CloseHandle(sSnapshotEvent);
+		sSnapshotEvent = NULL;
+	}
+
+	//Only the app thread is left, so anything released from now on can go right away.
+	{
+		sf::Lock lock(sReleasedMutex);
+		sDeferInterfaceDeletes = false;
+	}
+
+	ReleaseSnapshotInterfaces();
+	DeleteReleasedInterfaces();
+}
+
+////////////////////////////////////////////////////////////
+void WebSystem::SetThreadMode(ThreadMode mode)
+{
+	sThreadMode = mode;
+	WakeWebThread();
+}
+
+////////////////////////////////////////////////////////////
+void WebSystem::WakeWebThread()
+{
+	if (sWakeEvent)
+		SetEvent(sWakeEvent);
+}
+
+////////////////////////////////////////////////////////////
+void WebSystem::SnapshotThread()
+{
+	std::vector<SnapshotRequest> waiting;
+	std::vector<SnapshotRequest> unpainted;
+	std::vector<CefRefPtr<WebInterface> > released;
+
+	while (!sEndThread)
+	{
+		//Take the new requests, along with those still waiting for a paint.
+		{
+			sf::Lock lock(sSnapshotMutex);
+			while (!sSnapshotQueue.empty())
+			{
+				waiting.push_back(sSnapshotQueue.front());
+				sSnapshotQueue.pop();
+			}
+		}
+
+		for (unsigned int i = 0; i < waiting.size(); i++)
+		{
+			SnapshotRequest& request = waiting[i];
+
+			sf::Image image;
+			if (request.mpWeb->TakeSnapshot(request.mScale, image))
+			{
+				request.mfpCallback(request.mpWeb, image);
+				released.push_back(request.mpWeb);
+				continue;
+			}
+
+			//Nothing has been painted into the shadow yet, and the paint that is will wake us.
+			//Interfaces which have lost their browser never will be.
+			if (request.mpWeb->GetBrowser())
+				unpainted.push_back(request);
+			else
+				released.push_back(request.mpWeb);
+		}
+
+		//The old requests are only dropped once the app thread holds what they referenced.
+		waiting.swap(unpainted);
+		HandBackSnapshotInterfaces(released);
+		unpainted.clear();
+
+		WaitForSingleObject(sSnapshotEvent, INFINITE);
+	}
+
+	//Hand back the interfaces still waiting.
+	{
+		sf::Lock lock(sSnapshotMutex);
+		while (!sSnapshotQueue.empty())
+		{
+			waiting.push_back(sSnapshotQueue.front());
+			sSnapshotQueue.pop();
+		}
+	}
+
+	for (unsigned int i = 0; i < waiting.size(); i++)
+		released.push_back(waiting[i].mpWeb);
+	HandBackSnapshotInterfaces(released);
+	waiting.clear();
+}
+
+////////////////////////////////////////////////////////////
+void WebSystem::HandBackSnapshotInterfaces(std::vector<CefRefPtr<WebInterface> >& released)
+{
+	if (released.empty())
+		return;
+
+	{
+		sf::Lock lock(sSnapshotMutex);
+		sSnapshotReleases.insert(sSnapshotReleases.end(), released.begin(), released.end());
+	}
+
+	released.clear();
+}
+
+////////////////////////////////////////////////////////////
+void WebSystem::ReleaseSnapshotInterfaces()
+{
+	std::vector<CefRefPtr<WebInterface> > released;
+	{
+		sf::Lock lock(sSnapshotMutex);
+		released.swap(sSnapshotReleases);
+	}
+
+	//The references go with released, here on the app thread.
+}
+
+////////////////////////////////////////////////////////////
+void WebSystem::WakeSnapshotThread()
+{
+	if (sSnapshotEvent)
+		SetEvent(sSnapshotEvent);
+}
+
+////////////////////////////////////////////////////////////
+void WebSystem::SetAtlasPageSize(int size)
+{
+	sAtlas.SetPageSize(size);
+}
+
+////////////////////////////////////////////////////////////
+void WebSystem::SetBrowserPool(int count, const WebInterfaceSpec& spec)
+{
+	WebCommand command(WebCommand::COMMAND_FILL_POOL);
+	{
+		sf::Lock lock(sPoolMutex);
+
+		//Transparency and window are fixed when a browser is created, so spares made for others are no use.
+		command.flag = spec.mTransparent != sPoolSpec.mTransparent || spec.mHandle != sPoolSpec.mHandle;
+
+		sPoolSize = count < 0 ? 0 : count;
+		sPoolSpec = spec;
+	}
+
+	PostCommand(command);
+}
+
+////////////////////////////////////////////////////////////
+void WebSystem::RegisterScheme(std::string name, std::string domain, CefRefPtr<CefSchemeHandlerFactory> factory)
+{
+	WebCommand command(WebCommand::COMMAND_REGISTER_SCHEME);
+	command.text = name;
+	command.target = domain;
+	command.factory = factory;
+	PostCommand(command);
+}
+
+////////////////////////////////////////////////////////////
+CefRefPtr<WebInterface> WebSystem::CreateWebInterfaceSync(int width, int height, const std::string& url, bool transparent, sf::WindowHandle handle)
+{
+	CefRefPtr<WebInterface> pWeb = CreateWebInterfaceAsync(WebInterfaceSpec(width, height, url, transparent, handle));
+
+	while (!pWeb->IsReady())
+	{
+		//Sleep for one millisecond to prevent 100% CPU usage.
+		//There is probably a more elegant solution for this.
+		Sleep(1); 
+	}
+
+	return pWeb;
+}
+
+////////////////////////////////////////////////////////////
+CefRefPtr<WebInterface> WebSystem::CreateWebInterfaceHeadless(int width, int height, const std::string& url, bool transparent)
+{
+	CefRefPtr<WebInterface> pWeb = CreateWebInterfaceAsync(WebInterfaceSpec(width, height, url, transparent, NULL, true));
+
+	while (!pWeb->IsReady())
+	{
+		Sleep(1);
+	}
+
+	return pWeb;
+}
+
+////////////////////////////////////////////////////////////
+CefRefPtr<WebInterface> WebSystem::CreateWebInterfaceAsync(const WebInterfaceSpec& spec, InterfaceCallback callback)
+{
+	CefRefPtr<WebInterface> pWeb = new WebInterface(spec.mWidth, spec.mHeight, spec.mUrl, spec.mTransparent, spec.mHandle, spec.mHeadless);
+	pWeb->mfpCreatedCallback = callback;
+
+	WebCommand command(WebCommand::COMMAND_CREATE_BROWSER);
+	command.pWeb = pWeb;
+	PostCommand(command);
+
+	return pWeb;
+}
+
+////////////////////////////////////////////////////////////
+CefRefPtr<WebInterface> WebSystem::Prerender(CefRefPtr<WebInterface> pSlot, const std::string& url)
+{
+	CefRefPtr<WebInterface> pWeb = new WebInterface(pSlot->GetWidth(), pSlot->GetHeight(), url, pSlot->IsTransparent(), pSlot->mHandle, pSlot->IsHeadless());
+
+	//Get pixels to the texture the same way, so the swap changes nothing but the page.
+	pWeb->SetTileSize(pSlot->mTileSize);
+	if (pSlot->IsAtlased())
+		pWeb->SetAtlased(true);
+	pWeb->SetUpdateMode(pSlot->GetUpdateMode());
+	pWeb->SetUploadBackend(pSlot->GetUploadBackend());
+	pWeb->SetPixelFormat(pSlot->GetPixelFormat());
+	pWeb->SetPremultipliedAlpha(pSlot->IsPremultipliedAlpha());
+	pWeb->SetMaxPaintRate(pSlot->GetMaxPaintRate());
+	if (pSlot->HasFrameShadow())
+		pWeb->SetFrameShadow(true);
+
+	//Hidden from the start, so the browser is created hidden.
+	pWeb->mPrerender = true;
+	pWeb->mVisible = false;
+	pWeb->mpBindingSource = pSlot;
+
+	WebCommand command(WebCommand::COMMAND_CREATE_BROWSER);
+	command.pWeb = pWeb;
+	PostCommand(command);
+
+	return pWeb;
+}
+
+////////////////////////////////////////////////////////////
+bool WebSystem::SwapIn(CefRefPtr<WebInterface>& slot, CefRefPtr<WebInterface> pPrerendered)
+{
+	if (!pPrerendered->IsPrerendered())
+		return false;
+
+	CefRefPtr<WebInterface> pOld = slot;
+
+	pPrerendered->mPrerender = false;
+	if (pOld)
+		pPrerendered->SetAutoVisibility(pOld->GetAutoVisibility());
+	pPrerendered->SetVisible(true);
+
+	slot = pPrerendered;
+
+	if (pOld)
+		pOld->Close();
+
+	return true;
+}
+
+////////////////////////////////////////////////////////////
+void WebSystem::CreateWebInterfaces(const std::vector<WebInterfaceSpec>& specs, std::vector<CefRefPtr<WebInterface> >& interfaces, InterfaceCallback callback)
+{
+	//Build every interface before handing any to the cef thread, so their commands sit
+	//next to each other in the queue and are all run in the same batch.
+	unsigned int first = interfaces.size();
+	for (unsigned int i = 0; i < specs.size(); i++)
+	{
+		CefRefPtr<WebInterface> pWeb = new WebInterface(specs[i].mWidth, specs[i].mHeight, specs[i].mUrl, specs[i].mTransparent, specs[i].mHandle, specs[i].mHeadless);
+		pWeb->mfpCreatedCallback = callback;
+		interfaces.push_back(pWeb);
+	}
+
+	for (unsigned int i = first; i < interfaces.size(); i++)
+	{
+		WebCommand command(WebCommand::COMMAND_CREATE_BROWSER);
+		command.pWeb = interfaces[i];
+		PostCommand(command);
+	}
+}
+
+////////////////////////////////////////////////////////////
+void WebSystem::RunInput(WebInterface* pWeb)
+{
+	{
+		sf::Lock lock(pWeb->mInputMutex);
+		pWeb->mInputBatch.swap(pWeb->mInput);
+		pWeb->mInputPosted = false;
+		pWeb->mInputFocus = -1;
+	}
+
+	for (unsigned int i = 0; i < pWeb->mInputBatch.size(); i++)
+		RunCommand(pWeb->mInputBatch[i]);
+
+	pWeb->mInputBatch.clear();
+}
+
+////////////////////////////////////////////////////////////
+void WebSystem::FlushInput()
+{
+	InterfaceRegistry::Iterator i(sWebInterfaces);
+	while (WebInterface* pWeb = i.Next())
+		pWeb->FlushInput();
+}
+
+//////////////////////////////////////////////////////////// 
+void WebSystem::UpdateInterfaceTextures()
+{
+	ReleaseSnapshotInterfaces();
+	DeleteReleasedInterfaces();
+
+	FlushInput();
+
+	InterfaceRegistry::Iterator i(sWebInterfaces);
+	while (WebInterface* pWeb = i.Next())
+	{
+		if (pWeb->mAutoVisibility)
+		{
+			if (!pWeb->mDrawn && pWeb->mVisible)
+				pWeb->SetVisible(false);
+			pWeb->mDrawn = false;
+		}
+
+		pWeb->UpdateTexture();
+	}
+
+	//Pages emptied since the last frame are no longer drawn from.
+	sAtlas.CollectEmptyPages();
+}
+
+////////////////////////////////////////////////////////////
+void WebSystem::DeleteInterface(WebInterface* pWeb)
+{
+	{
+		sf::Lock lock(sReleasedMutex);
+		if (sDeferInterfaceDeletes)
+		{
+			sReleasedInterfaces.push_back(pWeb);
+			return;
+		}
+	}
+
+	delete pWeb;
+}
+
+////////////////////////////////////////////////////////////
+void WebSystem::DeleteReleasedInterfaces()
+{
+	std::vector<WebInterface*> released;
+	{
+		sf::Lock lock(sReleasedMutex);
+		released.swap(sReleasedInterfaces);
+	}
+
+	//Each waits out the readers which may still have found it, then frees its textures.
+	for (unsigned int i = 0; i < released.size(); i++)
+		delete released[i];
+}
+
+////////////////////////////////////////////////////////////
+static long sBenchmarkCalls = 0;
+static long sBenchmarkArguments = 0;
+static long sBenchmarkErrors = 0;
+
+////////////////////////////////////////////////////////////
+static void FillBenchmarkArguments(CefRefPtr<CefListValue> arguments, int count)
+{
+	for (int a = 0; a < count; a++)
+	{
+		if (a & 1)
+			arguments->SetString(a, "argument");
+		else
+			arguments->SetInt(a, a);
+	}
+}
+
+////////////////////////////////////////////////////////////
+static bool BenchmarkCallback(CefRefPtr<CefListValue> arguments)
+{
+	//Reads every argument, as a real callback would, and checks it is the one sent.
+	sBenchmarkCalls++;
+
+	int count = (int)arguments->GetSize();
+	sBenchmarkArguments += count;
+	for (int a = 0; a < count; a++)
+	{
+		bool sent = (a & 1) ?
+			arguments->GetType(a) == VTYPE_STRING && arguments->GetString(a) == "argument" :
+			arguments->GetType(a) == VTYPE_INT && arguments->GetInt(a) == a;
+		if (!sent)
+			sBenchmarkErrors++;
+	}
+
+	return true;
+}
+
+////////////////////////////////////////////////////////////
+void WebSystem::BenchmarkBindings(int iterations)
+{
+	//No browser has an ID below 1, so the binding can not clash with a real one.
+	const int browser = -1;
+	int id = InternBinding("benchmark", browser, &BenchmarkCallback);
+
+	printf("Binding calls: %d iterations\n", iterations);
+
+	int counts[3] = { 0, 4, 64 };
+	for (int c = 0; c < 3; c++)
+	{
+		sBenchmarkCalls = 0;
+		sBenchmarkArguments = 0;
+		sBenchmarkErrors = 0;
+
+		//Built as WebV8Handler::Execute() builds it, and read as OnProcessMessageReceived() reads it.
+		sf::Clock clock;
+		for (int i = 0; i < iterations; i++)
+		{
+			CefRefPtr<CefProcessMessage> message = CefProcessMessage::Create("jsbinding_call");
+			CefRefPtr<CefListValue> args = CefListValue::Create();
+			FillBenchmarkArguments(args, counts[c]);
+			message->GetArgumentList()->SetInt(0, id);
+			message->GetArgumentList()->SetList(1, args);
+
+			CefRefPtr<CefListValue> margs = message->GetArgumentList();
+			CallBinding(browser, margs->GetInt(0), margs->GetList(1));
+		}
+		float seconds = clock.getElapsedTime().asSeconds();
+
+		//The message is built once, leaving only the lookup and call.
+		CefRefPtr<CefProcessMessage> message = CefProcessMessage::Create("jsbinding_call");
+		CefRefPtr<CefListValue> args = CefListValue::Create();
+		FillBenchmarkArguments(args, counts[c]);
+		message->GetArgumentList()->SetInt(0, id);
+		message->GetArgumentList()->SetList(1, args);
+
+		clock.restart();
+		for (int i = 0; i < iterations; i++)
+		{
+			CefRefPtr<CefListValue> margs = message->GetArgumentList();
+			CallBinding(browser, margs->GetInt(0), margs->GetList(1));
+		}
+		float dispatchSeconds = clock.getElapsedTime().asSeconds();
+
+		//Every call must have arrived, with every argument as it was sent.
+		bool valid = sBenchmarkCalls == (long)iterations * 2
+			&& sBenchmarkArguments == (long)counts[c] * iterations * 2
+			&& sBenchmarkErrors == 0;
+		printf("  %2d args %12.0f calls/s, dispatch only %12.0f calls/s%s\n", counts[c],
+			seconds > 0.0f ? iterations / seconds : 0.0,
+			dispatchSeconds > 0.0f ? iterations / dispatchSeconds : 0.0,
+			valid ? "" : "  (CALLS OR ARGUMENTS LOST)");
+	}
+
+	ClearBindings(browser);
+}
+
+////////////////////////////////////////////////////////////
+static volatile long sInputReached = 0;
+
+////////////////////////////////////////////////////////////
+static bool InputReachedCallback(CefRefPtr<CefListValue> arguments)
+{
+	InterlockedExchange(&sInputReached, 1);
+	return true;
+}
+
+////////////////////////////////////////////////////////////
+bool WebSystem::TestInput(int timeout)
+{
+	sInputReached = 0;
+
+	CefRefPtr<WebInterface> pWeb = CreateWebInterfaceHeadless(256, 256,
+		"data:text/html,<body style='margin:0;height:100%'"
+		" onmousemove='if (window.inputReached) inputReached()'></body>", false);
+
+	//Adding the binding reloads the page, so keep moving the mouse until it is back.
+	pWeb->AddJSBinding("inputReached", &InputReachedCallback);
+
+	sf::Clock clock;
+	int x = 0;
+	while (!sInputReached && clock.getElapsedTime().asMilliseconds() < timeout)
+	{
+		pWeb->SendMouseMoveEvent(16 + (x++ & 63), 128);
+		FlushInput();
+		sf::sleep(sf::milliseconds(20));
+	}
+
+	bool reached = sInputReached != 0;
+	if (reached)
+		printf("Input reached the browser after %d ms.\n", clock.getElapsedTime().asMilliseconds());
+	else
+		printf("Input did not reach the browser within %d ms.\n", timeout);
+
+	pWeb->Close();
+	return reached;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+//Methods called by CEF
+//--------------------------------------------------------------------------------------------------------------------------
+
+////////////////////////////////////////////////////////////
+void WebSystem::OnBrowserCreated(CefRefPtr<CefBrowser> browser)
+{
+	sf::Lock lock(sBindingMutex);
+
+	//Send all JsBindings
+	BindingMap::iterator i = sBindings.begin();
+	for (; i != sBindings.end(); i++)
+	{
+		if (i->first.second == browser->GetIdentifier())
+		{
+			CefRefPtr<CefProcessMessage> message = CefProcessMessage::Create("jsbinding_create");
+			message->GetArgumentList()->SetString(0, i->first.first);
+			message->GetArgumentList()->SetInt(1, i->first.second);
+			message->GetArgumentList()->SetInt(2, i->second);
+
+			browser->SendProcessMessage(PID_RENDERER, message);
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////
+void WebSystem::OnBrowserDestroyed(CefRefPtr<CefBrowser> browser)
+{
+	EraseRendererBindings(browser->GetIdentifier());
+}
+
+////////////////////////////////////////////////////////////
+void WebSystem::OnContextCreated(CefRefPtr<CefBrowser> browser, CefRefPtr<CefFrame> frame, CefRefPtr<CefV8Context> context)
+{
+	//Retrieve the context's window object.
+	CefRefPtr<CefV8Value> object = context->GetGlobal();
+
+	sf::Lock lock(sBindingMutex);
+
+	//Setup bindings for that web interface.	
+	BindingMap::iterator i = sRendererBindings.begin();
+	for (; i != sRendererBindings.end(); i++)
+	{
+		if (i->first.second == browser->GetIdentifier())
+		{
+			//Each function gets a handler of its own, which knows the binding ID to send.
+			CefRefPtr<CefV8Handler> handler = new WebV8Handler(i->second);
+			CefRefPtr<CefV8Value> func = CefV8Value::CreateFunction(i->first.first, handler);
+
+			object->SetValue(i->first.first, func, V8_PROPERTY_ATTRIBUTE_NONE);
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////
+void WebSystem::OnContextReleased(CefRefPtr< CefBrowser > browser, CefRefPtr< CefFrame > frame, CefRefPtr< CefV8Context > context)
+{
+
+}
+
+////////////////////////////////////////////////////////////
+void WebSystem::OnUncaughtException(CefRefPtr< CefBrowser > browser, CefRefPtr< CefFrame > frame, CefRefPtr< CefV8Context > context, CefRefPtr< CefV8Exception > exception, CefRefPtr< CefV8StackTrace > stackTrace)
+{
+
+}
+
+////////////////////////////////////////////////////////////
+void WebSystem::OnRenderProcessThreadCreated(CefRefPtr<CefListValue> extra_info)
+{
+
+}
+
+////////////////////////////////////////////////////////////
+bool WebSystem::OnProcessMessageReceived(CefRefPtr<CefBrowser> browser, CefProcessId source_process, CefRefPtr<CefProcessMessage> message)
+{
+	CefString message_name = message->GetName();
+
+	//Identify whether we are in the browser process or the render process.
+	if (CefCurrentlyOn(TID_RENDERER))
+	{
+		//Renderer
+		if (message_name == "jsbinding_create")
+		{
+			std::string name = message->GetArgumentList()->GetString(0);
+
+			sf::Lock lock(sBindingMutex);
+			sRendererBindings[std::make_pair(name, message->GetArgumentList()->GetInt(1))] =
+				message->GetArgumentList()->GetInt(2);
+
+			browser->Reload();
+
+			return true;
+		}
+
+		//The browser has been pooled, and its bindings must not follow it to its next WebInterface.
+		if (message_name == "jsbinding_clear")
+		{
+			EraseRendererBindings(message->GetArgumentList()->GetInt(0));
+
+			return true;
+		}
+	}
+	else
+	{
+		//Browser
+		if (message_name == "jsbinding_call")
+		{
+			InterfaceRegistry::ReadScope scope;
+			WebInterface* pWeb = sWebInterfaces.Find(browser->GetIdentifier());
+			if (pWeb)
+			{
+				//The binding ID, then the arguments as one list.  GetList() hands back the list
+				//inside the message rather than a copy, so the callback reads what was sent.
+				CefRefPtr<CefListValue> margs = message->GetArgumentList();
+				pWeb->JSCallback(margs->GetInt(0), margs->GetList(1));
+
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+////////////////////////////////////////////////////////////
+void WebSystem::OnLoadStart(CefRefPtr<CefBrowser> browser, CefRefPtr<CefFrame> frame)
+{
+
+}
+
+////////////////////////////////////////////////////////////
+void WebSystem::OnLoadEnd(CefRefPtr<CefBrowser> browser, CefRefPtr<CefFrame> frame, int httpStatusCode)
+{
+	if (!frame->IsMain())
+		return;
+
+	InterfaceRegistry::ReadScope scope;
+	WebInterface* pWeb = sWebInterfaces.Find(browser->GetIdentifier());
+	if (!pWeb || !pWeb->mPrerender || pWeb->mPrerendered)
+		return;
+
+	//Show the prerendered page for one paint of the whole view.  Paint() hides it again.
+	{
+		sf::Lock lock(pWeb->mMutex);
+		pWeb->mVisible = true;
+	}
+
+	browser->GetHost()->WasHidden(false);
+	browser->GetHost()->Invalidate(CefRect(0, 0, pWeb->GetWidth(), pWeb->GetHeight()), PET_VIEW);
+}
+
+////////////////////////////////////////////////////////////
+void WebSystem::OnAfterCreated(CefRefPtr<CefBrowser> browser)
+{
+	AutoLock lock_scope(this);
+
+	//Popups are not ours.
+	if (browser->IsPopup())
+		return;
+
+	//Every browser we create gets a client of its own, which knows what it was created for.
+	CefRefPtr<WebBrowserClient> client = static_cast<WebBrowserClient*>(browser->GetHost()->GetClient().get());
+	CefRefPtr<WebInterface> pWeb = client->TakeInterface();
+
+	//A spare for the pool.
+	if (!pWeb)
+	{
+		sPoolPending--;
+		browser->GetHost()->WasHidden(true);
+		sBrowserPool.push_back(browser);
+		return;
+	}
+
+	AttachBrowser(pWeb, browser);
+}
 
-				//Convert BGRA to RGBA
-				unsigned int* pTmpBuf = (unsigned int*)rectBuffer;
-				const int numPixels = rect.width * rect.height;
-				for (int i = 0; i < numPixels; i++)
-				{
-					pTmpBuf[i] = (pTmpBuf[i] & 0xFF00FF00) | ((pTmpBuf[i] & 0x00FF0000) >> 16) | ((pTmpBuf[i] & 0x000000FF) << 16);
-				}
+////////////////////////////////////////////////////////////
+void WebSystem::OnBeforeClose(CefRefPtr<CefBrowser> browser)
+{
+	AutoLock lock_scope(this);
 
-				if (!rectBuffer)
-					continue;
-				//Update the texture with the new data.  
-				//This can be interrupted if the main thread calls a draw on a sprite which uses this texture
-				// as the texture is bound by openGL calls.  
-				//To rectify this we have the redundancy updating system.  
-				pWeb->mpTexture->update((sf::Uint8*)rectBuffer, rect.width, rect.height, rect.x, rect.y);
-
-				//Here we need to add the data required for the update to the queue for redundancy updates.  
-				pWeb->mUpdateRects.push(WebInterface::UpdateRect());
-				pWeb->mUpdateRects.back().buffer = rectBuffer;
-				pWeb->mUpdateRects.back().rect = rect;
-			}
-		}
+	//Free the browser pointer so that the browser can be destroyed.
+	{
+		InterfaceRegistry::ReadScope scope;
+		WebInterface* pWeb = sWebInterfaces.Find(browser->GetIdentifier());
+		if (pWeb)
+			pWeb->ClearBrowser();
+	}
+
+	//Nothing arrives for a closed browser, and its id is never used again.
+	sWebInterfaces.Remove(browser->GetIdentifier());
+	ClearBindings(browser->GetIdentifier());
+}
+
+////////////////////////////////////////////////////////////
+bool WebSystem::GetViewRect(CefRefPtr<CefBrowser> browser, CefRect &rect)
+{
+	InterfaceRegistry::ReadScope scope;
+	WebInterface* pWeb = sWebInterfaces.Find(browser->GetIdentifier());
+	if (!pWeb)
+	{
+		//Spares, and browsers not yet given to their WebInterface, are the size of the pool.
+		sf::Lock lock(sPoolMutex);
+		rect = CefRect(0, 0, sPoolSpec.mWidth, sPoolSpec.mHeight);
+		return true;
 	}
+
+	rect = CefRect(0, 0, pWeb->GetWidth(), pWeb->GetHeight());
+	return true;
+}
+
+////////////////////////////////////////////////////////////
+void WebSystem::OnPaint(CefRefPtr<CefBrowser> browser, PaintElementType type, const RectList& dirtyRects, const void* buffer, int width, int height)
+{
+	////Get the web interface we will be working with. 
+	//It can not be destroyed until the scope ends, even if the last reference goes meanwhile.
+	InterfaceRegistry::ReadScope scope;
+	WebInterface* pWeb = sWebInterfaces.Find(browser->GetIdentifier());
+	if (!pWeb)
+		return;
+
+	if (!buffer)
+		return;
+
+	if (type == PET_VIEW)
+		pWeb->Paint(dirtyRects, buffer, width, height);
 }
 
 ////////////////////////////////////////////////////////////
@@ -584,118 +1480,630 @@ bool WebSystem::OnKeyEvent(CefRefPtr<CefBrowser> browser, const CefKeyEvent& e,
 //--------------------------------------------------------------------------------------------------------------------------
 
 ////////////////////////////////////////////////////////////
-WebInterface::WebInterface(int width, int height, const std::string& url, bool transparent, sf::WindowHandle handle)
-: mHandle(handle)
+WebInterface::WebInterface(int width, int height, const std::string& url, bool transparent, sf::WindowHandle handle, bool headless)
+: mBrowser(NULL)
+, mHandle(handle)
+, mpTexture(NULL)
+, mAtlased(false)
+, mTileSize(0)
+, mActiveTileSize(0)
+, mTileColumns(0)
 , mTextureWidth(width)
 , mTextureHeight(height)
+, mUpdateMode(UPDATE_REDUNDANT)
+, mPixelFormat(TextureUploader::FORMAT_RGBA)
+, mMaxPaintRate(0.0f)
+, mThrottleInvalidated(false)
+, mVisible(true)
+, mAutoVisibility(false)
+, mDrawn(false)
+, mPremultipliedAlpha(false)
 , mCurrentURL(url)
 , mTransparent(transparent)
-, mBrowser(NULL)
-, mpTexture(NULL)
+, mHeadless(headless)
+, mFrameShadow(false)
+, mFramePainted(false)
+, mSnapshotWaiting(false)
+, mpRecorder(NULL)
+, mfpCreatedCallback(NULL)
+, mInputPosted(false)
+, mInputFocus(-1)
+, mPrerender(false)
+, mPrerendered(false)
+, mPrerenderHide(false)
+, mFrameSequence(0)
+, mRefCount(0)
+{
+	mUploadStats.rects = 0;
+	mUploadStats.bytes = 0;
+
+	//Headless interfaces are never drawn, so they need no shader.
+	if (transparent && !headless)
+		SetPremultipliedAlpha(true);
+
+	CreateTexture();
+
+	ResetPaintBuffers();
+}
+
+////////////////////////////////////////////////////////////
+WebInterface::~WebInterface()
+{
+	//Paints still arriving for our browser may be using us, wait them out before tearing anything down.
+	WebSystem::sWebInterfaces.Retire(this);
+
+	StopRecording();
+
+	ReleaseTexture();
+
+	ClearUpdateRects();
+
+	if (mBrowser)
+	{
+		mBrowser->GetHost()->CloseBrowser(true);
+		mBrowser = NULL;
+	}
+}
+
+////////////////////////////////////////////////////////////
+int WebInterface::AddRef()
+{
+	return InterlockedIncrement(&mRefCount);
+}
+
+////////////////////////////////////////////////////////////
+int WebInterface::Release()
+{
+	long count = InterlockedDecrement(&mRefCount);
+	if (count == 0)
+		WebSystem::DeleteInterface(this);
+	return count;
+}
+
+////////////////////////////////////////////////////////////
+bool WebInterface::TryAddRef()
+{
+	for (;;)
+	{
+		long count = mRefCount;
+		if (count <= 0)
+			return false;
+
+		if (InterlockedCompareExchange(&mRefCount, count + 1, count) == count)
+			return true;
+	}
+}
+
+////////////////////////////////////////////////////////////
+void WebInterface::Paint(const CefRenderHandler::RectList& dirtyRects, const void* buffer, int width, int height)
+{
+	int old_width = mTextureWidth;
+	int old_height = mTextureHeight;
+
+	//Retrieve current size of browser view.
+	mTextureWidth = width;
+	mTextureHeight = height;
+
+	//Check if we need to resize the texture before drawing to it.
+	if (old_width != mTextureWidth || old_height != mTextureHeight)
+	{
+		//This literally has never been called since the creation of this project, thus 
+		//it was never updated, and the outdated code has now been removed.
+		//printf("Called resize code in onpaint.\n");
+	}
+	else
+	{
+		//We want to work on the buffer byte by byte so get a pointer with a new type.
+		char* bitmap = (char*)(buffer);
+
+		sf::Lock lock(mMutex);
+
+		if (mpRecorder)
+			mpRecorder->Record(buffer, width, height, dirtyRects);
+
+		//Hidden interfaces get a full repaint when shown, so anything painted now would be wasted.
+		if (!mVisible)
+			return;
+
+		//A prerendered page goes back into hiding after its first paint of the whole view.
+		//That paint still goes through below.
+		if (mPrerender && !mPrerendered)
+		{
+			for (unsigned int i = 0; i < dirtyRects.size(); i++)
+			{
+				const CefRect& rect = dirtyRects[i];
+				if (rect.x <= 0 && rect.y <= 0 && rect.x + rect.width >= width && rect.y + rect.height >= height)
+				{
+					mVisible = false;
+					mPrerendered = true;
+					mPrerenderHide = true;
+					break;
+				}
+			}
+		}
+
+		//Hold rate limited paints back until the next tick, then apply everything held back at once.
+		//The buffer always holds the whole view, so the held back rects can be copied from any later paint.
+		const CefRenderHandler::RectList* pDirtyRects = &dirtyRects;
+		if (mMaxPaintRate > 0.0f || !mThrottledDamage.IsEmpty())
+		{
+			mThrottledDamage.SetViewSize(width, height);
+
+			if (!IsPaintDue())
+			{
+				mThrottledDamage.Add(dirtyRects);
+				return;
+			}
+
+			if (!mThrottledDamage.IsEmpty())
+			{
+				mThrottledDamage.Add(dirtyRects);
+				mThrottledRects.assign(mThrottledDamage.GetRects().begin(), mThrottledDamage.GetRects().end());
+				mThrottledDamage.Clear();
+				pDirtyRects = &mThrottledRects;
+			}
+
+			mPaintClock.restart();
+			mThrottleInvalidated = false;
+		}
+
+		//Headless interfaces only have the frame, shadowed ones keep it as well as the texture.
+		if (mHeadless || mFrameShadow)
+			WriteFrame(bitmap, width, height, *pDirtyRects);
+		if (mHeadless)
+			return;
+
+		if (mUpdateMode == UPDATE_HANDOFF)
+		{
+			//The frames are sized in SetSize(), so wait for a paint of the new size.
+			if (mHandoff.GetWidth() != width || mHandoff.GetHeight() != height)
+				return;
+
+			//Only write into the back frame here.  The draw thread uploads it, once.
+			FrameHandoff::Frame* frame = mHandoff.BeginFrame(*pDirtyRects);
+			if (!frame)
+				return;
+
+			for (unsigned int i = 0; i < frame->rects.size(); i++)
+			{
+				CopyPaintRect(frame->pixels + frame->offsets[i], frame->rects[i].width * BYTES_PER_PIXEL, bitmap, width, frame->rects[i]);
+			}
+
+			mHandoff.EndFrame();
+			return;
+		}
+
+		//Merge the dirty rectangles so that no pixel is copied or uploaded twice in this paint.
+		mPaintDamage.SetViewSize(width, height);
+		mPaintDamage.Clear();
+		mPaintDamage.Add(*pDirtyRects);
+
+		//Cut them along the tile grid, so each piece is uploaded to the one tile it lies on.
+		const std::vector<CefRect>& damage = mPaintDamage.GetRects();
+		mPaintPieces.clear();
+		for (unsigned int i = 0; i < damage.size(); i++)
+			DamageRegion::SplitToGrid(damage[i], mActiveTileSize, mPaintPieces);
+
+		//Update the dirty rectangles.
+		const std::vector<CefRect>& rects = mPaintPieces;
+		for (unsigned int i = 0; i < rects.size(); i++)
+		{
+			const CefRect& rect = rects[i];
+			//Get a rect sized buffer for the new rectangle data.
+			char* rectBuffer = mStagingArena.Allocate(rect.width * rect.height * BYTES_PER_PIXEL);
+
+			//Copy the new rectangle data out of the full size buffer into our rect sized one.
+			CopyPaintRect((sf::Uint8*)rectBuffer, rect.width * BYTES_PER_PIXEL, bitmap, mTextureWidth, rect);
+
+			if (!rectBuffer)
+				continue;
+			//Update the texture with the new data.  
+			//This can be interrupted if the main thread calls a draw on a sprite which uses this texture
+			// as the texture is bound by openGL calls.  
+			//To rectify this we have the redundancy updating system.  
+			int x, y;
+			sf::Texture* texture = GetUploadTarget(rect, x, y);
+			TextureUploader::Update(texture, (sf::Uint8*)rectBuffer, x, y, rect.width, rect.height, mPixelFormat);
+
+			//Queued rects which this one paints over would only be uploaded to be overwritten.
+			DropCoveredUpdateRects(rect);
+
+			//Here we need to add the data required for the update to the queue for redundancy updates.  
+			mUpdateRects.push_back(UpdateRect());
+			mUpdateRects.back().buffer = rectBuffer;
+			mUpdateRects.back().rect = rect;
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////
+void WebInterface::UpdateTexture()
+{
+	mUploadStats.rects = 0;
+	mUploadStats.bytes = 0;
+
+	if (!mVisible || mHeadless)
+		return;
+
+	if (mUpdateMode == UPDATE_HANDOFF)
+	{
+		//No lock needed, the cef thread never touches the frame we acquire.
+		const FrameHandoff::Frame* frame = mHandoff.AcquireFrame();
+		if (!frame)
+			return;
+
+		size_t bytes = 0;
+		for (unsigned int i = 0; i < frame->rects.size(); i++)
+			bytes += frame->rects[i].width * frame->rects[i].height * BYTES_PER_PIXEL;
+
+		mUploader.Begin(mpTexture, bytes, mPixelFormat);
+		for (unsigned int i = 0; i < frame->rects.size(); i++)
+		{
+			const CefRect& rect = frame->rects[i];
+			int x, y;
+			sf::Texture* texture = GetUploadTarget(rect, x, y);
+			mUploader.Add(texture, frame->pixels + frame->offsets[i], x, y, rect.width, rect.height);
+
+			mUploadStats.rects++;
+			mUploadStats.bytes += rect.width * rect.height * BYTES_PER_PIXEL;
+		}
+		mUploader.End();
+
+		return;
+	}
+
+	sf::Lock lock(mMutex);
+
+	size_t bytes = 0;
+	for (unsigned int i = 0; i < mUpdateRects.size(); i++)
+		bytes += mUpdateRects[i].rect.width * mUpdateRects[i].rect.height * BYTES_PER_PIXEL;
+
+	mUploader.Begin(mpTexture, bytes, mPixelFormat);
+	for (unsigned int i = 0; i < mUpdateRects.size(); i++)
+	{
+		const CefRect& rect = mUpdateRects[i].rect;
+		int x, y;
+		sf::Texture* texture = GetUploadTarget(rect, x, y);
+		mUploader.Add(texture, (sf::Uint8*)mUpdateRects[i].buffer, x, y, rect.width, rect.height);
+
+		mUploadStats.rects++;
+		mUploadStats.bytes += rect.width * rect.height * BYTES_PER_PIXEL;
+	}
+	mUploader.End();
+
+	ClearUpdateRects();
+}
+
+////////////////////////////////////////////////////////////
+sf::IntRect WebInterface::GetTextureRect()
+{
+	if (mAtlased)
+		return mAtlasRegion.rect;
+
+	return sf::IntRect(0, 0, mTextureWidth, mTextureHeight);
+}
+
+////////////////////////////////////////////////////////////
+bool WebInterface::SetAtlased(bool atlased)
+{
+	{
+		sf::Lock lock(mMutex);
+
+		if (atlased == mAtlased)
+			return true;
+
+		//Tiles are already as small as atlas regions would be, and headless interfaces have nothing to atlas.
+		if (atlased && (mActiveTileSize > 0 || mHeadless))
+			return false;
+
+		ReleaseTexture();
+		mAtlased = atlased;
+		CreateTexture();
+
+		//Pending rects belong to the old texture, and the new one starts out empty.
+		ResetPaintBuffers();
+	}
+
+	if (mBrowser)
+		Invalidate(CefRect(0, 0, mTextureWidth, mTextureHeight));
+
+	return mAtlased == atlased;
+}
+
+////////////////////////////////////////////////////////////
+void WebInterface::CreateTexture()
+{
+	if (mHeadless || mFrameShadow)
+	{
+		mFrame.assign(mTextureWidth * mTextureHeight * BYTES_PER_PIXEL, 0);
+		mFramePainted = false;
+	}
+
+	//Headless interfaces must not touch OpenGL at all, there may be no context to be had.
+	if (mHeadless)
+	{
+		mActiveTileSize = 0;
+		mAtlased = false;
+		return;
+	}
+
+	//Views too large for one texture get tiled, whether or not a tile size was asked for.
+	int maximum = (int)sf::Texture::getMaximumSize();
+	mActiveTileSize = mTileSize;
+	if (mActiveTileSize <= 0 && (mTextureWidth > maximum || mTextureHeight > maximum))
+		mActiveTileSize = WEB_INTERFACE_TILE_SIZE;
+	if (mActiveTileSize > maximum)
+		mActiveTileSize = maximum;
+
+	if (mActiveTileSize > 0)
+	{
+		mAtlased = false;
+
+		mTileColumns = (mTextureWidth + mActiveTileSize - 1) / mActiveTileSize;
+		int tileRows = (mTextureHeight + mActiveTileSize - 1) / mActiveTileSize;
+		for (int row = 0; row < tileRows; row++)
+		{
+			for (int column = 0; column < mTileColumns; column++)
+			{
+				sf::IntRect rect = GetTileRect((int)mTiles.size());
+
+				sf::Texture* pTile = new sf::Texture();
+				sf::Image img; img.create(rect.width, rect.height, sf::Color(0, 0, 0, 0));
+				pTile->loadFromImage(img);
+				pTile->setSmooth(true);
+				mTiles.push_back(pTile);
+			}
+		}
+
+		return;
+	}
+
+	if (mAtlased)
+	{
+		if (WebSystem::sAtlas.Allocate(mTextureWidth, mTextureHeight, mAtlasRegion))
+		{
+			mpTexture = WebSystem::sAtlas.GetPage(mAtlasRegion.page);
+			return;
+		}
+
+		mAtlased = false;
+	}
+
+	mpTexture = new sf::Texture();
+	sf::Image img; img.create(mTextureWidth, mTextureHeight, sf::Color(0, 0, 0, 0));
+	mpTexture->loadFromImage(img);
+	mpTexture->setSmooth(true);
+}
+
+////////////////////////////////////////////////////////////
+void WebInterface::ReleaseTexture()
+{
+	if (mAtlased)
+		WebSystem::sAtlas.Free(mAtlasRegion);
+	else
+		delete mpTexture;
+
+	mpTexture = NULL;
+
+	for (unsigned int i = 0; i < mTiles.size(); i++)
+		delete mTiles[i];
+
+	mTiles.clear();
+	mTileColumns = 0;
+	mActiveTileSize = 0;
+
+	std::vector<sf::Uint8>().swap(mFrame);
+}
+
+////////////////////////////////////////////////////////////
+void WebInterface::SetTileSize(int size)
+{
+	if (size < 0)
+		size = 0;
+
+	{
+		sf::Lock lock(mMutex);
+
+		if (size == mTileSize)
+			return;
+
+		mTileSize = size;
+		ReleaseTexture();
+		CreateTexture();
+
+		//Pending rects were cut for the old tiles, and the new ones start out empty.
+		ResetPaintBuffers();
+	}
+
+	if (mBrowser)
+		Invalidate(CefRect(0, 0, mTextureWidth, mTextureHeight));
+}
+
+////////////////////////////////////////////////////////////
+sf::IntRect WebInterface::GetTileRect(int index)
+{
+	int left = (index % mTileColumns) * mActiveTileSize;
+	int top = (index / mTileColumns) * mActiveTileSize;
+	int width = mTextureWidth - left < mActiveTileSize ? mTextureWidth - left : mActiveTileSize;
+	int height = mTextureHeight - top < mActiveTileSize ? mTextureHeight - top : mActiveTileSize;
+
+	return sf::IntRect(left, top, width, height);
+}
+
+////////////////////////////////////////////////////////////
+sf::Texture* WebInterface::GetUploadTarget(const CefRect& rect, int& x, int& y)
+{
+	if (mActiveTileSize > 0)
+	{
+		int column = rect.x / mActiveTileSize;
+		int row = rect.y / mActiveTileSize;
+		x = rect.x - column * mActiveTileSize;
+		y = rect.y - row * mActiveTileSize;
+		return mTiles[row * mTileColumns + column];
+	}
+
+	sf::IntRect textureRect = GetTextureRect();
+	x = textureRect.left + rect.x;
+	y = textureRect.top + rect.y;
+	return mpTexture;
+}
+
+////////////////////////////////////////////////////////////
+void WebInterface::Draw(sf::RenderTarget& target, const sf::Transform& transform)
+{
+	sf::RenderStates states = GetRenderStates();
+	states.transform = transform;
+
+	if (mActiveTileSize <= 0)
+	{
+		if (mpTexture)
+			target.draw(sf::Sprite(*mpTexture, GetTextureRect()), states);
+		return;
+	}
+
+	for (unsigned int i = 0; i < mTiles.size(); i++)
+	{
+		sf::IntRect rect = GetTileRect(i);
+		sf::Sprite tile(*mTiles[i]);
+		tile.setPosition((float)rect.left, (float)rect.top);
+		target.draw(tile, states);
+	}
+}
+
+////////////////////////////////////////////////////////////
+void WebInterface::ClearUpdateRects()
+{
+	for (unsigned int i = 0; i < mUpdateRects.size(); i++)
+	{
+		mStagingArena.Release(mUpdateRects[i].buffer);
+	}
+
+	mUpdateRects.clear();
+}
+
+////////////////////////////////////////////////////////////
+void WebInterface::DropCoveredUpdateRects(const CefRect& rect)
+{
+	unsigned int kept = 0;
+	for (unsigned int i = 0; i < mUpdateRects.size(); i++)
+	{
+		if (DamageRegion::Contains(rect, mUpdateRects[i].rect))
+			mStagingArena.Release(mUpdateRects[i].buffer);
+		else
+			mUpdateRects[kept++] = mUpdateRects[i];
+	}
+
+	mUpdateRects.resize(kept);
+}
+
+////////////////////////////////////////////////////////////
+void WebInterface::CopyPaintRect(sf::Uint8* dst, int dstPitch, const char* buffer, int bufferWidth, const CefRect& rect)
 {
-	mpTexture = new sf::Texture();
-	sf::Image img; img.create(mTextureWidth, mTextureHeight, sf::Color(0, 0, 0, 0));
-	mpTexture->loadFromImage(img);
-	mpTexture->setSmooth(true);
+	const sf::Uint8* src = (const sf::Uint8*)buffer + ((rect.x + (rect.y * bufferWidth)) * BYTES_PER_PIXEL);
 
+	//Cef paints BGRA, so it only needs converting if the texture is not uploaded as BGRA.
+	if (mPixelFormat == TextureUploader::FORMAT_BGRA)
+		PixelConverter::CopyBGRA(dst, dstPitch, src, bufferWidth * BYTES_PER_PIXEL, rect.width, rect.height);
+	else
+		PixelConverter::CopyBGRAToRGBA(dst, dstPitch, src, bufferWidth * BYTES_PER_PIXEL, rect.width, rect.height);
 }
 
 ////////////////////////////////////////////////////////////
-WebInterface::~WebInterface()
+void WebInterface::ResetPaintBuffers()
 {
+	ClearUpdateRects();
 
-	delete mpTexture;
+	mHandoff.SetTileSize(mActiveTileSize);
 
-	while (mUpdateRects.size() > 0)
+	//Headless paints go straight into the frame, they need neither buffer.
+	if (mHeadless)
 	{
-		delete[] mUpdateRects.front().buffer;
-		mUpdateRects.pop();
+		mStagingArena.Reset(0);
+		mHandoff.Reset(0, 0);
 	}
-
-	std::map<int, WebInterface*>::iterator i;
-	for (i = WebSystem::sWebInterfaces.begin(); i != WebSystem::sWebInterfaces.end(); i++)
+	else if (mUpdateMode == UPDATE_HANDOFF)
 	{
-		if (i->second == this)
-		{
-			WebSystem::sWebInterfaces.erase(i);
-			break;
-		}
+		mStagingArena.Reset(0);
+		mHandoff.Reset(mTextureWidth, mTextureHeight);
 	}
-
-	if (mBrowser)
+	else
 	{
-		mBrowser->GetHost()->CloseBrowser(true);
-		mBrowser = NULL;
+		mHandoff.Reset(0, 0);
+		mStagingArena.Reset(mTextureWidth * mTextureHeight * BYTES_PER_PIXEL * STAGING_ARENA_FRAMES);
 	}
 }
 
 ////////////////////////////////////////////////////////////
-void WebInterface::UpdateTexture()
+void WebInterface::FlushInput()
 {
-	sf::Lock lock(mMutex);
-	while (mUpdateRects.size() > 0)
 	{
-		int size = mUpdateRects.size();
-		const CefRect& rect = mUpdateRects.front().rect;
-		mpTexture->update((sf::Uint8*)mUpdateRects.front().buffer, rect.width, rect.height, rect.x, rect.y);
-		delete[] mUpdateRects.front().buffer;
-		mUpdateRects.pop();
+		sf::Lock lock(mInputMutex);
+		if (mInput.empty() || mInputPosted)
+			return;
+		mInputPosted = true;
 	}
-}
 
-////////////////////////////////////////////////////////////
-void WebInterface::SendFocusEvent(bool setFocus)
-{
-	mBrowser->GetHost()->SendFocusEvent(setFocus);
+	WebCommand command(WebCommand::COMMAND_FLUSH_INPUT);
+	PostCommand(command);
 }
 
 ////////////////////////////////////////////////////////////
-int WebInterface::GetMouseModifiers()
+void WebInterface::QueueInput(const WebCommand& command)
 {
-	int mod = 0;
-	if (sf::Keyboard::isKeyPressed(sf::Keyboard::LControl) ||
-		sf::Keyboard::isKeyPressed(sf::Keyboard::RControl))
-		mod |= EVENTFLAG_CONTROL_DOWN;
-	if (sf::Keyboard::isKeyPressed(sf::Keyboard::LShift) ||
-		sf::Keyboard::isKeyPressed(sf::Keyboard::RShift))
-		mod |= EVENTFLAG_SHIFT_DOWN;
-	if (sf::Keyboard::isKeyPressed(sf::Keyboard::LAlt) ||
-		sf::Keyboard::isKeyPressed(sf::Keyboard::RAlt))
-		mod |= EVENTFLAG_ALT_DOWN;
-	if (sf::Mouse::isButtonPressed(sf::Mouse::Left))
-		mod |= EVENTFLAG_LEFT_MOUSE_BUTTON;
-	if (sf::Mouse::isButtonPressed(sf::Mouse::Middle))
-		mod |= EVENTFLAG_MIDDLE_MOUSE_BUTTON;
-	if (sf::Mouse::isButtonPressed(sf::Mouse::Right))
-		mod |= EVENTFLAG_RIGHT_MOUSE_BUTTON;
+	bool full;
+	{
+		sf::Lock lock(mInputMutex);
+
+		//Repeating the focus changes nothing, and would keep the moves around it from merging.
+		if (command.type == WebCommand::COMMAND_FOCUS)
+		{
+			if (mInputFocus == (command.flag ? 1 : 0))
+				return;
+			mInputFocus = command.flag ? 1 : 0;
+		}
+
+		WebCommand* pLast = mInput.empty() ? NULL : &mInput.back();
+		if (pLast && pLast->type == command.type)
+		{
+			//Only where the mouse ends up matters, and a click brings its own position.
+			if (command.type == WebCommand::COMMAND_MOUSE_MOVE && pLast->flag == command.flag)
+			{
+				pLast->mouse = command.mouse;
+				return;
+			}
 
-	// Low bit set from GetKeyState indicates "toggled".
-	//if (::GetKeyState(VK_NUMLOCK) & 1)
-	//	mod |= EVENTFLAG_NUM_LOCK_ON;
-	//if (::GetKeyState(VK_CAPITAL) & 1)
-	//	mod |= EVENTFLAG_CAPS_LOCK_ON;
+			//Scrolling adds up, unless the modifiers changed, as control + wheel zooms.
+			if (command.type == WebCommand::COMMAND_MOUSE_WHEEL && pLast->mouse.modifiers == command.mouse.modifiers)
+			{
+				pLast->mouse = command.mouse;
+				pLast->deltaX += command.deltaX;
+				pLast->deltaY += command.deltaY;
+				return;
+			}
+		}
+
+		//Queued input runs through WebSystem::RunCommand() like any other command, which needs
+		//to know whose browser it is for.  The queue belongs to us, so no reference is taken.
+		WebCommand queued = command;
+		queued.pWeb = this;
+		mInput.push_back(queued);
+		full = mInput.size() >= WEB_INPUT_QUEUE_SIZE;
+	}
 
-	return mod;
+	//Do not let a flood of keys pile up for a whole frame.
+	if (full)
+		FlushInput();
 }
 
 ////////////////////////////////////////////////////////////
-int WebInterface::GetKeyboardModifiers()
+void WebInterface::SendFocusEvent(bool setFocus)
 {
-	int mod = 0;
-	if (sf::Keyboard::isKeyPressed(sf::Keyboard::LControl))
-		mod |= EVENTFLAG_CONTROL_DOWN;// mod |= EVENTFLAG_IS_LEFT;
-	if (sf::Keyboard::isKeyPressed(sf::Keyboard::RControl))
-		mod |= EVENTFLAG_CONTROL_DOWN;// mod |= EVENTFLAG_IS_RIGHT;
-	if (sf::Keyboard::isKeyPressed(sf::Keyboard::LShift))
-		mod |= EVENTFLAG_SHIFT_DOWN;// mod |= EVENTFLAG_IS_LEFT;
-	if (sf::Keyboard::isKeyPressed(sf::Keyboard::RShift))
-		mod |= EVENTFLAG_SHIFT_DOWN;// mod |= EVENTFLAG_IS_RIGHT;
-	if (sf::Keyboard::isKeyPressed(sf::Keyboard::LAlt))
-		mod |= EVENTFLAG_ALT_DOWN;// mod |= EVENTFLAG_IS_LEFT;
-	if (sf::Keyboard::isKeyPressed(sf::Keyboard::RAlt))
-		mod |= EVENTFLAG_ALT_DOWN;// mod |= EVENTFLAG_IS_RIGHT;
+	if (!mBrowser)
+		return;
 
-	return mod;
+	WebCommand command(WebCommand::COMMAND_FOCUS);
+	command.flag = setFocus;
+	QueueInput(command);
 }
 
 ////////////////////////////////////////////////////////////
@@ -704,12 +2112,14 @@ void WebInterface::SendMouseClickEvent(int x, int y, sf::Mouse::Button button, b
 	if (!mBrowser)
 		return;
 
-	CefBrowserHost::MouseButtonType type = button == sf::Mouse::Left ? MBT_LEFT : 
+	WebCommand command(WebCommand::COMMAND_MOUSE_CLICK);
+	command.button = button == sf::Mouse::Left ? MBT_LEFT : 
 		button == sf::Mouse::Right ? MBT_RIGHT : MBT_MIDDLE;
 
-	CefMouseEvent e; e.x = x; e.y = y; e.modifiers = GetMouseModifiers();
-	mBrowser->GetHost()->SendMouseMoveEvent(e, false);
-	mBrowser->GetHost()->SendMouseClickEvent(e, type, mouseUp, clickCount);
+	command.mouse.x = x; command.mouse.y = y; command.mouse.modifiers = GetMouseModifiers();
+	command.flag = mouseUp;
+	command.clicks = clickCount;
+	QueueInput(command);
 }
 
 //////////////////////////////////////////////////////////// 
@@ -718,8 +2128,10 @@ void WebInterface::SendMouseMoveEvent(int x, int y, bool mouseLeave)
 	if (!mBrowser)
 		return;
 
-	CefMouseEvent e; e.x = x; e.y = y; e.modifiers = GetMouseModifiers();
-	mBrowser->GetHost()->SendMouseMoveEvent(e, mouseLeave);
+	WebCommand command(WebCommand::COMMAND_MOUSE_MOVE);
+	command.mouse.x = x; command.mouse.y = y; command.mouse.modifiers = GetMouseModifiers();
+	command.flag = mouseLeave;
+	QueueInput(command);
 }
 
 ////////////////////////////////////////////////////////////
@@ -728,8 +2140,11 @@ void WebInterface::SendMouseWheelEvent(int x, int y, int deltaX, int deltaY)
 	if (!mBrowser)
 		return;
 
-	CefMouseEvent e; e.x = x; e.y = y; e.modifiers = GetMouseModifiers();
-	mBrowser->GetHost()->SendMouseWheelEvent(e, deltaX, deltaY);
+	WebCommand command(WebCommand::COMMAND_MOUSE_WHEEL);
+	command.mouse.x = x; command.mouse.y = y; command.mouse.modifiers = GetMouseModifiers();
+	command.deltaX = deltaX;
+	command.deltaY = deltaY;
+	QueueInput(command);
 }
 
 ////////////////////////////////////////////////////////////
@@ -737,10 +2152,12 @@ void WebInterface::SendKeyEvent(WPARAM key, bool keyUp, bool isSystem, int modif
 {
 	if (!mBrowser)
 		return;
-	CefKeyEvent e; e.windows_key_code = key; e.modifiers = modifiers == -1 ? GetKeyboardModifiers() : modifiers;
+	WebCommand command(WebCommand::COMMAND_KEY);
+	CefKeyEvent& e = command.key;
+	e.windows_key_code = key; e.modifiers = modifiers == -1 ? GetKeyboardModifiers() : modifiers;
 	e.type = keyUp ? KEYEVENT_KEYUP : KEYEVENT_KEYDOWN;
 	e.is_system_key = isSystem; e.character = key; e.unmodified_character = key; //e.native_key_code = 0;
-	mBrowser->GetHost()->SendKeyEvent(e);
+	QueueInput(command);
 }
 
 ////////////////////////////////////////////////////////////
@@ -748,36 +2165,54 @@ void WebInterface::SendKeyEvent(char key, int modifiers)
 {
 	if (!mBrowser)
 		return;
-	CefKeyEvent e; e.windows_key_code = key; e.modifiers = modifiers == -1 ? GetKeyboardModifiers() : modifiers;
+	WebCommand command(WebCommand::COMMAND_KEY);
+	CefKeyEvent& e = command.key;
+	e.windows_key_code = key; e.modifiers = modifiers == -1 ? GetKeyboardModifiers() : modifiers;
 	e.type = KEYEVENT_CHAR; e.character = key; e.unmodified_character = key;
-	mBrowser->GetHost()->SendKeyEvent(e);
+	QueueInput(command);
 }
 
 ////////////////////////////////////////////////////////////
 void WebInterface::AddJSBinding(const std::string name, JsBinding::JsCallback callback)
 {
-	WebSystem::sBindings.insert(std::make_pair(std::make_pair(name, mBrowser->GetIdentifier()), callback));
-
-	CefRefPtr<CefProcessMessage> message = CefProcessMessage::Create("jsbinding_create");
-	message->GetArgumentList()->SetString(0, name.c_str());
-	message->GetArgumentList()->SetInt(1, mBrowser->GetIdentifier());
+	AddJSBindings(std::vector<JsBinding>(1, JsBinding(name, callback)));
+}
 
-	mBrowser->SendProcessMessage(PID_RENDERER, message);
+////////////////////////////////////////////////////////////
+void WebInterface::AddJSBindings(const std::vector<JsBinding> bindings)
+{
+	{
+		sf::Lock lock(mMutex);
+		mPendingBindings.insert(mPendingBindings.end(), bindings.begin(), bindings.end());
+	}
 
-	//We have to reload the page otherwise the bindings wont be added to the context.
-	mBrowser->Reload();
+	//Without a browser yet, the command does nothing and WebSystem::AttachBrowser() sends them.
+	WebCommand command(WebCommand::COMMAND_ADD_BINDINGS);
+	PostCommand(command);
 }
 
 ////////////////////////////////////////////////////////////
-void WebInterface::AddJSBindings(const std::vector<JsBinding> bindings)
+void WebInterface::SendBindings()
 {
+	std::vector<JsBinding> bindings;
+	{
+		sf::Lock lock(mMutex);
+		if (!mBrowser)
+			return;
+		bindings.swap(mPendingBindings);
+	}
+
+	if (bindings.empty())
+		return;
+
 	for (unsigned int i = 0; i < bindings.size(); i++)
 	{
-		WebSystem::sBindings.insert(std::make_pair(std::make_pair(bindings[i].mFunctionName, mBrowser->GetIdentifier()), bindings[i].mfpJSCallback));
+		int id = WebSystem::InternBinding(bindings[i].mFunctionName, mBrowser->GetIdentifier(), bindings[i].mfpJSCallback);
 
 		CefRefPtr<CefProcessMessage> message = CefProcessMessage::Create("jsbinding_create");
 		message->GetArgumentList()->SetString(0, bindings[i].mFunctionName);
 		message->GetArgumentList()->SetInt(1, mBrowser->GetIdentifier());
+		message->GetArgumentList()->SetInt(2, id);
 
 		mBrowser->SendProcessMessage(PID_RENDERER, message);
 	}
@@ -792,7 +2227,10 @@ void WebInterface::ExecuteJS(const CefString& code)
 	if (!mBrowser)
 		return;
 
-	ExecuteJS(code, mBrowser->GetMainFrame());
+	//The main frame is looked up on the cef thread.
+	WebCommand command(WebCommand::COMMAND_EXECUTE_JS);
+	command.text = code;
+	PostCommand(command);
 }
 
 ////////////////////////////////////////////////////////////
@@ -814,7 +2252,11 @@ void WebInterface::ExecuteJS(const CefString& code, CefRefPtr<CefFrame> frame, i
 
 	//Should probably check to make sure the frame is from our browser here.
 
-	frame->ExecuteJavaScript(code, frame->GetURL(), startLine);
+	WebCommand command(WebCommand::COMMAND_EXECUTE_JS);
+	command.text = code;
+	command.frame = frame;
+	command.line = startLine;
+	PostCommand(command);
 }
 
 ////////////////////////////////////////////////////////////
@@ -822,16 +2264,52 @@ bool WebInterface::JSCallback(const CefString& name,
 	CefRefPtr<CefListValue> arguments
 	)
 {
-	bool result = false;
-	//Check if this is one of our bindings.
+	if (!mBrowser)
+		return false;
+
+	int id = -1;
 
-	if (WebSystem::sBindings.count(std::make_pair(name, mBrowser->GetIdentifier())))
+	//Check if this is one of our bindings.
 	{
-		result = WebSystem::sBindings[std::make_pair(name, mBrowser->GetIdentifier())](arguments);
+		sf::Lock lock(WebSystem::sBindingMutex);
+
+		WebSystem::BindingMap::iterator i = WebSystem::sBindings.find(std::make_pair(name.ToString(), mBrowser->GetIdentifier()));
+		if (i != WebSystem::sBindings.end())
+			id = i->second;
 	}
 
 	//Otherwise fallthrough and return false.
-	return result;
+	return JSCallback(id, arguments);
+}
+
+////////////////////////////////////////////////////////////
+bool WebInterface::JSCallback(int id,
+	CefRefPtr<CefListValue> arguments
+	)
+{
+	if (!mBrowser)
+		return false;
+
+	return WebSystem::CallBinding(mBrowser->GetIdentifier(), id, arguments);
+}
+
+////////////////////////////////////////////////////////////
+void WebInterface::Close(bool force)
+{
+	if (!mBrowser)
+		return;
+
+	WebCommand command(WebCommand::COMMAND_CLOSE);
+	command.flag = force;
+	PostCommand(command);
+}
+
+////////////////////////////////////////////////////////////
+void WebInterface::Invalidate(const CefRect& rect)
+{
+	WebCommand command(WebCommand::COMMAND_INVALIDATE);
+	command.rect = rect;
+	PostCommand(command);
 }
 
 ////////////////////////////////////////////////////////////
@@ -841,26 +2319,376 @@ void WebInterface::SetSize(int width, int height)
 	mTextureHeight = height;
 
 	if (mBrowser)
-		mBrowser->GetHost()->WasResized();
+	{
+		WebCommand command(WebCommand::COMMAND_RESIZE);
+		PostCommand(command);
+	}
+
+	{
+		sf::Lock lock(mMutex);
+
+		//Atlased interfaces get a region of the new size, or their own texture if none is free.
+		ReleaseTexture();
+		CreateTexture();
+
+		//Clear the update rects and resize the buffers they come from to match the new size.
+		ResetPaintBuffers();
+	}
+
+	if (mBrowser)
+		Invalidate(CefRect(0, 0, mTextureWidth, mTextureHeight));
+}
 
-	sf::Texture* pOldTexture = mpTexture;
-	mpTexture = new sf::Texture();
-	mpTexture->create(mTextureWidth, mTextureHeight);
-	mpTexture->setSmooth(true);
-	if (pOldTexture)
-		delete pOldTexture;
+////////////////////////////////////////////////////////////
+void WebInterface::SetUpdateMode(UpdateMode mode)
+{
+	{
+		sf::Lock lock(mMutex);
+
+		if (mode == mUpdateMode)
+			return;
+
+		mUpdateMode = mode;
+		ResetPaintBuffers();
+	}
+
+	if (mBrowser)
+		Invalidate(CefRect(0, 0, mTextureWidth, mTextureHeight));
+}
+
+////////////////////////////////////////////////////////////
+void WebInterface::SetMaxPaintRate(float fps)
+{
+	sf::Lock lock(mMutex);
+
+	mMaxPaintRate = fps > 0.0f ? fps : 0.0f;
+}
+
+////////////////////////////////////////////////////////////
+bool WebInterface::IsPaintDue()
+{
+	//Read once, the draw thread may change it.
+	float rate = mMaxPaintRate;
+
+	return rate <= 0.0f || mPaintClock.getElapsedTime().asSeconds() >= 1.0f / rate;
+}
+
+////////////////////////////////////////////////////////////
+void WebInterface::SetVisible(bool visible)
+{
+	{
+		sf::Lock lock(mMutex);
+
+		if (visible == mVisible)
+			return;
+
+		mVisible = visible;
+	}
+
+	if (!mBrowser)
+		return;
+
+	WebCommand command(WebCommand::COMMAND_SET_HIDDEN);
+	command.flag = !visible;
+	PostCommand(command);
+
+	//Paints were dropped while hidden, so bring the whole texture up to date in one go.
+	if (visible)
+		Invalidate(CefRect(0, 0, mTextureWidth, mTextureHeight));
+}
+
+////////////////////////////////////////////////////////////
+void WebInterface::MarkDrawn()
+{
+	mDrawn = true;
+
+	if (mAutoVisibility && !mVisible)
+		SetVisible(true);
+}
+
+////////////////////////////////////////////////////////////
+sf::RenderStates WebInterface::GetRenderStates()
+{
+	if (mPremultipliedAlpha)
+		return GetPremultipliedRenderStates();
+
+	return sf::RenderStates::Default;
+}
+
+////////////////////////////////////////////////////////////
+bool WebInterface::SetPremultipliedAlpha(bool premultiplied)
+{
+	//Drawing premultiplied texels with a straight alpha blend darkens every soft edge.
+	mPremultipliedAlpha = premultiplied && IsPremultipliedAlphaSupported();
+	return mPremultipliedAlpha == premultiplied;
+}
+
+////////////////////////////////////////////////////////////
+sf::RenderStates WebInterface::GetPremultipliedRenderStates()
+{
+	IsPremultipliedAlphaSupported();
+
+	sf::RenderStates states;
+	states.blendMode = sf::BlendAlpha;
+	states.shader = spPremultipliedShader;
+	return states;
+}
+
+////////////////////////////////////////////////////////////
+bool WebInterface::IsPremultipliedAlphaSupported()
+{
+	if (!sPremultipliedShaderLoaded)
+	{
+		sPremultipliedShaderLoaded = true;
+
+		if (sf::Shader::isAvailable())
+		{
+			//Filtering already happened on premultiplied texels, which is what keeps edges clean.
+			//Dividing afterwards hands the straight alpha blend the colour it expects.
+			const std::string source =
+				"uniform sampler2D texture;\n"
+				"void main()\n"
+				"{\n"
+				"	vec4 pixel = texture2D(texture, gl_TexCoord[0].xy);\n"
+				"	if (pixel.a > 0.0)\n"
+				"		pixel.rgb /= pixel.a;\n"
+				"	gl_FragColor = pixel * gl_Color;\n"
+				"}\n";
+
+			spPremultipliedShader = new sf::Shader();
+			if (spPremultipliedShader->loadFromMemory(source, sf::Shader::Fragment))
+			{
+				spPremultipliedShader->setParameter("texture", sf::Shader::CurrentTexture);
+			}
+			else
+			{
+				delete spPremultipliedShader;
+				spPremultipliedShader = NULL;
+			}
+		}
+
+		if (!spPremultipliedShader)
+			sf::err() << "WebInterface: no shader for premultiplied alpha, transparent pages are drawn as straight alpha." << std::endl;
+	}
+
+	return spPremultipliedShader != NULL;
+}
+
+////////////////////////////////////////////////////////////
+void WebInterface::SetPixelFormat(TextureUploader::Format format)
+{
+	{
+		sf::Lock lock(mMutex);
+
+		if (format == mPixelFormat)
+			return;
+
+		//Pending rects were copied in the old format.
+		mPixelFormat = format;
+		ResetPaintBuffers();
+	}
+
+	if (mBrowser)
+		Invalidate(CefRect(0, 0, mTextureWidth, mTextureHeight));
+}
 
+////////////////////////////////////////////////////////////
+bool WebInterface::SetUploadBackend(TextureUploader::Backend backend)
+{
+	return mUploader.SetBackend(backend);
+}
+
+////////////////////////////////////////////////////////////
+void WebInterface::SetFullFramePromotion(float fraction)
+{
 	sf::Lock lock(mMutex);
 
-	//Clear the update rects
-	while (mUpdateRects.size() > 0)
+	mPaintDamage.SetPromotionThreshold(fraction);
+	mHandoff.SetPromotionThreshold(fraction);
+}
+
+////////////////////////////////////////////////////////////
+WebInterface::PixelSpan WebInterface::LockFrame()
+{
+	mMutex.lock();
+
+	//SetSize() changes the size before it takes the lock to resize the frame.
+	bool sized = !mFrame.empty() && (int)mFrame.size() == mTextureWidth * mTextureHeight * BYTES_PER_PIXEL;
+
+	PixelSpan span;
+	span.pixels = sized ? &mFrame[0] : NULL;
+	span.width = sized ? mTextureWidth : 0;
+	span.height = sized ? mTextureHeight : 0;
+	span.pitch = span.width * BYTES_PER_PIXEL;
+	span.sequence = mFrameSequence;
+	return span;
+}
+
+////////////////////////////////////////////////////////////
+void WebInterface::UnlockFrame()
+{
+	mMutex.unlock();
+}
+
+////////////////////////////////////////////////////////////
+void WebInterface::SetFrameShadow(bool shadow)
+{
+	{
+		sf::Lock lock(mMutex);
+
+		if (shadow == mFrameShadow)
+			return;
+
+		mFrameShadow = shadow;
+		if (mHeadless)
+			return;
+
+		if (!shadow)
+		{
+			std::vector<sf::Uint8>().swap(mFrame);
+			return;
+		}
+
+		//The shadow only sees what is painted from now on, so paint everything.
+		mFrame.assign(mTextureWidth * mTextureHeight * BYTES_PER_PIXEL, 0);
+		mFramePainted = false;
+	}
+
+	if (mBrowser)
+		Invalidate(CefRect(0, 0, mTextureWidth, mTextureHeight));
+}
+
+////////////////////////////////////////////////////////////
+void WebInterface::RequestSnapshot(float scale, SnapshotCallback callback)
+{
+	if (!callback || scale <= 0.0f)
+		return;
+
+	if (!HasFrameShadow())
+		SetFrameShadow(true);
+
+	WebSystem::SnapshotRequest request;
+	request.mpWeb = this;
+	request.mScale = scale < 1.0f ? scale : 1.0f;
+	request.mfpCallback = callback;
+
+	sf::Lock lock(WebSystem::sSnapshotMutex);
+	WebSystem::sSnapshotQueue.push(request);
+
+	if (!WebSystem::spSnapshotThread)
+	{
+		WebSystem::sSnapshotEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+		WebSystem::spSnapshotThread = new sf::Thread(&WebSystem::SnapshotThread);
+		WebSystem::spSnapshotThread->launch();
+	}
+
+	WebSystem::WakeSnapshotThread();
+}
+
+////////////////////////////////////////////////////////////
+bool WebInterface::StartRecording(const std::string& path)
+{
+	StopRecording();
+
+	PaintRecorder* pRecorder = new PaintRecorder();
+	if (!pRecorder->Start(path))
+	{
+		delete pRecorder;
+		return false;
+	}
+
 	{
-		delete[] mUpdateRects.front().buffer;
-		mUpdateRects.pop();
+		sf::Lock lock(mMutex);
+		mpRecorder = pRecorder;
 	}
 
+	//Get a first paint, which is recorded whole, without waiting for the page to change.
 	if (mBrowser)
-		mBrowser->GetHost()->Invalidate(CefRect(0, 0, mTextureWidth, mTextureHeight), PET_VIEW);
+		Invalidate(CefRect(0, 0, mTextureWidth, mTextureHeight));
+
+	return true;
+}
+
+////////////////////////////////////////////////////////////
+void WebInterface::StopRecording()
+{
+	PaintRecorder* pRecorder = NULL;
+	{
+		sf::Lock lock(mMutex);
+		pRecorder = mpRecorder;
+		mpRecorder = NULL;
+	}
+
+	//Flushing the queue can take a while, so it is done without holding up painting.
+	if (pRecorder)
+	{
+		pRecorder->Stop();
+		delete pRecorder;
+	}
+}
+
+////////////////////////////////////////////////////////////
+void WebInterface::WriteFrame(const char* buffer, int width, int height, const CefRenderHandler::RectList& dirtyRects)
+{
+	//SetSize() resizes the frame, until then paints of the old size are dropped.
+	if ((int)mFrame.size() != width * height * BYTES_PER_PIXEL)
+		return;
+
+	mPaintDamage.SetViewSize(width, height);
+	mPaintDamage.Clear();
+	mPaintDamage.Add(dirtyRects);
+
+	const std::vector<CefRect>& rects = mPaintDamage.GetRects();
+	for (unsigned int i = 0; i < rects.size(); i++)
+	{
+		const CefRect& rect = rects[i];
+		sf::Uint8* dst = &mFrame[(rect.x + rect.y * width) * BYTES_PER_PIXEL];
+		CopyPaintRect(dst, width * BYTES_PER_PIXEL, buffer, width, rect);
+	}
+
+	mFramePainted = true;
+	mFrameSequence++;
+
+	if (mSnapshotWaiting)
+	{
+		mSnapshotWaiting = false;
+		WebSystem::WakeSnapshotThread();
+	}
+}
+
+////////////////////////////////////////////////////////////
+bool WebInterface::TakeSnapshot(float scale, sf::Image& image)
+{
+	int frameWidth, frameHeight;
+	bool bgra;
+	{
+		sf::Lock lock(mMutex);
+
+		if (!mFramePainted || (int)mFrame.size() != mTextureWidth * mTextureHeight * BYTES_PER_PIXEL)
+		{
+			mSnapshotWaiting = true;
+			return false;
+		}
+
+		//Copying is a fraction of the downscale, so this is all painting has to wait for.
+		frameWidth = mTextureWidth;
+		frameHeight = mTextureHeight;
+		bgra = mPixelFormat == TextureUploader::FORMAT_BGRA;
+		mSnapshotFrame.resize(mFrame.size());
+		memcpy(&mSnapshotFrame[0], &mFrame[0], mFrame.size());
+	}
+
+	int width = (int)(frameWidth * scale + 0.5f);
+	int height = (int)(frameHeight * scale + 0.5f);
+	width = width < 1 ? 1 : (width > frameWidth ? frameWidth : width);
+	height = height < 1 ? 1 : (height > frameHeight ? frameHeight : height);
+
+	std::vector<sf::Uint8> pixels(width * height * BYTES_PER_PIXEL);
+	PixelConverter::Downscale(&pixels[0], width * BYTES_PER_PIXEL, width, height,
+		&mSnapshotFrame[0], frameWidth * BYTES_PER_PIXEL, frameWidth, frameHeight, bgra);
+
+	image.create(width, height, &pixels[0]);
+	return true;
 }
 
 ////////////////////////////////////////////////////////////
@@ -870,15 +2698,19 @@ bool WebV8Handler::Execute(const CefString& name,
 	CefRefPtr<CefV8Value>& retval,
 	CefString& exception)
 {
-	//Send message to browser process to call function
+	//Send message to browser process to call function.  Only the binding ID is sent, not the name.
 	CefRefPtr<CefBrowser> browser = CefV8Context::GetCurrentContext()->GetBrowser();
 	CefRefPtr<CefProcessMessage> message = CefProcessMessage::Create("jsbinding_call");
-	message->GetArgumentList()->SetString(0, name);
-	message->GetArgumentList()->SetInt(1, arguments.size());
+
+	CefRefPtr<CefListValue> args = CefListValue::Create();
 	for (unsigned int i = 0; i < arguments.size(); i++)
 	{
-		SetListValue(message->GetArgumentList(), i+2, arguments[i]);
+		SetListValue(args, i, arguments[i]);
 	}
+
+	//args is not owned by anything yet, so SetList() moves it into the message without a copy.
+	message->GetArgumentList()->SetInt(0, mBindingId);
+	message->GetArgumentList()->SetList(1, args);
 	
 	browser->SendProcessMessage(PID_BROWSER, message);
 
@@ -8,6 +8,15 @@
 #include <include/cef_render_handler.h>
 #include <SFML\Graphics.hpp>
 #include <queue>
+#include <vector>
+#include "StagingArena.h"
+#include "FrameHandoff.h"
+#include "TextureUploader.h"
+#include "TextureAtlas.h"
+#include "PaintRecorder.h"
+#include "CommandQueue.h"
+#include "InputState.h"
+#include "InterfaceRegistry.h"
 
 ////////////////////////////////////////////////////////////
 // Pre-processor Definitions
@@ -29,6 +38,52 @@
 #define BYTES_PER_PIXEL 4
 #endif
 
+////////////////////////////////////////////////////////////
+// Number of full views worth of dirty rects a WebInterface can
+// hold before the paint path falls back to the heap.
+//
+////////////////////////////////////////////////////////////
+#ifndef STAGING_ARENA_FRAMES
+#define STAGING_ARENA_FRAMES 3
+#endif
+
+////////////////////////////////////////////////////////////
+// Tile size used for views too large for a single texture,
+// when no tile size has been set for the WebInterface.
+//
+////////////////////////////////////////////////////////////
+#ifndef WEB_INTERFACE_TILE_SIZE
+#define WEB_INTERFACE_TILE_SIZE 512
+#endif
+
+////////////////////////////////////////////////////////////
+// Longest the cef thread sleeps, in milliseconds, when nothing
+// wakes it.  Cef's own timers and messages wake it sooner.
+//
+////////////////////////////////////////////////////////////
+#ifndef WEB_THREAD_MAX_WAIT
+#define WEB_THREAD_MAX_WAIT 50
+#endif
+
+////////////////////////////////////////////////////////////
+// How long, in milliseconds, the cef thread keeps spinning
+// after the last sign of activity in THREAD_ADAPTIVE mode.
+//
+////////////////////////////////////////////////////////////
+#ifndef WEB_THREAD_SPIN_TIME
+#define WEB_THREAD_SPIN_TIME 20
+#endif
+
+////////////////////////////////////////////////////////////
+// Number of input events a WebInterface holds before they
+// are flushed to the cef thread without waiting for the
+// frame to end.
+//
+////////////////////////////////////////////////////////////
+#ifndef WEB_INPUT_QUEUE_SIZE
+#define WEB_INPUT_QUEUE_SIZE 256
+#endif
+
 ////////////////////////////////////////////////////////////
 // Web System Definitions
 ////////////////////////////////////////////////////////////
@@ -43,6 +98,9 @@ public:
 	////////////////////////////////////////////////////////////
 	/// \brief Function pointer to deal with a bound callback.
 	///
+	/// The arguments are those of the javascript call, as sent by the render process, and
+	/// are read only.
+	///
 	////////////////////////////////////////////////////////////
 	typedef bool(*JsCallback) (
 		CefRefPtr<CefListValue> arguments
@@ -77,6 +135,60 @@ public:
 class WebApp;
 class WebInterface;
 
+////////////////////////////////////////////////////////////
+/// \brief Function pointer called with a finished snapshot, see WebInterface::RequestSnapshot().
+///
+/// Called on the snapshot thread.  The image holds RGBA pixels, see sf::Image::getPixelsPtr().
+///
+////////////////////////////////////////////////////////////
+typedef void(*SnapshotCallback) (
+	CefRefPtr<WebInterface> pWeb,
+	const sf::Image& image
+	);
+
+////////////////////////////////////////////////////////////
+/// \brief Function pointer called once the browser of a WebInterface created asynchronously is ready.
+///
+/// Called on the cef thread.
+///
+////////////////////////////////////////////////////////////
+typedef void(*InterfaceCallback) (
+	CefRefPtr<WebInterface> pWeb
+	);
+
+////////////////////////////////////////////////////////////
+/// \brief Everything needed to create a WebInterface, see WebSystem::CreateWebInterfaces().
+///
+////////////////////////////////////////////////////////////
+struct WebInterfaceSpec
+{
+public:
+	////////////////////////////////////////////////////////////
+	/// \param width		Width of the interface texture
+	/// \param height		Height of the interface texture
+	/// \param url			Url to load 
+	/// \param transparent	True to use a transparent background
+	/// \param handle		Handle of the window it is drawn in
+	/// \param headless		True to keep the view in a cpu frame buffer instead of a texture
+	///
+	////////////////////////////////////////////////////////////
+	WebInterfaceSpec(int width, int height, const std::string& url, bool transparent, sf::WindowHandle handle = NULL, bool headless = false)
+		:mWidth(width)
+		, mHeight(height)
+		, mUrl(url)
+		, mTransparent(transparent)
+		, mHandle(handle)
+		, mHeadless(headless)
+	{}
+
+	int mWidth;
+	int mHeight;
+	std::string mUrl;
+	bool mTransparent;
+	sf::WindowHandle mHandle;
+	bool mHeadless;
+};
+
 class WebSystem : public CefBrowserProcessHandler,
 	public CefRenderProcessHandler,
 	public CefClient,
@@ -90,6 +202,33 @@ class WebSystem : public CefBrowserProcessHandler,
 	friend class WebInterface;
 	friend class WebV8Handler;
 public:
+	////////////////////////////////////////////////////////////
+	/// \brief Ways the cef thread can wait for work.
+	///
+	////////////////////////////////////////////////////////////
+	enum ThreadMode
+	{
+		////////////////////////////////////////////////////////////
+		/// Do cef work over and over without waiting.  Uses a whole core, even when idle.
+		///
+		////////////////////////////////////////////////////////////
+		THREAD_SPIN,
+
+		////////////////////////////////////////////////////////////
+		/// Sleep until cef has a message or timer due, a command is queued, or
+		/// WEB_THREAD_MAX_WAIT passes.
+		///
+		////////////////////////////////////////////////////////////
+		THREAD_WAIT,
+
+		////////////////////////////////////////////////////////////
+		/// Spin while there is activity, and wait like THREAD_WAIT once there has been none
+		/// for WEB_THREAD_SPIN_TIME.  The default.
+		///
+		////////////////////////////////////////////////////////////
+		THREAD_ADAPTIVE
+	};
+
 	////////////////////////////////////////////////////////////
 	/// API Methods
 	////////////////////////////////////////////////////////////
@@ -151,6 +290,29 @@ public:
 	////////////////////////////////////////////////////////////
 	static void WaitForWebEnd();
 
+	////////////////////////////////////////////////////////////
+	/// \brief Sets how the cef thread waits for work.
+	///
+	/// \param mode		The mode to use.
+	///
+	////////////////////////////////////////////////////////////
+	static void SetThreadMode(ThreadMode mode);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns how the cef thread waits for work.
+	///
+	////////////////////////////////////////////////////////////
+	static ThreadMode GetThreadMode() { return sThreadMode; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Wakes the cef thread if it is waiting, so it does its work right away.
+	///
+	/// Everything queued through WebSystem wakes it already.  Calls made straight to cef
+	/// wake it through cef's own messages.
+	///
+	////////////////////////////////////////////////////////////
+	static void WakeWebThread();
+
 	////////////////////////////////////////////////////////////
 	/// \brief Queues a custom scheme to be registered for use in WebSystem
 	///
@@ -169,8 +331,109 @@ public:
 	/// \param url			Url to load 
 	/// \param transparent	True to use a transparent background
 	///
+	/// \return The created WebInterface
+	///
+	////////////////////////////////////////////////////////////
+	static CefRefPtr<WebInterface> CreateWebInterfaceSync(int width, int height, const std::string& url, bool transparent, sf::WindowHandle handle);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Creates a headless web interface, and blocks until it is ready.
+	///
+	/// Headless interfaces keep their view in a cpu frame buffer instead of a texture, so
+	/// they need neither an OpenGL context nor a window.  Read the frame with LockFrame().
+	///
+	/// \param width		Width of the view
+	/// \param height		Height of the view
+	/// \param url			Url to load 
+	/// \param transparent	True to use a transparent background
+	///
+	/// \return The created WebInterface
+	///
+	////////////////////////////////////////////////////////////
+	static CefRefPtr<WebInterface> CreateWebInterfaceHeadless(int width, int height, const std::string& url, bool transparent);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Creates a web interface without waiting for its browser.
+	///
+	/// The WebInterface can be drawn and configured right away.  Input sent before its browser
+	/// is ready is dropped.  Poll WebInterface::IsReady(), or pass a callback.
+	///
+	/// \param spec			What to create
+	/// \param callback		Called on the cef thread once the browser is ready, or NULL
+	///
+	/// \return The created WebInterface
+	///
+	////////////////////////////////////////////////////////////
+	static CefRefPtr<WebInterface> CreateWebInterfaceAsync(const WebInterfaceSpec& spec, InterfaceCallback callback = NULL);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Creates several web interfaces without waiting for their browsers.
+	///
+	/// The cef thread starts creating all of the browsers in one pass, so they load side by
+	/// side instead of one after another.  Otherwise like CreateWebInterfaceAsync().
+	///
+	/// \param specs		What to create
+	/// \param interfaces	Receives the created WebInterfaces, in the order of specs
+	/// \param callback		Called on the cef thread as each browser is ready, or NULL
+	///
+	////////////////////////////////////////////////////////////
+	static void CreateWebInterfaces(const std::vector<WebInterfaceSpec>& specs, std::vector<CefRefPtr<WebInterface> >& interfaces, InterfaceCallback callback = NULL);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Loads a page in a hidden WebInterface, ready to take the place of another with SwapIn().
+	///
+	/// The new interface has the size, transparency, texture settings and javascript bindings
+	/// of the one it replaces.  It stays hidden while loading, is shown for a single paint of
+	/// the whole view once loaded, and is hidden again until swapped in.
+	///
+	/// \param pSlot	The WebInterface the page will replace.
+	/// \param url		Url to load.
+	///
+	/// \return The hidden WebInterface.
+	///
+	////////////////////////////////////////////////////////////
+	static CefRefPtr<WebInterface> Prerender(CefRefPtr<WebInterface> pSlot, const std::string& url);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Puts a prerendered WebInterface in place of the one it was made for, once it has painted.
+	///
+	/// Its texture already holds the page, so it can be drawn straight away.  The old
+	/// WebInterface is closed.  Call on the thread which draws, between frames.
+	///
+	/// \param slot			Reference to the WebInterface being replaced, set to pPrerendered.
+	/// \param pPrerendered	WebInterface returned by Prerender().
+	///
+	/// \return False if the page has not painted yet, in which case nothing changes.
+	///
+	////////////////////////////////////////////////////////////
+	static bool SwapIn(CefRefPtr<WebInterface>& slot, CefRefPtr<WebInterface> pPrerendered);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Sets the size of the shared textures atlased WebInterfaces are packed into.
+	///
+	/// Only affects pages created after the call.  Defaults to TEXTURE_ATLAS_PAGE_SIZE.
+	///
+	/// \param size		Width and height of a page in pixels.
+	///
+	////////////////////////////////////////////////////////////
+	static void SetAtlasPageSize(int size);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Keeps spare browsers created ahead of time, so new WebInterfaces are ready in milliseconds.
+	///
+	/// The spares wait hidden on about:blank.  A new WebInterface with the same transparency
+	/// and window as the spec takes one instead of creating a browser, and the pool is topped
+	/// back up in the background.  Closed WebInterfaces give their browser back to the pool
+	/// while it has room, after clearing its javascript bindings and loading about:blank.
+	///
+	/// The pool is off until this is called.  Changing the transparency or window of the spec
+	/// closes the spares there are, as they cannot be changed.
+	///
+	/// \param count	Number of spares to keep.  0 closes them and turns the pool off.
+	/// \param spec		Size, transparency and window of the spares.  The url and headless are ignored.
+	///
 	////////////////////////////////////////////////////////////
-	static WebInterface* CreateWebInterfaceSync(int width, int height, const std::string& url, bool transparent, sf::WindowHandle handle);
+	static void SetBrowserPool(int count, const WebInterfaceSpec& spec);
 
 	////////////////////////////////////////////////////////////
 	/// \brief Redundantly updates the textures of all WebInterfaces
@@ -181,11 +444,62 @@ public:
 	/// This function is used to redundantly update textures on the draw thread, where they cannot
 	/// be interrupted by another thread calling gl_bind on them.
 	///
+	/// WebInterfaces with auto visibility which were not marked drawn since the last call are hidden here.
+	/// The input queued up by every WebInterface is flushed here too, see FlushInput().
+	/// WebInterfaces whose last reference went on another thread are deleted here, see DeleteInterface().
+	/// Atlas pages left empty are released here as well, see TextureAtlas::CollectEmptyPages().
+	///
 	/// \return Pointer to the created WebInterface
 	///
 	////////////////////////////////////////////////////////////
 	static void UpdateInterfaceTextures();
 
+	////////////////////////////////////////////////////////////
+	/// \brief Keeps track of modifier keys and mouse buttons from a window event.
+	///
+	/// Pass every event of the window, before sending it on to WebInterfaces, so the
+	/// modifiers sent with it are those of the event.  InputRouter does this itself.
+	/// Until this is first called, modifiers are asked of the os for every input event.
+	///
+	/// \param event	The event.
+	///
+	////////////////////////////////////////////////////////////
+	static void ProcessEvent(const sf::Event& event) { sInputState.ProcessEvent(event); }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Times javascript binding calls and prints how many go through a second to stdout.
+	///
+	/// Each call is built the way the render process builds it and dispatched the way the
+	/// browser process does, without cef sending it between them.  Calls with 0, 4 and 64
+	/// arguments are timed, first with the message built each time, then dispatch alone.
+	///
+	/// \param iterations	Number of calls to time for each argument count.
+	///
+	////////////////////////////////////////////////////////////
+	static void BenchmarkBindings(int iterations = 100000);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Checks that queued input reaches the browser, and prints the result to stdout.
+	///
+	/// Creates a headless WebInterface on a page which calls a binding when the mouse moves,
+	/// then moves the mouse and flushes until the binding is called.  StartWeb() must have
+	/// been called.
+	///
+	/// \param timeout	Milliseconds to wait for the page to see the input.
+	///
+	/// \return True if the page saw the input in time.
+	///
+	////////////////////////////////////////////////////////////
+	static bool TestInput(int timeout = 10000);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Sends the input queued up by every WebInterface to cef.
+	///
+	/// Called by UpdateInterfaceTextures(), so input goes out once a frame.
+	///
+	////////////////////////////////////////////////////////////
+	static void FlushInput();
+
 	////////////////////////////////////////////////////////////
 	/// \breif This is for accessing the non-static functions of our singleton.
 	///
@@ -260,24 +574,6 @@ public:
 
 private:
 
-	////////////////////////////////////////////////////////////
-	/// \brief Container for custom scheme information
-	///
-	////////////////////////////////////////////////////////////
-	struct RegScheme
-	{
-	public:
-		RegScheme(std::string name, std::string domain, CefRefPtr<CefSchemeHandlerFactory> factory)
-			:mName(name)
-			, mDomain(domain)
-			, mFactory(factory)
-		{}
-		std::string mName;
-		std::string mDomain;
-		CefRefPtr<CefSchemeHandlerFactory> mFactory;
-	};
-
-
 	////////////////////////////////////////////////////////////
 	/// Arguments
 	////////////////////////////////////////////////////////////
@@ -323,407 +619,1568 @@ private:
 	static void WebThread();
 
 	////////////////////////////////////////////////////////////
-	/// \brief A thread instance to run WebThread() on
+	/// \brief Asks for a repaint of the damage each paint rate limited WebInterface is sitting on, once it is due.
 	///
-	////////////////////////////////////////////////////////////
-	static sf::Thread* spThread;
-
-	////////////////////////////////////////////////////////////
-	/// \brief Boolean to signal that the thread should end
+	/// Called by WebThread() after each round of cef work.  Without it, the last paints of a
+	/// page which stops painting between two ticks would never reach the texture.
+	///
+	/// \return True if some damage is still being held back, so the thread should not sleep long.
 	///
 	////////////////////////////////////////////////////////////
-	static bool sEndThread;
+	static bool FlushThrottledPaints();
 
 	////////////////////////////////////////////////////////////
-	/// \brief Queue which stores custom schemes to be initialized within the WebThread
+	/// \brief Hides the browsers of prerendered WebInterfaces again after their one paint.
 	///
-	/// After initialization they are removed from the queue.
+	/// Called by WebThread() after each round of cef work, so the browser is not hidden
+	/// from inside its own paint.
 	///
 	////////////////////////////////////////////////////////////
-	static std::queue<RegScheme> sRegSchemeQueue;
+	static void HidePrerendered();
 
 	////////////////////////////////////////////////////////////
-	/// \brief Queue which stores WebInterfaces which are waiting to have their browser initialized
+	/// \brief Waits for the next work of the cef thread, as sThreadMode says.
 	///
-	/// After initialization they are removed from the queue.
+	/// \param timeout	Longest to wait, in milliseconds.
 	///
 	////////////////////////////////////////////////////////////
-	static std::queue<WebInterface*> sMakeWebInterfaceQueue;
+	static void WaitForWork(unsigned int timeout);
 
 	////////////////////////////////////////////////////////////
-	/// \brief Keeps track of existing WebInterfaces by the ID of their cef browser.
+	/// \brief A thread instance to run WebThread() on
 	///
 	////////////////////////////////////////////////////////////
-	static std::map<int, WebInterface*> sWebInterfaces;
+	static sf::Thread* spThread;
 
 	////////////////////////////////////////////////////////////
-	/// \brief Type for the map containing all javascript bindings.  
+	/// \brief Boolean to signal that the thread should end
 	///
 	////////////////////////////////////////////////////////////
-	typedef std::map<std::pair<std::string, int>,
-		 JsBinding::JsCallback >
-		 BindingMap;
+	static bool sEndThread;
 
 	////////////////////////////////////////////////////////////
-	/// \brief Map containing all javascript bindings.  
+	/// \brief How the cef thread waits for work.
 	///
 	////////////////////////////////////////////////////////////
-	static BindingMap sBindings;
+	static ThreadMode sThreadMode;
 
 	////////////////////////////////////////////////////////////
-	/// \brief Creates a browser and adds it to a WebInterface
+	/// \brief Auto reset event set by WakeWebThread().  Exists while the cef thread runs.
 	///
 	////////////////////////////////////////////////////////////
-	void AddBrowserToInterface(WebInterface* pWeb);
+	static HANDLE sWakeEvent;
 
-	WebSystem(){}
-	~WebSystem(){}
-
-public:
 	////////////////////////////////////////////////////////////
-	/// \brief Implement cef reference counting.
+	/// \brief Time since the cef thread last saw activity.  Only used on the cef thread.
 	///
 	////////////////////////////////////////////////////////////
-	IMPLEMENT_REFCOUNTING(WebSystem);
+	static sf::Clock sActivityClock;
 
 	////////////////////////////////////////////////////////////
-	/// \brief Implement cef locking mechanism.
+	/// \brief Commands waiting for the cef thread, drained after each round of cef work.
 	///
 	////////////////////////////////////////////////////////////
-	IMPLEMENT_LOCKING(WebSystem);
-};
-
-
-////////////////////////////////////////////////////////////
-/// \brief Custom CefApp which is merely used to allow for custom process handlers.
-///
-////////////////////////////////////////////////////////////
-class WebApp : public CefApp
-{
-public:
-	WebApp(){}
+	static CommandQueue sCommands;
 
 	////////////////////////////////////////////////////////////
-	/// Cef process handler retrieval methods.  Called by Cef.
+	/// \brief Commands taken from sCommands in one go.  Only used on the cef thread.
 	///
 	////////////////////////////////////////////////////////////
-	virtual CefRefPtr<CefBrowserProcessHandler> GetBrowserProcessHandler() override { return WebSystem::GetInstance().get(); }
-	virtual CefRefPtr<CefRenderProcessHandler> GetRenderProcessHandler() override { return WebSystem::GetInstance().get(); }
+	static std::vector<WebCommand> sCommandBatch;
 
 	////////////////////////////////////////////////////////////
-	/// \brief Implement cef reference counting.
+	/// \brief Id of the thread running WebThread(), or 0 before it has started.
 	///
 	////////////////////////////////////////////////////////////
-	IMPLEMENT_REFCOUNTING(WebApp);
-};
-
-////////////////////////////////////////////////////////////
-/// \breif Interface for the program to interact with WebSystem.  
-///
-/// Should be held in CefRefPtr container rather than as a raw pointer.
-/// Each instance functions has it's own browser and functions independently.
-/// Do not delete when finished.  Instead call Close() and then release the
-/// CefRefPtr used to reference this object.
-///
-////////////////////////////////////////////////////////////
-class WebInterface : public CefBase
-{
-	friend class WebSystem;
-public:
+	static unsigned long sWebThreadId;
 
 	////////////////////////////////////////////////////////////
-	/// \brief Send a focus event to this WebInterface.
+	/// \brief Hands a command to the cef thread.
 	///
-	/// \param setFocus True to gain focus, false to lose focus.
+	/// Commands run in the order each thread posted them.  Posting from the cef thread itself
+	/// runs the command right away.  If the queue is full this waits for the cef thread to
+	/// make room.
+	///
+	/// \param command	The command.  Its WebInterface is referenced until it has run.  The
+	///					command is dropped if the last reference to it is already gone.
 	///
 	////////////////////////////////////////////////////////////
-	void SendFocusEvent(bool setFocus);
+	static void PostCommand(const WebCommand& command);
 
 	////////////////////////////////////////////////////////////
-	/// \brief Send a mouse click event to this WebInterface
+	/// \brief Runs the commands waiting in sCommands.  Called by WebThread().
 	///
-	/// \param x			Horizontal position of the mouse in local coordinates.
-	/// \param y			Vertical position of the mosue in local coordinates.
-	/// \param button		The mouse button for which we are sending an event.  Left | Middle | Right
-	/// \param mouseUp		Whether the event is for a depression or release of the button.
-	/// \param clickCount	The number of clicks.  Used for double/triple etc. clicks.
+	/// \return True if there were any.
 	///
 	////////////////////////////////////////////////////////////
-	void SendMouseClickEvent(int x, int y, sf::Mouse::Button button, bool mouseUp, int clickCount);
+	static bool RunCommands();
 
 	////////////////////////////////////////////////////////////
-	/// \brief Send a mouse move event to this WebInterface
-	///
-	/// \param x			Horizontal position of the mouse in local coordinates.
-	/// \param y			Vertical position of the mouse in local coordinates.
-	/// \param mouseLeave	Whether the mouse leaves our boundaries.  When in doubt set false.
+	/// \brief Runs one command.  Only called on the cef thread.
 	///
 	////////////////////////////////////////////////////////////
-	void SendMouseMoveEvent(int x, int y, bool mouseLeave = false);
+	static void RunCommand(const WebCommand& command);
 
 	////////////////////////////////////////////////////////////
-	/// \brief Send a mouse wheel event to this WebInterface
-	///
-	/// \param x		Horizontal position of the mouse in local coordinates.
-	/// \param y		Vertical position of the mouse in local coordinates.
-	/// \param deltaX	Change in the horizontal mouse wheel.
-	/// \param deltaY	Change in the vertical mouse wheel.
+	/// \brief Sends the input queued up by a WebInterface to its browser.  Only called on the cef thread.
 	///
 	////////////////////////////////////////////////////////////
-	void SendMouseWheelEvent(int x, int y, int deltaX, int deltaY);
+	static void RunInput(WebInterface* pWeb);
 
 	////////////////////////////////////////////////////////////
-	/// \brief Send a key event to this WebInterface
-	/// 
-	/// \param key			The key being pressed/released.
-	/// \param keyUp		Differentiates between keyup and keydown events.
-	/// \param modifiers	Holds the state of SHIFT/CONTROL/ALT etc. for this key press.  If unspecified will default for Shift, Control, and Alt keys only.
+	/// \brief A snapshot waiting for the snapshot thread.
 	///
 	////////////////////////////////////////////////////////////
-	void SendKeyEvent(WPARAM key, bool keyUp, bool isSystem = false, int modifiers = -1);
+	struct SnapshotRequest
+	{
+	public:
+		CefRefPtr<WebInterface> mpWeb;
+		float mScale;
+		SnapshotCallback mfpCallback;
+	};
 
 	////////////////////////////////////////////////////////////
-	/// \brief Send a key event to this WebInterface
-	/// 
-	/// \param key			The key being pressed/released.
-	/// \param keyUp		Differentiates between keyup and keydown events.
-	/// \param modifiers	Holds the state of SHIFT/CONTROL/ALT etc. for this key press.  If unspecified will default for Shift, Control, and Alt keys only.
+	/// \brief Snapshots waiting to be taken, guarded by sSnapshotMutex.
 	///
 	////////////////////////////////////////////////////////////
-	void SendKeyEvent(char key, int modifiers = -1);
-
+	static std::queue<SnapshotRequest> sSnapshotQueue;
 
 	////////////////////////////////////////////////////////////
-	/// \brief Adds a javascript binding to this WebInterface
+	/// \brief References the snapshot thread is done with, for the app thread to let go of.
+	///
+	/// The snapshot thread never releases a WebInterface itself, so it is never the one to
+	/// tear it down.
+	///
+	////////////////////////////////////////////////////////////
+	static std::vector<CefRefPtr<WebInterface> > sSnapshotReleases;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Guards sSnapshotQueue, sSnapshotReleases and spSnapshotThread.
+	///
+	////////////////////////////////////////////////////////////
+	static sf::Mutex sSnapshotMutex;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Thread which downscales snapshots, started by the first request.
+	///
+	////////////////////////////////////////////////////////////
+	static sf::Thread* spSnapshotThread;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Auto reset event set by WakeSnapshotThread().  Exists while the snapshot thread runs.
+	///
+	////////////////////////////////////////////////////////////
+	static HANDLE sSnapshotEvent;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Runs the snapshot thread until EndWeb().
+	///
+	/// Sleeps until a snapshot is requested, or a frame a request waits for is painted.
+	///
+	////////////////////////////////////////////////////////////
+	static void SnapshotThread();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Wakes the snapshot thread, if it is running.  Can be called from any thread.
+	///
+	////////////////////////////////////////////////////////////
+	static void WakeSnapshotThread();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Hands references the snapshot thread is done with to sSnapshotReleases.
+	///
+	/// \param released	The references, emptied.
+	///
+	////////////////////////////////////////////////////////////
+	static void HandBackSnapshotInterfaces(std::vector<CefRefPtr<WebInterface> >& released);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Lets go of the references in sSnapshotReleases.  Only call on the app thread.
+	///
+	////////////////////////////////////////////////////////////
+	static void ReleaseSnapshotInterfaces();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Keeps track of existing WebInterfaces by the ID of their cef browser.
+	///
+	/// Look up only inside an InterfaceRegistry::ReadScope, or walk it with an
+	/// InterfaceRegistry::Iterator.
+	///
+	////////////////////////////////////////////////////////////
+	static InterfaceRegistry sWebInterfaces;
+
+	////////////////////////////////////////////////////////////
+	/// \brief WebInterfaces whose last reference is gone, waiting for the app thread to delete them.
+	///
+	/// The last reference can go on any thread, but a WebInterface must be torn down on the
+	/// app thread, which owns its textures.
+	///
+	////////////////////////////////////////////////////////////
+	static std::vector<WebInterface*> sReleasedInterfaces;
+
+	////////////////////////////////////////////////////////////
+	/// \brief True while cef runs, so released WebInterfaces are left for the app thread.
+	///
+	////////////////////////////////////////////////////////////
+	static bool sDeferInterfaceDeletes;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Guards sReleasedInterfaces and sDeferInterfaceDeletes.
+	///
+	////////////////////////////////////////////////////////////
+	static sf::Mutex sReleasedMutex;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Deletes a WebInterface whose last reference is gone, or leaves it for the app thread.
+	///
+	////////////////////////////////////////////////////////////
+	static void DeleteInterface(WebInterface* pWeb);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Deletes the WebInterfaces left by DeleteInterface().  Only call on the app thread.
+	///
+	////////////////////////////////////////////////////////////
+	static void DeleteReleasedInterfaces();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Type for the map containing all javascript bindings.  
+	///
+	/// Maps the name and browser ID of a binding to its binding ID.
+	///
+	////////////////////////////////////////////////////////////
+	typedef std::map<std::pair<std::string, int>,
+		 int >
+		 BindingMap;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Map containing all javascript bindings.  
+	///
+	////////////////////////////////////////////////////////////
+	static BindingMap sBindings;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Binding IDs the render process was sent, by name and browser.  Only used in the render process.
+	///
+	/// Kept apart from sBindings, as in single process mode both sides share the statics.
+	///
+	////////////////////////////////////////////////////////////
+	static BindingMap sRendererBindings;
+
+	////////////////////////////////////////////////////////////
+	/// \brief A bound callback and the browser it was bound for.
+	///
+	////////////////////////////////////////////////////////////
+	struct BoundCallback
+	{
+	public:
+		JsBinding::JsCallback mfpCallback;
+		int mBrowser;
+
+		////////////////////////////////////////////////////////////
+		/// \brief How often the slot has been reused, carried in the binding ID.
+		///
+		////////////////////////////////////////////////////////////
+		int mGeneration;
+	};
+
+	////////////////////////////////////////////////////////////
+	/// \brief Binding IDs hold the slot in sBindingCallbacks in their low bits, and the
+	/// generation of the slot above.
+	///
+	////////////////////////////////////////////////////////////
+	static const int BINDING_SLOT_BITS = 20;
+	static const int BINDING_SLOT_MASK = (1 << BINDING_SLOT_BITS) - 1;
+	static const int BINDING_GENERATION_MASK = (1 << (31 - BINDING_SLOT_BITS)) - 1;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Bound callbacks, indexed by the slot of their binding ID.  Only used in the browser process.
+	///
+	/// Slots of removed bindings are reused with the next generation, so an ID from a render
+	/// process which has not caught up yet does not reach the binding now in its slot.
+	///
+	////////////////////////////////////////////////////////////
+	static std::vector<BoundCallback> sBindingCallbacks;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Slots in sBindingCallbacks whose bindings were removed, to be reused.
+	///
+	////////////////////////////////////////////////////////////
+	static std::vector<int> sFreeBindings;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Guards sBindings, sRendererBindings, sBindingCallbacks and sFreeBindings, which are added to from any thread.
+	///
+	////////////////////////////////////////////////////////////
+	static sf::Mutex sBindingMutex;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Gives a binding its ID, or returns the one it already has.
+	///
+	/// \param name		Call sign of the function in javascript.
+	/// \param browser		ID of the browser the binding is for.
+	/// \param callback	Pointer to the function in c++.
+	///
+	/// \return The binding ID.
+	///
+	////////////////////////////////////////////////////////////
+	static int InternBinding(const std::string& name, int browser, JsBinding::JsCallback callback);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Removes every binding of a browser, and frees their slots.  Only call in the browser process.
+	///
+	////////////////////////////////////////////////////////////
+	static void ClearBindings(int browser);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Forgets the binding IDs the render process was sent for a browser.  Only call in the render process.
+	///
+	////////////////////////////////////////////////////////////
+	static void EraseRendererBindings(int browser);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Calls a bound callback by its binding ID.
+	///
+	/// \param browser		ID of the browser the call came from.  Bindings of other browsers are not called.
+	/// \param id			The binding ID.
+	/// \param arguments	Arguments, handed to the callback as they are.
+	///
+	/// \return The result of the callback, false if there is none.
+	///
+	////////////////////////////////////////////////////////////
+	static bool CallBinding(int browser, int id, CefRefPtr<CefListValue> arguments);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Shared textures which atlased WebInterfaces are packed into.
+	///
+	////////////////////////////////////////////////////////////
+	static TextureAtlas sAtlas;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Modifiers and mouse buttons, kept by ProcessEvent().
+	///
+	////////////////////////////////////////////////////////////
+	static InputState sInputState;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Starts creating the browser of a WebInterface, which gets it in OnAfterCreated().
+	///
+	////////////////////////////////////////////////////////////
+	void AddBrowserToInterface(WebInterface* pWeb);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Gives a new browser to a WebInterface and starts sending it paints.
+	///
+	////////////////////////////////////////////////////////////
+	void AttachBrowser(WebInterface* pWeb, CefRefPtr<CefBrowser> browser);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Checks whether a WebInterface can use the browsers of the pool.
+	///
+	////////////////////////////////////////////////////////////
+	static bool IsPoolable(WebInterface* pWeb);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Creates or closes spares until the pool has sPoolSize.  Only called on the cef thread.
+	///
+	////////////////////////////////////////////////////////////
+	static void FillPool();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Takes the browser from a WebInterface, and pools or closes it.  Only called on the cef thread.
+	///
+	/// \param pWeb		The WebInterface being closed.
+	/// \param force	True to force the browser to close, if it is closed.
+	///
+	////////////////////////////////////////////////////////////
+	static void RecycleBrowser(WebInterface* pWeb, bool force);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Spare browsers, hidden on about:blank.  Only used on the cef thread.
+	///
+	////////////////////////////////////////////////////////////
+	static std::vector<CefRefPtr<CefBrowser> > sBrowserPool;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Spares being created.  Only used on the cef thread.
+	///
+	////////////////////////////////////////////////////////////
+	static int sPoolPending;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Number of spares to keep, and what they look like.  Guarded by sPoolMutex.
+	///
+	////////////////////////////////////////////////////////////
+	static int sPoolSize;
+	static WebInterfaceSpec sPoolSpec;
+	static sf::Mutex sPoolMutex;
+
+	WebSystem(){}
+	~WebSystem(){}
+
+public:
+	////////////////////////////////////////////////////////////
+	/// \brief Implement cef reference counting.
+	///
+	////////////////////////////////////////////////////////////
+	IMPLEMENT_REFCOUNTING(WebSystem);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Implement cef locking mechanism.
+	///
+	////////////////////////////////////////////////////////////
+	IMPLEMENT_LOCKING(WebSystem);
+};
+
+
+////////////////////////////////////////////////////////////
+/// \brief Custom CefApp which is merely used to allow for custom process handlers.
+///
+////////////////////////////////////////////////////////////
+class WebApp : public CefApp
+{
+public:
+	WebApp(){}
+
+	////////////////////////////////////////////////////////////
+	/// Cef process handler retrieval methods.  Called by Cef.
+	///
+	////////////////////////////////////////////////////////////
+	virtual CefRefPtr<CefBrowserProcessHandler> GetBrowserProcessHandler() override { return WebSystem::GetInstance().get(); }
+	virtual CefRefPtr<CefRenderProcessHandler> GetRenderProcessHandler() override { return WebSystem::GetInstance().get(); }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Implement cef reference counting.
+	///
+	////////////////////////////////////////////////////////////
+	IMPLEMENT_REFCOUNTING(WebApp);
+};
+
+////////////////////////////////////////////////////////////
+/// \breif Interface for the program to interact with WebSystem.  
+///
+/// Should be held in CefRefPtr container rather than as a raw pointer.
+/// Each instance functions has it's own browser and functions independently.
+/// Do not delete when finished.  Instead call Close() and then release the
+/// CefRefPtr used to reference this object.
+///
+////////////////////////////////////////////////////////////
+class WebInterface : public CefBase
+{
+	friend class WebSystem;
+public:
+	////////////////////////////////////////////////////////////
+	/// \brief Ways in which painted rects can reach the texture.
+	///
+	////////////////////////////////////////////////////////////
+	enum UpdateMode
+	{
+		////////////////////////////////////////////////////////////
+		/// OnPaint updates the texture on the cef thread, and queues the same rects to be
+		/// redundantly updated again by UpdateTexture().  This is the default.
+		///
+		////////////////////////////////////////////////////////////
+		UPDATE_REDUNDANT,
+
+		////////////////////////////////////////////////////////////
+		/// OnPaint only writes the rects into a triple buffered frame which it hands off to
+		/// the draw thread without locking.  UpdateTexture() uploads each changed region once,
+		/// and all texture work happens on the draw thread.
+		///
+		////////////////////////////////////////////////////////////
+		UPDATE_HANDOFF
+	};
+
+	////////////////////////////////////////////////////////////
+	/// \brief What the last call to UpdateTexture() uploaded.
+	///
+	////////////////////////////////////////////////////////////
+	struct UploadStats
+	{
+	public:
+		unsigned int rects;
+		unsigned int bytes;
+	};
+
+	////////////////////////////////////////////////////////////
+	/// \brief Read only view of the frame buffer of a headless WebInterface.
+	///
+	////////////////////////////////////////////////////////////
+	struct PixelSpan
+	{
+	public:
+		////////////////////////////////////////////////////////////
+		/// \brief Rows of pixels, top to bottom, in the channel order of GetPixelFormat().
+		///
+		////////////////////////////////////////////////////////////
+		const sf::Uint8* pixels;
+		int width;
+		int height;
+
+		////////////////////////////////////////////////////////////
+		/// \brief Bytes from the start of one row to the start of the next.
+		///
+		////////////////////////////////////////////////////////////
+		int pitch;
+
+		////////////////////////////////////////////////////////////
+		/// \brief Number of paints applied to the frame so far.
+		///
+		////////////////////////////////////////////////////////////
+		unsigned int sequence;
+	};
+
+	////////////////////////////////////////////////////////////
+	/// \brief Sends the input events queued up since the last flush to cef, as one batch.
+	///
+	/// Mouse and key events are not sent to cef one by one.  They wait in a queue until the
+	/// frame ends, see WebSystem::UpdateInterfaceTextures().  Consecutive mouse moves are
+	/// merged into the last one, and consecutive wheel events into one with their deltas
+	/// added up, so a fast mouse costs one move a frame.  Clicks, keys and focus changes are
+	/// kept as they are, in order with the moves around them.
+	///
+	/// Call this to send input sooner, or when UpdateInterfaceTextures() is not used.
+	///
+	////////////////////////////////////////////////////////////
+	void FlushInput();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Send a focus event to this WebInterface.
+	///
+	/// \param setFocus True to gain focus, false to lose focus.
+	///
+	////////////////////////////////////////////////////////////
+	void SendFocusEvent(bool setFocus);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Send a mouse click event to this WebInterface
+	///
+	/// \param x			Horizontal position of the mouse in local coordinates.
+	/// \param y			Vertical position of the mosue in local coordinates.
+	/// \param button		The mouse button for which we are sending an event.  Left | Middle | Right
+	/// \param mouseUp		Whether the event is for a depression or release of the button.
+	/// \param clickCount	The number of clicks.  Used for double/triple etc. clicks.
+	///
+	////////////////////////////////////////////////////////////
+	void SendMouseClickEvent(int x, int y, sf::Mouse::Button button, bool mouseUp, int clickCount);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Send a mouse move event to this WebInterface
+	///
+	/// \param x			Horizontal position of the mouse in local coordinates.
+	/// \param y			Vertical position of the mouse in local coordinates.
+	/// \param mouseLeave	Whether the mouse leaves our boundaries.  When in doubt set false.
+	///
+	////////////////////////////////////////////////////////////
+	void SendMouseMoveEvent(int x, int y, bool mouseLeave = false);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Send a mouse wheel event to this WebInterface
+	///
+	/// \param x		Horizontal position of the mouse in local coordinates.
+	/// \param y		Vertical position of the mouse in local coordinates.
+	/// \param deltaX	Change in the horizontal mouse wheel.
+	/// \param deltaY	Change in the vertical mouse wheel.
+	///
+	////////////////////////////////////////////////////////////
+	void SendMouseWheelEvent(int x, int y, int deltaX, int deltaY);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Send a key event to this WebInterface
+	/// 
+	/// \param key			The key being pressed/released.
+	/// \param keyUp		Differentiates between keyup and keydown events.
+	/// \param modifiers	Holds the state of SHIFT/CONTROL/ALT etc. for this key press.  If unspecified will default for Shift, Control, and Alt keys only.
+	///
+	////////////////////////////////////////////////////////////
+	void SendKeyEvent(WPARAM key, bool keyUp, bool isSystem = false, int modifiers = -1);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Send a key event to this WebInterface
+	/// 
+	/// \param key			The key being pressed/released.
+	/// \param keyUp		Differentiates between keyup and keydown events.
+	/// \param modifiers	Holds the state of SHIFT/CONTROL/ALT etc. for this key press.  If unspecified will default for Shift, Control, and Alt keys only.
+	///
+	////////////////////////////////////////////////////////////
+	void SendKeyEvent(char key, int modifiers = -1);
+
+
+	////////////////////////////////////////////////////////////
+	/// \brief Adds a javascript binding to this WebInterface
+	///
+	/// Can be called before the browser exists, in which case the binding is added as soon
+	/// as the browser is created.
 	///
 	/// \param name			Call sign of this function for javascript.
 	/// \param callback		Pointer to the bound function.
 	///
 	////////////////////////////////////////////////////////////
-	void AddJSBinding(const std::string name, JsBinding::JsCallback callback);
+	void AddJSBinding(const std::string name, JsBinding::JsCallback callback);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Adds a list of javascript bindings to this WebInterface
+	/// 
+	/// \param bindings List of bindings to be added.
+	///
+	/// Calling this is more efficient than multiple calls of AddJsBinding() as it only reloads
+	/// the browser once rather than once per binding.  
+	///
+	////////////////////////////////////////////////////////////
+	void AddJSBindings(const std::vector<JsBinding> bindings);
+
+
+	////////////////////////////////////////////////////////////
+	/// \brief Executes javascript.  
+	///
+	/// \param code		Code to be executed.
+	///
+	////////////////////////////////////////////////////////////
+	void ExecuteJS(const CefString& code);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Exectues javascript in specified frame.  
+	///
+	/// \param code		Code to be executed.
+	/// \param frame	Frame to be used for execution.
+	///
+	////////////////////////////////////////////////////////////
+	void ExecuteJS(const CefString& code, CefRefPtr<CefFrame> frame);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Executes javascript in specified frame, with specified start line.
+	///
+	/// \param code			Code to be executed.
+	/// \param frame		Frame to be used for execution.
+	/// \param startLine	Line to be used as starting position.
+	///
+	////////////////////////////////////////////////////////////
+	void ExecuteJS(const CefString& code, CefRefPtr<CefFrame> frame, int startLine);
+
+
+	////////////////////////////////////////////////////////////
+	/// \brief Called internally to handle javascript callbacks.  
+	///
+	/// Can also be called externally to fake javascript callbacks for testing etc..
+	///
+	/// \return Success of the callback.
+	///
+	////////////////////////////////////////////////////////////
+	bool JSCallback(const CefString& name,
+		CefRefPtr<CefListValue> arguments
+		);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Calls one of our javascript bindings by its binding ID.
+	///
+	/// \return Success of the callback.
+	///
+	////////////////////////////////////////////////////////////
+	bool JSCallback(int id,
+		CefRefPtr<CefListValue> arguments
+		);
+
+
+	////////////////////////////////////////////////////////////
+	/// \brief Construct a web interface.
+	///
+	/// \param width			Horizontal size of the WebInterface.
+	/// \param height			Vertical size of the WebInterface.
+	/// \param url				Url to load upon construction.
+	/// \param transparent		Background transparency.
+	/// \param headless			True to keep the view in a cpu frame buffer, with no texture.
+	///
+	////////////////////////////////////////////////////////////
+	WebInterface(int width, int height, const std::string& url, bool transparent, sf::WindowHandle handle, bool headless = false);
+	virtual ~WebInterface();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Closes this WebInterface so that it can be released.
+	///
+	/// \param force	True will force the browser to close.  False will allow the user to cancel the close.
+	///
+	/// If the close is not forced, the WebInterface is not guaranteed to be
+	/// ready for release, which can cause a memory leak if not tracked carefully.
+	///
+	/// When the browser pool has room for it, the browser is not closed but reset and kept as a
+	/// spare, see WebSystem::SetBrowserPool().
+	///
+	////////////////////////////////////////////////////////////
+	void Close(bool force = true);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Accesses the browser related this WebInterface
+	///
+	/// \return CefRefPtr referencing the browser related to this WebInterface.
+	///
+	////////////////////////////////////////////////////////////
+	CefRefPtr<CefBrowser> GetBrowser() { return mBrowser; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Checks whether the browser has been created, for interfaces created asynchronously.
+	///
+	/// \return True once the browser is ready, until it is closed.
+	///
+	////////////////////////////////////////////////////////////
+	bool IsReady() { return mBrowser.get() != NULL; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Checks whether a WebInterface made by WebSystem::Prerender() has painted its page.
+	///
+	/// \return True once it can be swapped in.
+	///
+	////////////////////////////////////////////////////////////
+	bool IsPrerendered() { return mPrerendered; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the width of this WebInterface.
+	///
+	/// \return Width of this WebInterface.
+	///
+	////////////////////////////////////////////////////////////
+	int GetWidth() { return mTextureWidth; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the height of this WebInterface.
+	///
+	/// \return Height of this WebInterface.
+	///
+	////////////////////////////////////////////////////////////
+	int GetHeight() { return mTextureHeight; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Performs the redundancy update for our texture.  
+	///
+	/// This will be called for all WebInterfaces by WebSystem::UpdateInterfaceTextures().
+	/// It can also be called manually for each texture, but as it must be called each frame
+	/// in which an OnPaint for the WebInterface, it is much safter to use WebSystem::UpdateInterfaceTextures().
+	///
+	/// In UPDATE_HANDOFF mode this is the only place the texture is updated.
+	///
+	////////////////////////////////////////////////////////////
+	void UpdateTexture();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Applies a paint of the view, as handed over by cef.
+	///
+	/// WebSystem::OnPaint() calls this on the cef thread.  It can also be called directly,
+	/// without a browser, to feed recorded or synthetic paints through the same path; see
+	/// PaintReplay.  A paint of a different size than the WebInterface is ignored.
+	///
+	/// \param dirtyRects	Rects which changed.
+	/// \param buffer		The whole view, BGRA.
+	/// \param width		Width of the view.
+	/// \param height		Height of the view.
+	///
+	////////////////////////////////////////////////////////////
+	void Paint(const CefRenderHandler::RectList& dirtyRects, const void* buffer, int width, int height);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the texture of this WebInterface.
+	///
+	/// \return Pointer to the texture of this WebInterface, or NULL if it is tiled.
+	///
+	////////////////////////////////////////////////////////////
+	sf::Texture* GetTexture() { return mpTexture; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the part of GetTexture() which holds this WebInterface.
+	///
+	/// This is the whole texture unless the WebInterface is atlased.
+	///
+	/// \return Rect of the texture in pixels, e.g. for sf::Sprite::setTextureRect().
+	///
+	////////////////////////////////////////////////////////////
+	sf::IntRect GetTextureRect();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Moves this WebInterface into or out of the shared texture atlas.
+	///
+	/// Atlased WebInterfaces share a few large textures, so an AtlasBatch can draw all of
+	/// them with one call per page.  GetTexture() and GetTextureRect() change, so sprites
+	/// need setting up again.  The whole view is repainted.
+	///
+	/// \param atlased	True to move into the atlas, false to get an own texture back.
+	///
+	/// \return False if the WebInterface is tiled, or does not fit in an atlas page, and keeps its own texture.
+	///
+	////////////////////////////////////////////////////////////
+	bool SetAtlased(bool atlased);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns whether this WebInterface lives in the shared texture atlas.
+	///
+	/// \return True if atlased.
+	///
+	////////////////////////////////////////////////////////////
+	bool IsAtlased() { return mAtlased; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Splits the texture of this WebInterface into a grid of square tiles.
+	///
+	/// Each dirty rect is then only uploaded to the tiles it touches, and the view can be
+	/// larger than the biggest texture the driver supports.  Views which are that large are
+	/// tiled with WEB_INTERFACE_TILE_SIZE even without a tile size.  Tiled WebInterfaces are
+	/// never atlased, have no GetTexture(), and are drawn with Draw() or an AtlasBatch.
+	/// The whole view is repainted.
+	///
+	/// \param size		Width and height of a tile, e.g. 256 or 512.  0 uses a single texture.
+	///
+	////////////////////////////////////////////////////////////
+	void SetTileSize(int size);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the size of the tiles in use.
+	///
+	/// \return Width and height of a tile, or 0 if a single texture is used.
+	///
+	////////////////////////////////////////////////////////////
+	int GetTileSize() { return mActiveTileSize; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns whether this WebInterface is split into tiles.
+	///
+	/// \return True if tiled.
+	///
+	////////////////////////////////////////////////////////////
+	bool IsTiled() { return mActiveTileSize > 0; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the number of tiles, row by row from the top left.
+	///
+	/// \return Number of tiles, 0 if not tiled.
+	///
+	////////////////////////////////////////////////////////////
+	int GetTileCount() { return (int)mTiles.size(); }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the texture of a tile.
+	///
+	/// Tiles on the right and bottom edges are only as large as the part of the view they cover.
+	///
+	/// \param index	Index of the tile.
+	///
+	/// \return The texture of the tile.
+	///
+	////////////////////////////////////////////////////////////
+	sf::Texture* GetTile(int index) { return mTiles[index]; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the part of the view a tile covers.
+	///
+	/// \param index	Index of the tile.
+	///
+	/// \return Rect of the view in pixels, e.g. for placing the tile with sf::Sprite::setPosition().
+	///
+	////////////////////////////////////////////////////////////
+	sf::IntRect GetTileRect(int index);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Draws this WebInterface with its render states, whether tiled or not.
+	///
+	/// \param target		Target to draw to.
+	/// \param transform	Placement of the WebInterface, e.g. an sf::Sprite's getTransform().
+	///
+	////////////////////////////////////////////////////////////
+	void Draw(sf::RenderTarget& target, const sf::Transform& transform);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the url of the currently loaded web page.
+	///
+	/// \return URL of the currently loaded web page.
+	///
+	////////////////////////////////////////////////////////////
+	std::string GetCurrentURL() { return mCurrentURL; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns background transparency.
+	///
+	/// \return Boolean representing background transparency.
+	///
+	////////////////////////////////////////////////////////////
+	bool IsTransparent() { return mTransparent; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Used to change the size of this WebInterface.
+	///
+	/// \param width	New horizontal size.
+	/// \param height	New vertical size.
+	///
+	////////////////////////////////////////////////////////////
+	void SetSize(int width, int height);
 
 	////////////////////////////////////////////////////////////
-	/// \brief Adds a list of javascript bindings to this WebInterface
-	/// 
-	/// \param bindings List of bindings to be added.
+	/// \brief Changes how painted rects reach the texture of this WebInterface.
+	///
+	/// Pending rects are discarded and the whole view is repainted.
+	///
+	/// \param mode	The new update mode.
+	///
+	////////////////////////////////////////////////////////////
+	void SetUpdateMode(UpdateMode mode);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns how painted rects reach the texture of this WebInterface.
+	///
+	/// \return The current update mode.
+	///
+	////////////////////////////////////////////////////////////
+	UpdateMode GetUpdateMode() { return mUpdateMode; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Limits how often paints of this WebInterface reach its texture.
+	///
+	/// Paints arriving sooner than 1 / fps seconds after the last one which was applied are
+	/// not copied or uploaded.  Their damage is held back and applied together with the next
+	/// paint which is allowed through, or repainted once the next tick is due.
+	/// Useful for ambient panels with animations nobody needs to see at full rate.
+	///
+	/// \param fps	Highest number of paints per second, such as 60, 30, 10 or 1.  0 for no limit, which is the default.
+	///
+	////////////////////////////////////////////////////////////
+	void SetMaxPaintRate(float fps);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the highest number of paints per second which reach the texture.
+	///
+	/// \return Paints per second, or 0 if unlimited.
+	///
+	////////////////////////////////////////////////////////////
+	float GetMaxPaintRate() { return mMaxPaintRate; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Shows or hides this WebInterface.
+	///
+	/// A hidden WebInterface tells cef it was hidden, so the page stops rendering, and
+	/// any paints still arriving are dropped instead of being copied and uploaded.
+	/// Showing it again repaints the whole view once to catch the texture up.
+	///
+	/// \param visible	False to hide, true to show.
+	///
+	////////////////////////////////////////////////////////////
+	void SetVisible(bool visible);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns whether this WebInterface is visible.
+	///
+	/// \return False if hidden.
+	///
+	////////////////////////////////////////////////////////////
+	bool IsVisible() { return mVisible; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Lets WebSystem::UpdateInterfaceTextures() decide visibility from MarkDrawn().
+	///
+	/// A WebInterface which has not been marked drawn since the previous call to
+	/// UpdateInterfaceTextures() is hidden, and shown again as soon as it is marked.
+	///
+	/// \param automatic	True to manage visibility automatically.
+	///
+	////////////////////////////////////////////////////////////
+	void SetAutoVisibility(bool automatic) { mAutoVisibility = automatic; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns whether visibility is managed automatically.
+	///
+	/// \return True if automatic.
+	///
+	////////////////////////////////////////////////////////////
+	bool GetAutoVisibility() { return mAutoVisibility; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Records that the texture of this WebInterface is being drawn this frame.
+	///
+	/// Only needed with auto visibility.  Call it whenever the texture is drawn, or at least
+	/// once per frame in which it is on screen.
+	///
+	////////////////////////////////////////////////////////////
+	void MarkDrawn();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Sets whether the texture of this WebInterface holds premultiplied alpha.
+	///
+	/// Cef paints transparent pages with premultiplied alpha, and that is what ends up in
+	/// the texture.  In premultiplied mode GetRenderStates() returns states which composite
+	/// it correctly, so nothing has to be un-premultiplied on the cpu.  Defaults to whether
+	/// the WebInterface is transparent and has a texture.  Opaque pages look the same either way.
+	///
+	/// Premultiplied mode needs a shader, see IsPremultipliedAlphaSupported().  Without one
+	/// the WebInterface stays in straight alpha mode.  Must be called from the thread which draws.
+	///
+	/// \param premultiplied	True if the texture should be drawn as premultiplied alpha.
+	///
+	/// \return False if premultiplied mode was asked for but is not supported.
+	///
+	////////////////////////////////////////////////////////////
+	bool SetPremultipliedAlpha(bool premultiplied);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns whether the texture of this WebInterface is drawn as premultiplied alpha.
+	///
+	/// \return True in premultiplied mode.
+	///
+	////////////////////////////////////////////////////////////
+	bool IsPremultipliedAlpha() { return mPremultipliedAlpha; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the render states to draw the texture of this WebInterface with.
+	///
+	/// Only needed for premultiplied mode, otherwise these are the default states.
+	/// Set the transform on the returned states, or draw through an sf::Sprite, as usual.
+	///
+	/// \return Render states for drawing this WebInterface.
+	///
+	////////////////////////////////////////////////////////////
+	sf::RenderStates GetRenderStates();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns render states which composite a premultiplied alpha texture correctly.
+	///
+	/// SFML only blends straight alpha, so the states carry a shader which undoes the
+	/// premultiplication after texture filtering and before the straight alpha blend.
+	/// The division happens on the gpu, per drawn pixel.  If the shader is not supported
+	/// the default states are returned.  Must be called from the thread which draws.
+	///
+	/// \return Render states for drawing premultiplied textures.
+	///
+	////////////////////////////////////////////////////////////
+	static sf::RenderStates GetPremultipliedRenderStates();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Checks whether premultiplied textures can be drawn correctly.
+	///
+	/// Creates the shader GetPremultipliedRenderStates() uses on the first call.  If shaders
+	/// are not available or it fails to compile, that is reported once to sf::err().
+	/// Must be called from the thread which draws.
+	///
+	/// \return True if the shader exists.
+	///
+	////////////////////////////////////////////////////////////
+	static bool IsPremultipliedAlphaSupported();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Changes the channel order painted rects are uploaded in.
+	///
+	/// TextureUploader::FORMAT_BGRA uploads the pixels exactly as cef paints them and lets
+	/// OpenGL reorder the channels, so the paint path only copies them.  FORMAT_RGBA converts
+	/// them on the cpu first, which is the default.  Pending rects are discarded and the whole
+	/// view is repainted.
+	///
+	/// \param format	The new pixel format.
+	///
+	////////////////////////////////////////////////////////////
+	void SetPixelFormat(TextureUploader::Format format);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the channel order painted rects are uploaded in.
+	///
+	/// \return The current pixel format.
+	///
+	////////////////////////////////////////////////////////////
+	TextureUploader::Format GetPixelFormat() { return mPixelFormat; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Changes how UpdateTexture() gets pixels to the texture of this WebInterface.
+	///
+	/// TextureUploader::BACKEND_PBO streams uploads through pixel buffer objects so the draw
+	/// thread does not stall on them.  Must be called from the thread which draws.
+	///
+	/// \param backend	The new upload backend.
+	///
+	/// \return False if the backend is not supported by the driver, in which case uploads stay synchronous.
+	///
+	////////////////////////////////////////////////////////////
+	bool SetUploadBackend(TextureUploader::Backend backend);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns how UpdateTexture() gets pixels to the texture of this WebInterface.
+	///
+	/// \return The current upload backend.
+	///
+	////////////////////////////////////////////////////////////
+	TextureUploader::Backend GetUploadBackend() { return mUploader.GetBackend(); }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Sets how much of the view must change before a paint is uploaded as one full view.
+	///
+	/// Dirty rects are merged into as few disjoint rects as possible.  When they cover at least
+	/// this fraction of the view, a single full view upload is done instead.
+	///
+	/// \param fraction	Between 0 and 1.  Defaults to DAMAGE_REGION_PROMOTION.
+	///
+	////////////////////////////////////////////////////////////
+	void SetFullFramePromotion(float fraction);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns what the last call to UpdateTexture() uploaded.
+	///
+	/// \return Number of rects and bytes uploaded.
+	///
+	////////////////////////////////////////////////////////////
+	const UploadStats& GetUploadStats() { return mUploadStats; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns whether this WebInterface keeps its view in a cpu frame buffer.
+	///
+	/// Headless interfaces have no texture, are never atlased or tiled, and do nothing in
+	/// UpdateTexture() or Draw().
+	///
+	/// \return True if headless.
+	///
+	////////////////////////////////////////////////////////////
+	bool IsHeadless() { return mHeadless; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Locks the frame buffer and returns a view of it.
+	///
+	/// Only headless WebInterfaces and those with a frame shadow have a frame buffer.
+	/// Painting waits while the frame is locked, so call UnlockFrame() as soon as possible.
+	/// The pixels are only valid until then.
+	///
+	/// \return The frame, with NULL pixels if there is no frame buffer or it is being resized.
+	///
+	////////////////////////////////////////////////////////////
+	PixelSpan LockFrame();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Unlocks the frame buffer locked by LockFrame().
+	///
+	////////////////////////////////////////////////////////////
+	void UnlockFrame();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the number of paints applied to the frame buffer so far.
+	///
+	/// Cheap enough to poll, to find out whether the frame changed without locking it.
+	///
+	/// \return Sequence number of the current frame.
+	///
+	////////////////////////////////////////////////////////////
+	unsigned int GetFrameSequence() { return mFrameSequence; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Keeps a cpu copy of the view alongside the texture.
+	///
+	/// Every paint is then also copied into a frame buffer, which can be read with LockFrame()
+	/// and is what snapshots are taken from, so they never read back from the gpu.
+	/// Turned on by the first RequestSnapshot().  Headless WebInterfaces always have one.
+	/// Turning it on repaints the whole view.
+	///
+	/// \param shadow	True to keep the cpu copy.
+	///
+	////////////////////////////////////////////////////////////
+	void SetFrameShadow(bool shadow);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns whether a cpu copy of the view is kept.
+	///
+	/// \return True if headless or shadowed.
+	///
+	////////////////////////////////////////////////////////////
+	bool HasFrameShadow() { return mHeadless || mFrameShadow; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Takes a scaled down copy of the view in the background.
+	///
+	/// The copy is made from the frame shadow, which is turned on if needed, and downscaled
+	/// with a box filter on the snapshot thread.  Neither the draw thread nor the gpu is
+	/// involved.  The first snapshot after turning on the shadow waits for the repaint.
+	///
+	/// \param scale		Size of the snapshot relative to the view, above 0 and at most 1.
+	/// \param callback	Called on the snapshot thread with the snapshot.
+	///
+	////////////////////////////////////////////////////////////
+	void RequestSnapshot(float scale, SnapshotCallback callback);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Starts recording every paint of this WebInterface to a file.
+	///
+	/// Paints are recorded as cef hands them over, before any rate limit, and can be
+	/// played back with a PaintReader.  Any recording already running is stopped first.
+	///
+	/// \param path		File to record to.  It is overwritten.
+	///
+	/// \return False if the file could not be opened.
+	///
+	////////////////////////////////////////////////////////////
+	bool StartRecording(const std::string& path);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Stops recording, once every paint recorded so far is written.
+	///
+	////////////////////////////////////////////////////////////
+	void StopRecording();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns whether the paints of this WebInterface are being recorded.
+	///
+	/// \return True if recording.
+	///
+	////////////////////////////////////////////////////////////
+	bool IsRecording() { return mpRecorder != NULL; }
+
+private:
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the defaultly handled modifiers for mouse keys.
+	///
+	/// Taken from WebSystem::ProcessEvent(), see InputState.
+	///
+	/// \return Integer representing current mouse modifiers.
+	///
+	////////////////////////////////////////////////////////////
+	static int GetMouseModifiers() { return WebSystem::sInputState.GetModifiers(); }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the defaultly tracked modifiers for keyboard keys.
+	///
+	/// This handles Shift, Control, Alt, and caps and num lock.
+	///
+	/// \return Integer representing current defaultly tracked keyboard modifiers.
+	///
+	////////////////////////////////////////////////////////////
+	static int GetKeyboardModifiers() { return WebSystem::sInputState.GetModifiers() & ~InputState::MOUSE_BUTTON_FLAGS; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Holds data for redundantly updating rectangles on the texture. 
+	///
+	////////////////////////////////////////////////////////////
+	struct UpdateRect
+	{
+	public:
+		char* buffer;
+		CefRect rect;
+	};
+
+	////////////////////////////////////////////////////////////
+	/// \brief Reference to the browser related to this WebInterface.
+	///
+	////////////////////////////////////////////////////////////
+	CefRefPtr<CefBrowser> mBrowser;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Releases the reference to the browser related to this WebInterface.
+	///
+	/// This allows for the browser to be safely closed.
+	///
+	////////////////////////////////////////////////////////////
+	void ClearBrowser() { mBrowser = NULL; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Hands a command for our browser to the cef thread, see WebSystem::PostCommand().
+	///
+	////////////////////////////////////////////////////////////
+	void PostCommand(WebCommand& command) { command.pWeb = this; WebSystem::PostCommand(command); }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Adds an input event to mInput, merging it into the last one where it can.
+	///
+	////////////////////////////////////////////////////////////
+	void QueueInput(const WebCommand& command);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Sends mPendingBindings to our browser and reloads the page.  Only call on the cef thread.
+	///
+	/// Does nothing if there are none, or no browser yet.
+	///
+	////////////////////////////////////////////////////////////
+	void SendBindings();
+
+	////////////////////////////////////////////////////////////
+	/// \brief Asks our browser to repaint part of the view.
+	///
+	////////////////////////////////////////////////////////////
+	void Invalidate(const CefRect& rect);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Handle of the window that this is drawn in.
+	///
+	////////////////////////////////////////////////////////////
+	sf::WindowHandle mHandle;
+
+	////////////////////////////////////////////////////////////
+	/// \brief The texture used for displaying this WebInterface.
+	///
+	////////////////////////////////////////////////////////////
+	sf::Texture* mpTexture;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Whether mpTexture is an atlas page rather than our own texture.
+	///
+	////////////////////////////////////////////////////////////
+	bool mAtlased;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Where in the atlas this WebInterface lives, when atlased.
+	///
+	////////////////////////////////////////////////////////////
+	TextureAtlas::Region mAtlasRegion;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Sets up mpTexture for the current size, in the atlas if atlased and there is room.
 	///
-	/// Calling this is more efficient than multiple calls of AddJsBinding() as it only reloads
-	/// the browser once rather than once per binding.  
+	/// Sets up mTiles instead when tiled, or when the view is too large for one texture.
 	///
 	////////////////////////////////////////////////////////////
-	void AddJSBindings(const std::vector<JsBinding> bindings);
+	void CreateTexture();
 
+	////////////////////////////////////////////////////////////
+	/// \brief Deletes our texture or tiles, or gives our region back to the atlas.
+	///
+	////////////////////////////////////////////////////////////
+	void ReleaseTexture();
 
 	////////////////////////////////////////////////////////////
-	/// \brief Executes javascript.  
+	/// \brief Finds the texture a rect of the view is uploaded to, and where on it.
 	///
-	/// \param code		Code to be executed.
+	/// When tiled the rect must lie within a single tile, see DamageRegion::SplitToGrid().
+	///
+	/// \param rect	Rect in view coordinates.
+	/// \param x		Receives the horizontal position of the rect on the texture.
+	/// \param y		Receives the vertical position of the rect on the texture.
+	///
+	/// \return The texture to upload to.
 	///
 	////////////////////////////////////////////////////////////
-	void ExecuteJS(const CefString& code);
+	sf::Texture* GetUploadTarget(const CefRect& rect, int& x, int& y);
 
 	////////////////////////////////////////////////////////////
-	/// \brief Exectues javascript in specified frame.  
-	///
-	/// \param code		Code to be executed.
-	/// \param frame	Frame to be used for execution.
+	/// \brief Tile size set with SetTileSize().
 	///
 	////////////////////////////////////////////////////////////
-	void ExecuteJS(const CefString& code, CefRefPtr<CefFrame> frame);
+	int mTileSize;
 
 	////////////////////////////////////////////////////////////
-	/// \brief Executes javascript in specified frame, with specified start line.
+	/// \brief Tile size of mTiles, 0 when mpTexture is used instead.
 	///
-	/// \param code			Code to be executed.
-	/// \param frame		Frame to be used for execution.
-	/// \param startLine	Line to be used as starting position.
+	////////////////////////////////////////////////////////////
+	int mActiveTileSize;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Textures of the tiles, row by row.
 	///
 	////////////////////////////////////////////////////////////
-	void ExecuteJS(const CefString& code, CefRefPtr<CefFrame> frame, int startLine);
+	std::vector<sf::Texture*> mTiles;
 
+	////////////////////////////////////////////////////////////
+	/// \brief Number of tiles across the view.
+	///
+	////////////////////////////////////////////////////////////
+	int mTileColumns;
 
 	////////////////////////////////////////////////////////////
-	/// \brief Called internally to handle javascript callbacks.  
+	/// \brief Dirty rects of a paint cut along the tile grid.  Kept to hold on to its capacity.
 	///
-	/// Can also be called externally to fake javascript callbacks for testing etc..
+	////////////////////////////////////////////////////////////
+	std::vector<CefRect> mPaintPieces;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Width of the texture, and also the WebInterface.
 	///
-	/// \return Success of the callback.
+	////////////////////////////////////////////////////////////
+	int mTextureWidth;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Height of the texture, and also the WebInterface.
 	///
 	////////////////////////////////////////////////////////////
-	bool JSCallback(const CefString& name,
-		CefRefPtr<CefListValue> arguments
-		);
+	int mTextureHeight;
 
+	////////////////////////////////////////////////////////////
+	/// \brief Mutex used to prevent multiple threads from operating on the texture at the same time.
+	///
+	////////////////////////////////////////////////////////////
+	sf::Mutex mMutex;
 
 	////////////////////////////////////////////////////////////
-	/// \brief Construct a web interface.
+	/// \brief Rectangles to be redundantly updated, oldest first.
 	///
-	/// \param width			Horizontal size of the WebInterface.
-	/// \param height			Vertical size of the WebInterface.
-	/// \param url				Url to load upon construction.
-	/// \param transparent		Background transparency.
+	/// Emptied with clear() so that its capacity is kept between frames.
 	///
 	////////////////////////////////////////////////////////////
-	WebInterface(int width, int height, const std::string& url, bool transparent, sf::WindowHandle handle);
-	virtual ~WebInterface();
+	std::vector<UpdateRect> mUpdateRects;
 
 	////////////////////////////////////////////////////////////
-	/// \brief Closes this WebInterface so that it can be released.
-	///
-	/// \param force	True will force the browser to close.  False will allow the user to cancel the close.
+	/// \brief Arena which the buffers of mUpdateRects are allocated from.
 	///
-	/// If the close is not forced, the WebInterface is not guaranteed to be
-	/// ready for release, which can cause a memory leak if not tracked carefully.
+	/// Sized from the dimensions of this WebInterface so that painting does
+	/// not touch the heap once the page is running.
 	///
 	////////////////////////////////////////////////////////////
-	void Close(bool force = true) { sf::Lock lock(mMutex); mBrowser->GetHost()->CloseBrowser(force); }
+	StagingArena mStagingArena;
 
 	////////////////////////////////////////////////////////////
-	/// \brief Accesses the browser related this WebInterface
+	/// \brief Returns every buffer in mUpdateRects to the arena and empties it.
 	///
-	/// \return CefRefPtr referencing the browser related to this WebInterface.
+	/// mMutex must be held by the caller.
 	///
 	////////////////////////////////////////////////////////////
-	CefRefPtr<CefBrowser> GetBrowser() { return mBrowser; }
+	void ClearUpdateRects();
 
 	////////////////////////////////////////////////////////////
-	/// \brief Returns the width of this WebInterface.
+	/// \brief Sizes the paint buffers used by the current update mode to the current size, and frees the others.
 	///
-	/// \return Width of this WebInterface.
+	/// mMutex must be held by the caller.
 	///
 	////////////////////////////////////////////////////////////
-	int GetWidth() { return mTextureWidth; }
+	void ResetPaintBuffers();
 
 	////////////////////////////////////////////////////////////
-	/// \brief Returns the height of this WebInterface.
+	/// \brief Drops the queued rects which are completely covered by a newer one.
 	///
-	/// \return Height of this WebInterface.
+	/// mMutex must be held by the caller.
 	///
 	////////////////////////////////////////////////////////////
-	int GetHeight() { return mTextureHeight; }
+	void DropCoveredUpdateRects(const CefRect& rect);
 
 	////////////////////////////////////////////////////////////
-	/// \brief Performs the redundancy update for our texture.  
+	/// \brief Copies a rect out of a cef paint buffer, converting it to the pixel format if needed.
 	///
-	/// This will be called for all WebInterfaces by WebSystem::UpdateInterfaceTextures().
-	/// It can also be called manually for each texture, but as it must be called each frame
-	/// in which an OnPaint for the WebInterface, it is much safter to use WebSystem::UpdateInterfaceTextures().
+	/// \param dst			Where to write the rect.
+	/// \param dstPitch		Bytes between the rows written to dst.
+	/// \param buffer		The full view buffer handed to OnPaint.
+	/// \param bufferWidth	Width of that buffer in pixels.
+	/// \param rect			Rect of the buffer to copy.
 	///
 	////////////////////////////////////////////////////////////
-	void UpdateTexture();
+	void CopyPaintRect(sf::Uint8* dst, int dstPitch, const char* buffer, int bufferWidth, const CefRect& rect);
 
 	////////////////////////////////////////////////////////////
-	/// \brief Returns the texture of this WebInterface.
+	/// \brief Copies the dirty rects of a paint into mFrame.
 	///
-	/// \return Pointer to the texture of this WebInterface.
+	/// mMutex must be held by the caller.
+	///
+	/// \param buffer		The full view buffer handed to OnPaint.
+	/// \param width		Width of that buffer in pixels.
+	/// \param height		Height of that buffer in pixels.
+	/// \param dirtyRects	Rects which changed.
 	///
 	////////////////////////////////////////////////////////////
-	sf::Texture* GetTexture() { return mpTexture; }
+	void WriteFrame(const char* buffer, int width, int height, const CefRenderHandler::RectList& dirtyRects);
 
 	////////////////////////////////////////////////////////////
-	/// \brief Returns the url of the currently loaded web page.
+	/// \brief Downscales mFrame into an image, on the calling thread.
 	///
-	/// \return URL of the currently loaded web page.
+	/// mFrame is only copied while holding mMutex, the downscale runs on the copy so painting
+	/// is not held up.  If nothing has been painted yet, the next paint wakes the snapshot
+	/// thread.
+	///
+	/// \param scale	Size of the image relative to the view.
+	/// \param image	Receives the RGBA image.
+	///
+	/// \return False if nothing has been painted into mFrame yet.
 	///
 	////////////////////////////////////////////////////////////
-	std::string GetCurrentURL() { return mCurrentURL; }
+	bool TakeSnapshot(float scale, sf::Image& image);
 
 	////////////////////////////////////////////////////////////
-	/// \brief Returns background transparency.
-	///
-	/// \return Boolean representing background transparency.
+	/// \brief Dirty rects of the paint being processed, merged.  Only used by OnPaint.
 	///
 	////////////////////////////////////////////////////////////
-	bool IsTransparent() { return mTransparent; }
+	DamageRegion mPaintDamage;
 
 	////////////////////////////////////////////////////////////
-	/// \brief Used to change the size of this WebInterface.
+	/// \brief What the last call to UpdateTexture() uploaded.
 	///
-	/// \param width	New horizontal size.
-	/// \param height	New vertical size.
+	////////////////////////////////////////////////////////////
+	UploadStats mUploadStats;
+
+	////////////////////////////////////////////////////////////
+	/// \brief How painted rects reach the texture.
 	///
 	////////////////////////////////////////////////////////////
-	void SetSize(int width, int height);
+	UpdateMode mUpdateMode;
 
-private:
 	////////////////////////////////////////////////////////////
-	/// \brief Returns the defaultly handled modifiers for mouse keys.
+	/// \brief Frames passed from OnPaint to UpdateTexture() in UPDATE_HANDOFF mode.
 	///
-	/// \return Integer representing current mouse modifiers.
+	////////////////////////////////////////////////////////////
+	FrameHandoff mHandoff;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Gets the rects of UpdateTexture() to the texture.  Only used on the draw thread.
 	///
 	////////////////////////////////////////////////////////////
-	static int GetMouseModifiers();
+	TextureUploader mUploader;
 
 	////////////////////////////////////////////////////////////
-	/// \brief Returns the defaultly tracked modifiers for keyboard keys.
+	/// \brief Channel order painted rects are copied and uploaded in.
 	///
-	/// This only handles Shift, Control, and Alt.
+	////////////////////////////////////////////////////////////
+	TextureUploader::Format mPixelFormat;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Highest number of paints per second which reach the texture, 0 for no limit.
 	///
-	/// \return Integer representing current defaultly tracked keyboard modifiers.
+	////////////////////////////////////////////////////////////
+	float mMaxPaintRate;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Time since a paint was last applied.  Only used on the cef thread.
 	///
 	////////////////////////////////////////////////////////////
-	static int GetKeyboardModifiers();
+	sf::Clock mPaintClock;
 
 	////////////////////////////////////////////////////////////
-	/// \brief Holds data for redundantly updating rectangles on the texture. 
+	/// \brief Damage of paints held back by the paint rate limit.  Only used on the cef thread.
 	///
 	////////////////////////////////////////////////////////////
-	struct UpdateRect
-	{
-	public:
-		char* buffer;
-		CefRect rect;
-	};
+	DamageRegion mThrottledDamage;
 
 	////////////////////////////////////////////////////////////
-	/// \brief Reference to the browser related to this WebInterface.
+	/// \brief Checks whether the paint rate limit lets the next paint through.  Only used on the cef thread.
 	///
 	////////////////////////////////////////////////////////////
-	CefRefPtr<CefBrowser> mBrowser;
+	bool IsPaintDue();
 
 	////////////////////////////////////////////////////////////
-	/// \brief Releases the reference to the browser related to this WebInterface.
+	/// \brief Held back damage plus the dirty rects of the paint applying it.  Only used on the cef thread.
 	///
-	/// This allows for the browser to be safely closed.
+	////////////////////////////////////////////////////////////
+	CefRenderHandler::RectList mThrottledRects;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Whether a repaint of mThrottledDamage has been asked for.  Only used on the cef thread.
 	///
 	////////////////////////////////////////////////////////////
-	void ClearBrowser() { mBrowser = NULL; }
+	bool mThrottleInvalidated;
 
 	////////////////////////////////////////////////////////////
-	/// \brief Handle of the window that this is drawn in.
+	/// \brief Whether this WebInterface is shown.  Paints are dropped while hidden.
 	///
 	////////////////////////////////////////////////////////////
-	sf::WindowHandle mHandle;
+	bool mVisible;
 
 	////////////////////////////////////////////////////////////
-	/// \brief The texture used for displaying this WebInterface.
+	/// \brief Whether UpdateInterfaceTextures() manages mVisible.
 	///
 	////////////////////////////////////////////////////////////
-	sf::Texture* mpTexture;
+	bool mAutoVisibility;
 
 	////////////////////////////////////////////////////////////
-	/// \brief Width of the texture, and also the WebInterface.
+	/// \brief Whether MarkDrawn() was called since the last UpdateInterfaceTextures().
 	///
 	////////////////////////////////////////////////////////////
-	int mTextureWidth;
+	bool mDrawn;
 
 	////////////////////////////////////////////////////////////
-	/// \brief Height of the texture, and also the WebInterface.
+	/// \brief Whether the texture is drawn as premultiplied alpha.
 	///
 	////////////////////////////////////////////////////////////
-	int mTextureHeight;
+	bool mPremultipliedAlpha;
 
 	////////////////////////////////////////////////////////////
-	/// \brief Mutex used to prevent multiple threads from operating on the texture at the same time.
+	/// \brief Shader used by GetPremultipliedRenderStates(), created on first use.
+	///
+	/// Kept for the life of the program, as it can not safely be destroyed after
+	/// sfml has torn down its contexts at exit.
 	///
 	////////////////////////////////////////////////////////////
-	sf::Mutex mMutex;
+	static sf::Shader* spPremultipliedShader;
 
 	////////////////////////////////////////////////////////////
-	/// \brief Queue of rectangles to be redundantly updated.
+	/// \brief Whether creating spPremultipliedShader has been attempted.
 	///
 	////////////////////////////////////////////////////////////
-	std::queue<UpdateRect> mUpdateRects;
+	static bool sPremultipliedShaderLoaded;
 
 	////////////////////////////////////////////////////////////
 	/// \brief URL of the current web page.
@@ -739,12 +2196,151 @@ private:
 	//////////////////////////////////////////////////////////// 
 	bool mTransparent;
 
+	////////////////////////////////////////////////////////////
+	/// \brief Whether the view is kept in mFrame instead of a texture.
+	///
+	/// This cannot be changed after creation.
+	///
+	//////////////////////////////////////////////////////////// 
+	bool mHeadless;
+
+	////////////////////////////////////////////////////////////
+	/// \brief The view of a headless or shadowed WebInterface, guarded by mMutex.
+	///
+	////////////////////////////////////////////////////////////
+	std::vector<sf::Uint8> mFrame;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Whether mFrame is kept alongside the texture.
+	///
+	////////////////////////////////////////////////////////////
+	bool mFrameShadow;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Whether mFrame has been painted since it was last allocated.
+	///
+	////////////////////////////////////////////////////////////
+	bool mFramePainted;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Whether a snapshot is waiting for mFrame to be painted.  Guarded by mMutex.
+	///
+	////////////////////////////////////////////////////////////
+	bool mSnapshotWaiting;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Copy of mFrame taken by TakeSnapshot().  Only used on the snapshot thread.
+	///
+	/// Kept between snapshots, so copying does not allocate once it has grown to size.
+	///
+	////////////////////////////////////////////////////////////
+	std::vector<sf::Uint8> mSnapshotFrame;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Records our paints, NULL when not recording.  Guarded by mMutex.
+	///
+	////////////////////////////////////////////////////////////
+	PaintRecorder* mpRecorder;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Called once our browser has been created, or NULL.
+	///
+	////////////////////////////////////////////////////////////
+	InterfaceCallback mfpCreatedCallback;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Input events waiting for FlushInput(), guarded by mInputMutex.
+	///
+	////////////////////////////////////////////////////////////
+	std::vector<WebCommand> mInput;
+	sf::Mutex mInputMutex;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Whether a flush has been posted which the cef thread has not run yet.
+	///
+	/// Input queued meanwhile goes out with that flush.  Guarded by mInputMutex.
+	///
+	////////////////////////////////////////////////////////////
+	bool mInputPosted;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Focus given by the last focus event in mInput, 1 or 0, or -1 if there is none.
+	///
+	////////////////////////////////////////////////////////////
+	int mInputFocus;
+
+	////////////////////////////////////////////////////////////
+	/// \brief The input being sent, swapped with mInput.  Only used on the cef thread.
+	///
+	/// The two are swapped back and forth so both keep their capacity.
+	///
+	////////////////////////////////////////////////////////////
+	std::vector<WebCommand> mInputBatch;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Whether this was made by WebSystem::Prerender() and has not been swapped in yet.
+	///
+	////////////////////////////////////////////////////////////
+	volatile bool mPrerender;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Whether the prerendered page has painted the whole view.
+	///
+	////////////////////////////////////////////////////////////
+	volatile bool mPrerendered;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Set by that paint, for HidePrerendered() to hide the browser again.
+	///
+	////////////////////////////////////////////////////////////
+	volatile bool mPrerenderHide;
+
+	////////////////////////////////////////////////////////////
+	/// \brief WebInterface whose bindings are copied once our browser exists, or NULL.
+	///
+	////////////////////////////////////////////////////////////
+	CefRefPtr<WebInterface> mpBindingSource;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Bindings waiting for the cef thread to send them.  Guarded by mMutex.
+	///
+	/// Stay here until we have a browser, then AttachBrowser() sends them.
+	///
+	////////////////////////////////////////////////////////////
+	std::vector<JsBinding> mPendingBindings;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Number of paints applied to mFrame.
+	///
+	////////////////////////////////////////////////////////////
+	volatile unsigned int mFrameSequence;
+
 public:
 	////////////////////////////////////////////////////////////
 	/// \brief Implement cef reference counting.
 	///
+	/// Done by hand rather than with IMPLEMENT_REFCOUNTING, as WebInterfaces found through
+	/// WebSystem::sWebInterfaces may already have lost their last reference.  Those must only
+	/// be referenced with TryAddRef(), and are deleted on the app thread, see
+	/// WebSystem::DeleteInterface().
+	///
+	////////////////////////////////////////////////////////////
+	int AddRef();
+	int Release();
+	int GetRefCt() { return mRefCount; }
+
+	////////////////////////////////////////////////////////////
+	/// \brief Takes a reference unless the last one is already gone.
+	///
+	/// \return True if a reference was taken.
+	///
 	////////////////////////////////////////////////////////////
-	IMPLEMENT_REFCOUNTING(WebInterface);
+	bool TryAddRef();
+
+private:
+	volatile long mRefCount;
+
+public:
 
 	////////////////////////////////////////////////////////////
 	/// \brief Implement cef locking mechanism.
@@ -753,6 +2349,56 @@ public:
 	IMPLEMENT_LOCKING(WebInterface);
 };
 
+////////////////////////////////////////////////////////////
+/// \brief The CefClient each of our browsers is created with.
+///
+/// Hands every call on to WebSystem, and carries the WebInterface the browser was created
+/// for, so OnAfterCreated() knows whose browser it is however browsers arrive.
+///
+////////////////////////////////////////////////////////////
+class WebBrowserClient : public CefClient
+{
+public:
+	////////////////////////////////////////////////////////////
+	/// \param pWeb	WebInterface the browser is for, NULL for a spare for the pool.
+	///
+	////////////////////////////////////////////////////////////
+	WebBrowserClient(CefRefPtr<WebInterface> pWeb) : mpWeb(pWeb) {}
+
+	////////////////////////////////////////////////////////////
+	/// \brief Returns the WebInterface the browser was created for, and lets go of it.
+	///
+	/// Only the first call returns it, so the browser does not keep the WebInterface alive.
+	///
+	////////////////////////////////////////////////////////////
+	CefRefPtr<WebInterface> TakeInterface() { CefRefPtr<WebInterface> pWeb = mpWeb; mpWeb = NULL; return pWeb; }
+
+	////////////////////////////////////////////////////////////
+	/// Cef Handler retrieval methods.  Called by Cef.
+	///
+	////////////////////////////////////////////////////////////
+	virtual CefRefPtr<CefLifeSpanHandler> GetLifeSpanHandler() override { return WebSystem::GetInstance().get(); }
+	virtual CefRefPtr<CefLoadHandler> GetLoadHandler() override { return WebSystem::GetInstance().get(); }
+	virtual CefRefPtr<CefRequestHandler> GetRequestHandler() override { return WebSystem::GetInstance().get(); }
+	virtual CefRefPtr<CefDisplayHandler> GetDisplayHandler() override { return WebSystem::GetInstance().get(); }
+	virtual CefRefPtr<CefRenderHandler> GetRenderHandler() override { return WebSystem::GetInstance().get(); }
+	virtual CefRefPtr<CefKeyboardHandler> GetKeyboardHandler() override { return WebSystem::GetInstance().get(); }
+
+	virtual bool OnProcessMessageReceived(CefRefPtr<CefBrowser> browser, CefProcessId source_process, CefRefPtr<CefProcessMessage> message) override
+	{
+		return WebSystem::GetInstance()->OnProcessMessageReceived(browser, source_process, message);
+	}
+
+private:
+	CefRefPtr<WebInterface> mpWeb;
+
+	////////////////////////////////////////////////////////////
+	/// \brief Implement cef reference counting.
+	///
+	////////////////////////////////////////////////////////////
+	IMPLEMENT_REFCOUNTING(WebBrowserClient);
+};
+
 ////////////////////////////////////////////////////////////
 /// \brief CefV8Handler implementation which executes bound javascript callbacks.
 ///
@@ -764,7 +2410,11 @@ class WebV8Handler : public CefV8Handler
 	friend class WebSystem;
 
 public:
-	WebV8Handler() {}
+	////////////////////////////////////////////////////////////
+	/// \param id	Binding ID of the function this handles.
+	///
+	////////////////////////////////////////////////////////////
+	WebV8Handler(int id) : mBindingId(id) {}
 
 	////////////////////////////////////////////////////////////
 	/// \brief Called by Cef when a bound function has been called in javascript.
@@ -787,4 +2437,10 @@ private:
 	///
 	////////////////////////////////////////////////////////////
 	IMPLEMENT_REFCOUNTING(WebV8Handler);
+
+	////////////////////////////////////////////////////////////
+	/// \brief Sent in place of the function name, see WebSystem::InternBinding().
+	///
+	////////////////////////////////////////////////////////////
+	int mBindingId;
 };
\ No newline at end of file